@@ -0,0 +1,357 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/param.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "esp_log.h"
+#include "globals.h"
+#include "db_protocol.h"
+#include "db_bench.h"
+#include "db_metrics.h"
+#include "db_esp32_control.h"
+#include "db_esp32_settings.h"
+#include "msp_ltm_serial.h"
+#include "mavlink_serial.h"
+
+#define SEND_TIME_WINDOW (1 << 20)          // generated frames whose write time is remembered for the latency
+#define MAX_TRACKED_FRAMES (1 << 26)        // sequence numbers tracked per run for losses & duplicates
+#define MAX_LATENCY_SAMPLES (1 << 22)
+#define PACE_INTERVAL_US 1000
+#define DRAIN_TIMEOUT_US 1000000            // time the bridge gets to forward the last generated frames
+#define KEEPALIVE_INTERVAL_US 1000000       // UDP clients send something now and then or the bridge removes them
+#define BRIDGE_START_DELAY_US 500000
+#define MAX_CLIENTS 8                       // downlink goes to all of them. Only the first one checks the frames
+
+EventGroupHandle_t wifi_event_group;
+
+typedef struct {
+    int pty_master;
+    uint32_t rate_bps;          // 0 = as fast as the pseudo terminal takes it
+    int64_t duration_us;
+    volatile bool running;
+    volatile uint32_t generated_frames;
+    volatile uint32_t generated_bytes;
+    int64_t *send_time_us;      // write time of frame sequence % SEND_TIME_WINDOW
+    int64_t cpu_us;             // CPU time used by the generator thread
+} generator_context_t;
+
+typedef struct {
+    uint8_t *seen;              // bitmap of received sequence numbers relative to base_sequence
+    bool have_base;
+    uint32_t base_sequence;
+    uint32_t max_sequence;
+    uint32_t frames;
+    uint32_t duplicates;
+    uint32_t bytes;
+    uint64_t forwarded_bytes;   // received by all clients
+    uint32_t *latency_us;
+    uint32_t latency_count;
+    const int64_t *send_time_us;    // NULL if the generator runs on a remote device
+    volatile const uint32_t *generated_frames;
+} receiver_stats_t;
+
+static receiver_stats_t receiver;
+
+static int64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/**
+ * @param who RUSAGE_SELF for the whole process, RUSAGE_THREAD for the calling thread
+ * @return User + system CPU time in us
+ */
+static int64_t cpu_time_us(int who) {
+    struct rusage usage;
+    getrusage(who, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL + usage.ru_utime.tv_usec +
+           usage.ru_stime.tv_usec;
+}
+
+/**
+ * Flight controller stand-in: writes generated frames to the pseudo terminal the bridge reads from, paced to rate_bps.
+ * Everything the bridge writes to the "UART" is read & discarded
+ */
+static void *generator_thread(void *arg) {
+    generator_context_t *context = arg;
+    db_bench_generator_t generator;
+    memset(&generator, 0, sizeof(generator));
+    uint8_t frame[DB_BENCH_MAX_FRAME_SIZE], uplink[512];
+    int64_t start = now_us();
+    while (now_us() - start < context->duration_us) {
+        int64_t now = now_us();
+        uint64_t due = context->rate_bps ? (uint64_t) (now - start) * context->rate_bps / 1000000 : UINT64_MAX;
+        uint32_t burst = 0;
+        while (generator.bytes < due && burst < 64 * 1024) {
+            uint32_t sequence = generator.sequence;
+            uint16_t length = db_bench_next_frame(&generator, SERIAL_PROTOCOL, frame);
+            context->send_time_us[sequence % SEND_TIME_WINDOW] = now_us();
+            for (uint16_t written = 0; written < length;) {
+                ssize_t n = write(context->pty_master, &frame[written], length - written);
+                if (n > 0) written += n;
+                else if (errno == EAGAIN) usleep(100);  // bridge does not keep up - a real UART would overflow
+                else return NULL;
+            }
+            burst += length;
+            context->generated_frames = generator.frames;
+            context->generated_bytes = generator.bytes;
+        }
+        while (read(context->pty_master, uplink, sizeof(uplink)) > 0) {}
+        if (context->rate_bps) usleep(PACE_INTERVAL_US);
+    }
+    context->cpu_us = cpu_time_us(RUSAGE_THREAD);
+    context->running = false;
+    return NULL;
+}
+
+static void on_frame(const uint8_t *frame, uint16_t frame_length) {
+    uint32_t sequence;
+    if (!db_bench_frame_sequence(frame, frame_length, &sequence)) return;
+    int64_t now = now_us();
+    if (!receiver.have_base) {
+        receiver.have_base = true;
+        receiver.base_sequence = receiver.send_time_us ? 0 : sequence;  // remote generator started before us
+    }
+    uint32_t index = sequence - receiver.base_sequence;
+    if (sequence < receiver.base_sequence || index >= MAX_TRACKED_FRAMES) return;
+    if (receiver.seen[index / 8] & (1 << (index % 8))) {
+        receiver.duplicates++;
+        return;
+    }
+    receiver.seen[index / 8] |= (uint8_t) (1 << (index % 8));
+    receiver.frames++;
+    if (sequence > receiver.max_sequence) receiver.max_sequence = sequence;
+    if (receiver.send_time_us && receiver.latency_count < MAX_LATENCY_SAMPLES &&
+        *receiver.generated_frames - sequence < SEND_TIME_WINDOW) {
+        receiver.latency_us[receiver.latency_count++] =
+                (uint32_t) (now - receiver.send_time_us[sequence % SEND_TIME_WINDOW]);
+    }
+}
+
+static void on_msp_ltm(msp_ltm_port_t *msp_ltm_port) {
+    const uint8_t *frame;
+    uint16_t frame_length = get_msp_ltm_frame(msp_ltm_port, &frame);
+    on_frame(frame, frame_length);
+}
+
+static int connect_client(bool tcp, const char *bridge_ip, struct sockaddr_in *bridge_addr) {
+    memset(bridge_addr, 0, sizeof(*bridge_addr));
+    bridge_addr->sin_family = AF_INET;
+    bridge_addr->sin_port = htons(tcp ? APP_PORT_PROXY : APP_PORT_PROXY_UDP);
+    inet_pton(AF_INET, bridge_ip, &bridge_addr->sin_addr);
+    int fd = socket(AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    int rcvbuf = 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (tcp) {
+        for (int attempt = 0; connect(fd, (struct sockaddr *) bridge_addr, sizeof(*bridge_addr)) != 0; attempt++) {
+            if (attempt == 50) {
+                perror("connect");
+                exit(EXIT_FAILURE);
+            }
+            close(fd);
+            fd = socket(AF_INET, SOCK_STREAM, 0);
+            usleep(100000);
+        }
+    }
+    return fd;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Reads the downlink of all clients until the generator stopped and the bridge had DRAIN_TIMEOUT_US to forward the
+ * rest. Remote mode: until duration_us passed. Only the frames of the first client are checked, the other clients
+ * are only counted
+ */
+static void receive(const int fds[], int client_count, bool tcp, const struct sockaddr_in *bridge_addr,
+                    generator_context_t *generator, int64_t duration_us) {
+    static msp_ltm_port_t msp_ltm_port;
+    static mavlink_port_t mavlink_port;
+    init_mavlink_port(&mavlink_port);
+    uint8_t buffer[8192];
+    struct pollfd pfds[MAX_CLIENTS];
+    for (int i = 0; i < client_count; i++) pfds[i] = (struct pollfd) {.fd = fds[i], .events = POLLIN};
+    int64_t start = now_us(), stop = generator ? 0 : start + duration_us, last_keepalive = 0;
+    while (stop == 0 || now_us() < stop) {
+        if (!tcp && now_us() - last_keepalive >= KEEPALIVE_INTERVAL_US) {
+            uint8_t keepalive = 0;
+            for (int i = 0; i < client_count; i++)
+                sendto(fds[i], &keepalive, 1, 0, (const struct sockaddr *) bridge_addr, sizeof(*bridge_addr));
+            last_keepalive = now_us();
+        }
+        if (generator && stop == 0 && !generator->running) stop = now_us() + DRAIN_TIMEOUT_US;
+        if (poll(pfds, client_count, 10) <= 0) continue;
+        for (int i = 0; i < client_count; i++) {
+            if (!(pfds[i].revents & (POLLIN | POLLERR | POLLHUP))) continue;
+            ssize_t length = recv(fds[i], buffer, sizeof(buffer), 0);
+            if (length <= 0) {
+                if (tcp) return;
+                continue;
+            }
+            receiver.forwarded_bytes += length;
+            if (i > 0) continue;
+            receiver.bytes += length;
+            if (SERIAL_PROTOCOL == 1 || SERIAL_PROTOCOL == 2) {
+                parse_msp_ltm_buffer(&msp_ltm_port, buffer, (size_t) length, on_msp_ltm);
+            } else {
+                size_t pos = 0;
+                while (parse_mavlink_buffer(&mavlink_port, buffer, (size_t) length, &pos))
+                    on_frame(mavlink_port.frame_buffer, mavlink_port.frame_length);
+            }
+        }
+    }
+}
+
+static void print_usage(const char *name) {
+    fprintf(stderr, "Usage: %s [options]\n"
+                    "Runs the bridge with a pseudo terminal as UART and a generated flight controller stream. Receives\n"
+                    "the downlink as a TCP or UDP client and checks the sequence numbers of the frames.\n"
+                    "  -p <1-5>   SERIAL_PROTOCOL: 1,2=MSP/LTM, 3=MAVLink, 4,5=transparent. Default 3\n"
+                    "  -b <baud>  UART baud rate. Generated rate is baud / 10 (8N1). Default 115200\n"
+                    "  -r <B/s>   generated bytes per second instead. 0 = as fast as possible\n"
+                    "  -t <bytes> TRANSPARENT_BUF_SIZE\n"
+                    "  -m <bytes> MSP_LTM_PACKET_SIZE\n"
+                    "  -w <us>    SERIAL_HOLD_TIME_US\n"
+                    "  -c <tcp|udp> client type. Default tcp\n"
+                    "  -n <1-8>   number of clients. Default 1. CPU time per forwarded byte counts all of them\n"
+                    "  -d <s>     duration. Default 5\n"
+                    "  -l <ratio> exit with failure if more frames are lost. Default 1\n"
+                    "  -R <ip>    no local bridge: receive from a device built with DB_BENCHMARK. -p must match\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    esp_log_level_set("*", ESP_LOG_WARN);
+    read_settings_nvs();
+    uint32_t rate_bps = 0;
+    bool rate_set = false, tcp = true;
+    int client_count = 1;
+    double duration_s = 5, max_loss = 1;
+    const char *remote_ip = NULL;
+    SERIAL_PROTOCOL = 3;
+    DB_UART_BAUD_RATE = 115200;
+    int option;
+    while ((option = getopt(argc, argv, "p:b:r:t:m:w:c:n:d:l:R:h")) != -1) {
+        switch (option) {
+            case 'p': SERIAL_PROTOCOL = (uint8_t) atoi(optarg); break;
+            case 'b': DB_UART_BAUD_RATE = (uint32_t) atoi(optarg); break;
+            case 'r': rate_bps = (uint32_t) atoi(optarg); rate_set = true; break;
+            case 't': TRANSPARENT_BUF_SIZE = (uint16_t) atoi(optarg); break;
+            case 'm': MSP_LTM_PACKET_SIZE = (uint16_t) atoi(optarg); break;
+            case 'w': SERIAL_HOLD_TIME_US = (uint32_t) atoi(optarg); break;
+            case 'c': tcp = strcmp(optarg, "udp") != 0; break;
+            case 'n': client_count = MIN(MAX(atoi(optarg), 1), MAX_CLIENTS); break;
+            case 'd': duration_s = atof(optarg); break;
+            case 'l': max_loss = atof(optarg); break;
+            case 'R': remote_ip = optarg; break;
+            default:
+                print_usage(argv[0]);
+                return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (!rate_set) rate_bps = DB_UART_BAUD_RATE / 10;
+    signal(SIGPIPE, SIG_IGN);
+
+    static generator_context_t generator;
+    generator.rate_bps = rate_bps;
+    generator.duration_us = (int64_t) (duration_s * 1000000);
+    generator.running = true;
+    receiver.seen = calloc(MAX_TRACKED_FRAMES / 8, 1);
+    receiver.latency_us = malloc(MAX_LATENCY_SAMPLES * sizeof(uint32_t));
+    receiver.generated_frames = &generator.generated_frames;
+    pthread_t generator_handle;
+    if (remote_ip == NULL) {
+        generator.send_time_us = calloc(SEND_TIME_WINDOW, sizeof(int64_t));
+        receiver.send_time_us = generator.send_time_us;
+        generator.pty_master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (generator.pty_master == -1 || grantpt(generator.pty_master) || unlockpt(generator.pty_master)) {
+            perror("posix_openpt");
+            return EXIT_FAILURE;
+        }
+        setenv("DB_UART_DEVICE", ptsname(generator.pty_master), 1);
+        wifi_event_group = xEventGroupCreate();
+        xEventGroupSetBits(wifi_event_group, BIT2);
+        control_module();
+        usleep(BRIDGE_START_DELAY_US);
+    }
+    struct sockaddr_in bridge_addr;
+    int fds[MAX_CLIENTS];
+    for (int i = 0; i < client_count; i++) {
+        fds[i] = connect_client(tcp, remote_ip ? remote_ip : "127.0.0.1", &bridge_addr);
+        if (!tcp) {  // register as UDP client before the first frame
+            uint8_t hello = 0;
+            sendto(fds[i], &hello, 1, 0, (struct sockaddr *) &bridge_addr, sizeof(bridge_addr));
+        }
+    }
+    usleep(100000);
+    int64_t start = now_us(), cpu_start = cpu_time_us(RUSAGE_SELF), receiver_cpu_start = cpu_time_us(RUSAGE_THREAD);
+    if (remote_ip == NULL) pthread_create(&generator_handle, NULL, generator_thread, &generator);
+    receive(fds, client_count, tcp, &bridge_addr, remote_ip ? NULL : &generator, generator.duration_us);
+    int64_t receiver_cpu_us = cpu_time_us(RUSAGE_THREAD) - receiver_cpu_start;
+    double seconds = (now_us() - start) / 1e6, wall_seconds = seconds;
+    if (remote_ip == NULL) {
+        pthread_join(generator_handle, NULL);
+        seconds = duration_s;
+    }
+
+    uint32_t expected = remote_ip ? (receiver.frames ? receiver.max_sequence - receiver.base_sequence + 1 : 0)
+                                  : generator.generated_frames;
+    uint32_t lost = expected > receiver.frames ? expected - receiver.frames : 0;
+    double loss = expected ? (double) lost / expected : 0;
+    printf("proto %i baud %u pkt %u/%u hold %uus %s x%i: offered %.0f B/s received %.0f B/s | frames %u lost %u (%.3f%%) "
+           "dup %u", SERIAL_PROTOCOL, DB_UART_BAUD_RATE, TRANSPARENT_BUF_SIZE, MSP_LTM_PACKET_SIZE,
+           SERIAL_HOLD_TIME_US, tcp ? "tcp" : "udp", client_count, remote_ip ? 0 : generator.generated_bytes / seconds,
+           receiver.bytes / seconds, expected, lost, loss * 100, receiver.duplicates);
+    if (receiver.latency_count > 0) {
+        qsort(receiver.latency_us, receiver.latency_count, sizeof(uint32_t), compare_u32);
+        printf(" | latency p50 %u p99 %u max %u us", receiver.latency_us[receiver.latency_count / 2],
+               receiver.latency_us[(uint32_t) (receiver.latency_count * 0.99)],
+               receiver.latency_us[receiver.latency_count - 1]);
+    }
+    if (remote_ip == NULL && receiver.forwarded_bytes > 0) {
+        // process CPU time without the generator (flight controller) and the receiving clients
+        int64_t bridge_cpu_us = cpu_time_us(RUSAGE_SELF) - cpu_start - generator.cpu_us - receiver_cpu_us;
+        printf(" | cpu %.1f ns/forwarded B (%.1f%% of a core)", bridge_cpu_us * 1000.0 / receiver.forwarded_bytes,
+               bridge_cpu_us / (wall_seconds * 1e4));
+    }
+    if (remote_ip == NULL) {
+        printf(" | bridge: uart_rx %u bad_crc %u ring_drop %u", db_metrics.uart_rx_bytes,
+               db_metrics.parser_bad_checksums, db_metrics.downlink_dropped);
+    }
+    printf("\n");
+    return (expected == 0 || loss > max_loss) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
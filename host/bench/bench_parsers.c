@@ -0,0 +1,245 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "msp_ltm_serial.h"
+#include "mavlink_serial.h"
+
+#define MAX_STREAMS 32
+#define MAX_STREAM_SIZE (1024 * 1024)
+#define READ_SIZE 128           // replayed in chunks like the UART reads them
+#define MIN_RUN_SECONDS 0.2
+#define RUNS 5                  // best of
+#define DEFAULT_TOLERANCE 2.0   // fail if slower than baseline * tolerance
+
+typedef struct {
+    uint32_t frames;
+    uint32_t bad_checksums;
+    uint32_t resyncs;
+} parse_result_t;
+
+typedef parse_result_t (*replay_fn_t)(const uint8_t *stream, size_t length);
+
+typedef struct {
+    char stream[64];
+    char parser[16];
+    double ns_per_byte;
+    uint32_t frames;
+} baseline_entry_t;
+
+static uint32_t buffer_frames;
+
+/**
+ * Replays with parse_msp_ltm_byte() like the MSP uplink path
+ */
+static parse_result_t replay_msp_ltm_byte(const uint8_t *stream, size_t length) {
+    msp_ltm_port_t port;
+    memset(&port, 0, sizeof(port));
+    parse_result_t result = {0};
+    for (size_t i = 0; i < length; i++) {
+        if (!parse_msp_ltm_byte(&port, stream[i])) continue;
+        if (port.parse_state == MSP_PACKET_RECEIVED || port.parse_state == LTM_PACKET_RECEIVED) result.frames++;
+    }
+    result.bad_checksums = port.bad_checksums;
+    result.resyncs = port.resyncs;
+    return result;
+}
+
+static void count_frame(msp_ltm_port_t *msp_ltm_port) {
+    (void) msp_ltm_port;
+    buffer_frames++;
+}
+
+/**
+ * Replays with parse_msp_ltm_buffer() like the MSP/LTM downlink path
+ */
+static parse_result_t replay_msp_ltm_buffer(const uint8_t *stream, size_t length) {
+    msp_ltm_port_t port;
+    memset(&port, 0, sizeof(port));
+    buffer_frames = 0;
+    for (size_t pos = 0; pos < length; pos += READ_SIZE) {
+        parse_msp_ltm_buffer(&port, &stream[pos], length - pos < READ_SIZE ? length - pos : READ_SIZE, count_frame);
+    }
+    parse_result_t result = {buffer_frames, port.bad_checksums, port.resyncs};
+    return result;
+}
+
+static parse_result_t replay_mavlink_buffer(const uint8_t *stream, size_t length) {
+    static mavlink_port_t port;
+    init_mavlink_port(&port);
+    parse_result_t result = {0};
+    for (size_t pos = 0; pos < length; pos += READ_SIZE) {
+        size_t chunk = length - pos < READ_SIZE ? length - pos : READ_SIZE, chunk_pos = 0;
+        while (parse_mavlink_buffer(&port, &stream[pos], chunk, &chunk_pos)) result.frames++;
+    }
+    result.bad_checksums = port.bad_crcs;
+    result.resyncs = port.resyncs;
+    return result;
+}
+
+static replay_fn_t get_replay_fn(const char *parser) {
+    if (strcmp(parser, "msp_byte") == 0) return replay_msp_ltm_byte;
+    if (strcmp(parser, "msp_buffer") == 0) return replay_msp_ltm_buffer;
+    if (strcmp(parser, "mavlink") == 0) return replay_mavlink_buffer;
+    return NULL;
+}
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @return Best ns/byte of RUNS runs that replay the stream for at least MIN_RUN_SECONDS each
+ */
+static double measure(replay_fn_t replay, const uint8_t *stream, size_t length) {
+    double best = 0;
+    for (int run = 0; run < RUNS; run++) {
+        size_t bytes = 0;
+        double start = now_s(), elapsed;
+        do {
+            replay(stream, length);
+            bytes += length;
+            elapsed = now_s() - start;
+        } while (elapsed < MIN_RUN_SECONDS);
+        double ns_per_byte = elapsed * 1e9 / bytes;
+        if (run == 0 || ns_per_byte < best) best = ns_per_byte;
+    }
+    return best;
+}
+
+static uint8_t *read_stream(const char *dir, const char *name, size_t *length) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.bin", dir, name);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+    uint8_t *stream = malloc(MAX_STREAM_SIZE);
+    *length = fread(stream, 1, MAX_STREAM_SIZE, f);
+    fclose(f);
+    return stream;
+}
+
+static int read_baseline(const char *path, baseline_entry_t *entries) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    char line[256];
+    int count = 0;
+    while (fgets(line, sizeof(line), f) && count < MAX_STREAMS) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        baseline_entry_t *entry = &entries[count];
+        if (sscanf(line, "%63s %15s %lf %u", entry->stream, entry->parser, &entry->ns_per_byte, &entry->frames) == 4)
+            count++;
+    }
+    fclose(f);
+    return count;
+}
+
+static void write_baseline(const char *path, const baseline_entry_t *entries, int count) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return;
+    }
+    fprintf(f, "# Parser replay baseline, written by bench_parsers -u\n# stream parser ns/byte frames\n");
+    for (int i = 0; i < count; i++) {
+        fprintf(f, "%s %s %.2f %u\n", entries[i].stream, entries[i].parser, entries[i].ns_per_byte, entries[i].frames);
+    }
+    fclose(f);
+}
+
+static void usage() {
+    printf("Replays recorded serial streams through the MSP/LTM & MAVLink parsers and compares the throughput with a\n"
+           "baseline. Fails if a parser is slower than baseline * tolerance or finds a different number of frames.\n\n"
+           "bench_parsers [-t tolerance] [-u] <baseline file> <stream directory>\n"
+           "  -t  tolerance factor, default %.1f\n"
+           "  -u  write the measured values to the baseline file\n", DEFAULT_TOLERANCE);
+}
+
+int main(int argc, char **argv) {
+    double tolerance = DEFAULT_TOLERANCE;
+    int update = 0, opt;
+    while ((opt = getopt(argc, argv, "t:uh")) != -1) {
+        switch (opt) {
+            case 't':
+                tolerance = atof(optarg);
+                break;
+            case 'u':
+                update = 1;
+                break;
+            default:
+                usage();
+                return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (argc - optind != 2) {
+        usage();
+        return 2;
+    }
+    const char *baseline_path = argv[optind], *stream_dir = argv[optind + 1];
+    baseline_entry_t entries[MAX_STREAMS];
+    int count = read_baseline(baseline_path, entries);
+    if (count <= 0) return 2;
+
+    int failures = 0;
+    printf("%-16s %-10s %8s %10s %8s %8s %8s %10s\n", "stream", "parser", "ns/byte", "frames/s", "frames", "bad_crc",
+           "resyncs", "baseline");
+    for (int i = 0; i < count; i++) {
+        baseline_entry_t *entry = &entries[i];
+        replay_fn_t replay = get_replay_fn(entry->parser);
+        size_t length;
+        uint8_t *stream = read_stream(stream_dir, entry->stream, &length);
+        if (replay == NULL || stream == NULL) {
+            fprintf(stderr, "%s: unknown parser '%s' or missing stream\n", entry->stream, entry->parser);
+            free(stream);
+            failures++;
+            continue;
+        }
+        parse_result_t result = replay(stream, length);
+        double ns_per_byte = measure(replay, stream, length);
+        double frames_per_s = result.frames / (ns_per_byte * length / 1e9);
+        printf("%-16s %-10s %8.2f %10.0f %8u %8u %8u %10.2f", entry->stream, entry->parser, ns_per_byte,
+               frames_per_s, result.frames, result.bad_checksums, result.resyncs, entry->ns_per_byte);
+        if (update) {
+            entry->ns_per_byte = ns_per_byte;
+            entry->frames = result.frames;
+        } else if (result.frames != entry->frames) {
+            printf("  FAIL: %u frames expected", entry->frames);
+            failures++;
+        } else if (ns_per_byte > entry->ns_per_byte * tolerance) {
+            printf("  FAIL: slower than %.2f ns/byte", entry->ns_per_byte * tolerance);
+            failures++;
+        }
+        printf("\n");
+        free(stream);
+    }
+    if (update) write_baseline(baseline_path, entries, count);
+    return failures != 0;
+}
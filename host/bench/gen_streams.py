@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+#
+#   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+#
+#   Copyright 2019 Wolfgang Christl
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+"""
+Generates the synthetic serial streams replayed by bench_parsers. Deterministic for a given seed so the committed
+streams in streams/ can be regenerated:
+
+    ./gen_streams.py streams
+
+--noise is the probability of a run of random bytes in front of a frame, --corrupt the probability of one flipped
+byte within a frame. The committed *_noisy streams use --noise 0.05 --corrupt 0.02.
+"""
+import argparse
+import os
+import random
+
+LTM_PAYLOAD_SIZES = {b'G': 14, b'A': 6, b'S': 7, b'O': 14, b'N': 6, b'X': 6}
+# msg_id: (payload length, CRC_EXTRA) - all listed in mavlink_serial.c
+MAVLINK_MESSAGES = {0: (9, 50), 1: (31, 124), 24: (30, 24), 30: (28, 39), 33: (28, 104), 74: (20, 20), 253: (51, 83)}
+MSP_MAX_PAYLOAD = 192   # keeps the committed streams. The parser takes up to MSP_MAX_PAYLOAD_SIZE (512)
+
+
+def crc8_dvb_s2(crc, data):
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0xD5) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def crc_x25(data):
+    crc = 0xFFFF
+    for byte in data:
+        tmp = byte ^ (crc & 0xFF)
+        tmp = (tmp ^ (tmp << 4)) & 0xFF
+        crc = ((crc >> 8) ^ (tmp << 8) ^ (tmp << 3) ^ (tmp >> 4)) & 0xFFFF
+    return crc
+
+
+def xor(data):
+    checksum = 0
+    for byte in data:
+        checksum ^= byte
+    return checksum
+
+
+def msp_payload(rng, max_size):
+    # mostly small telemetry responses, some large ones (e.g. MSP_BOXNAMES)
+    size = rng.randint(0, 32) if rng.random() < 0.8 else rng.randint(33, max_size)
+    return bytes(rng.getrandbits(8) for _ in range(size))
+
+
+def msp_v1(rng):
+    payload = msp_payload(rng, MSP_MAX_PAYLOAD)
+    body = bytes([len(payload), rng.randint(1, 254)]) + payload
+    return b'$M' + rng.choice([b'>', b'<']) + body + bytes([xor(body)])
+
+
+def msp_v2_native(rng):
+    payload = msp_payload(rng, MSP_MAX_PAYLOAD)
+    cmd = rng.randint(0x1000, 0x2100)
+    body = bytes([0, cmd & 0xFF, cmd >> 8, len(payload) & 0xFF, len(payload) >> 8]) + payload
+    return b'$X' + rng.choice([b'>', b'<']) + body + bytes([crc8_dvb_s2(0, body)])
+
+
+def msp_v2_over_v1(rng):
+    payload = msp_payload(rng, MSP_MAX_PAYLOAD - 6)
+    cmd = rng.randint(0x1000, 0x2100)
+    v2 = bytes([0, cmd & 0xFF, cmd >> 8, len(payload) & 0xFF, len(payload) >> 8]) + payload
+    v2 += bytes([crc8_dvb_s2(0, v2)])
+    body = bytes([len(v2), 255]) + v2
+    return b'$M' + rng.choice([b'>', b'<']) + body + bytes([xor(body)])
+
+
+def ltm(rng):
+    frame_type = rng.choice(list(LTM_PAYLOAD_SIZES))
+    payload = bytes(rng.getrandbits(8) for _ in range(LTM_PAYLOAD_SIZES[frame_type]))
+    return b'$T' + frame_type + payload + bytes([xor(payload)])
+
+
+def mavlink(rng):
+    msg_id = rng.choice(list(MAVLINK_MESSAGES))
+    length, crc_extra = MAVLINK_MESSAGES[msg_id]
+    payload = bytes(rng.getrandbits(8) for _ in range(length))
+    seq, sys_id, comp_id = rng.getrandbits(8), 1, 1
+    if rng.random() < 0.5:
+        header = bytes([0xFE, length, seq, sys_id, comp_id, msg_id])
+    else:
+        header = bytes([0xFD, length, 0, 0, seq, sys_id, comp_id, msg_id, 0, 0])
+    crc = crc_x25(header[1:] + payload + bytes([crc_extra]))
+    return header + payload + bytes([crc & 0xFF, crc >> 8])
+
+
+def msp_ltm_mixed(rng):
+    return rng.choice([msp_v1, msp_v2_native, msp_v2_over_v1, ltm])(rng)
+
+
+STREAMS = {
+    'msp_v1': msp_v1,
+    'msp_v2_native': msp_v2_native,
+    'msp_v2_over_v1': msp_v2_over_v1,
+    'ltm': ltm,
+    'mavlink': mavlink,
+}
+
+
+def generate(frame_gen, size, noise, corrupt, seed):
+    rng = random.Random(seed)
+    stream = bytearray()
+    while len(stream) < size:
+        if rng.random() < noise:
+            stream += bytes(rng.getrandbits(8) for _ in range(rng.randint(1, 32)))
+        frame = bytearray(frame_gen(rng))
+        if rng.random() < corrupt:
+            frame[rng.randrange(len(frame))] ^= 1 << rng.randrange(8)
+        stream += frame
+    return bytes(stream)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('out_dir')
+    parser.add_argument('--size', type=int, default=32768, help='minimum size of each stream in bytes')
+    parser.add_argument('--noise', type=float, default=None, help='only generate noisy streams with this noise ratio')
+    parser.add_argument('--corrupt', type=float, default=0.02, help='corruption ratio of the noisy streams')
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+    streams = {}
+    if args.noise is None:
+        for name, frame_gen in STREAMS.items():
+            streams[name] = (frame_gen, 0, 0)
+        noise = 0.05
+    else:
+        noise = args.noise
+    streams['msp_ltm_noisy'] = (msp_ltm_mixed, noise, args.corrupt)
+    streams['mavlink_noisy'] = (mavlink, noise, args.corrupt)
+    os.makedirs(args.out_dir, exist_ok=True)
+    for name, (frame_gen, stream_noise, stream_corrupt) in streams.items():
+        with open(os.path.join(args.out_dir, name + '.bin'), 'wb') as f:
+            f.write(generate(frame_gen, args.size, stream_noise, stream_corrupt, args.seed))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+#   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+#
+#   Copyright 2019 Wolfgang Christl
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# Runs bench_bridge for every serial protocol, packet size & baud rate of the settings page, both client types and 1, 4
+# & 8 connected clients. One result line per run. Usage: sweep.sh [path to bench_bridge] (default ./build/bench_bridge)
+# Override the lists with BAUD_RATES, MSP_LTM_SIZES, TRANSPARENT_SIZES, CLIENTS, CLIENT_COUNTS & DURATION (seconds per
+# run).
+
+BENCH=${1:-./build/bench_bridge}
+BAUD_RATES=${BAUD_RATES:-"115200 230400 460800 921600"}
+MSP_LTM_SIZES=${MSP_LTM_SIZES:-"0 64 128 256"}
+TRANSPARENT_SIZES=${TRANSPARENT_SIZES:-"32 64 128 256 512"}
+CLIENTS=${CLIENTS:-"tcp udp"}
+CLIENT_COUNTS=${CLIENT_COUNTS:-"1 4 8"}
+DURATION=${DURATION:-5}
+
+for baud in $BAUD_RATES; do
+    for client in $CLIENTS; do
+        for count in $CLIENT_COUNTS; do
+            for size in $MSP_LTM_SIZES; do
+                "$BENCH" -p 1 -b "$baud" -m "$size" -c "$client" -n "$count" -d "$DURATION"
+            done
+            for protocol in 3 4; do
+                for size in $TRANSPARENT_SIZES; do
+                    "$BENCH" -p "$protocol" -b "$baud" -t "$size" -c "$client" -n "$count" -d "$DURATION"
+                done
+            done
+        done
+    done
+done
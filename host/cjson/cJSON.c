@@ -0,0 +1,376 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include "cJSON.h"
+
+typedef struct {
+    char *buffer;
+    size_t length;
+    size_t size;
+    bool failed;
+} print_buffer_t;
+
+static cJSON *new_item(int type) {
+    cJSON *item = calloc(1, sizeof(cJSON));
+    if (item != NULL) item->type = type;
+    return item;
+}
+
+void cJSON_Delete(cJSON *item) {
+    while (item != NULL) {
+        cJSON *next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
+
+cJSON *cJSON_CreateNumber(double num) {
+    cJSON *item = new_item(cJSON_Number);
+    if (item == NULL) return NULL;
+    item->valuedouble = num;
+    item->valueint = num >= 2147483647.0 ? 2147483647 : num <= -2147483648.0 ? -2147483647 - 1 : (int) num;
+    return item;
+}
+
+cJSON *cJSON_CreateString(const char *string) {
+    cJSON *item = new_item(cJSON_String);
+    if (item == NULL) return NULL;
+    if ((item->valuestring = strdup(string)) == NULL) {
+        free(item);
+        return NULL;
+    }
+    return item;
+}
+
+cJSON *cJSON_CreateArray() {
+    return new_item(cJSON_Array);
+}
+
+cJSON *cJSON_CreateObject() {
+    return new_item(cJSON_Object);
+}
+
+void cJSON_AddItemToArray(cJSON *array, cJSON *item) {
+    if (array == NULL || item == NULL) return;
+    if (array->child == NULL) {
+        array->child = item;
+        item->prev = item;  // first element keeps a link to the last one
+        return;
+    }
+    cJSON *last = array->child->prev;
+    last->next = item;
+    item->prev = last;
+    array->child->prev = item;
+}
+
+void cJSON_AddItemToObject(cJSON *object, const char *string, cJSON *item) {
+    if (object == NULL || item == NULL) return;
+    free(item->string);
+    item->string = strdup(string);
+    cJSON_AddItemToArray(object, item);
+}
+
+static cJSON *add_to_object(cJSON *object, const char *name, cJSON *item) {
+    if (item == NULL) return NULL;
+    cJSON_AddItemToObject(object, name, item);
+    return item;
+}
+
+cJSON *cJSON_AddNumberToObject(cJSON *object, const char *name, double number) {
+    return add_to_object(object, name, cJSON_CreateNumber(number));
+}
+
+cJSON *cJSON_AddStringToObject(cJSON *object, const char *name, const char *string) {
+    return add_to_object(object, name, cJSON_CreateString(string));
+}
+
+cJSON *cJSON_AddObjectToObject(cJSON *object, const char *name) {
+    return add_to_object(object, name, cJSON_CreateObject());
+}
+
+cJSON *cJSON_AddArrayToObject(cJSON *object, const char *name) {
+    return add_to_object(object, name, cJSON_CreateArray());
+}
+
+/**
+ * Case insensitive like the original
+ */
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string) {
+    if (object == NULL || string == NULL) return NULL;
+    for (cJSON *item = object->child; item != NULL; item = item->next) {
+        if (item->string != NULL && strcasecmp(item->string, string) == 0) return item;
+    }
+    return NULL;
+}
+
+bool cJSON_IsNumber(const cJSON *item) {
+    return item != NULL && (item->type & 0xff) == cJSON_Number;
+}
+
+bool cJSON_IsString(const cJSON *item) {
+    return item != NULL && (item->type & 0xff) == cJSON_String;
+}
+
+bool cJSON_IsBool(const cJSON *item) {
+    return item != NULL && (item->type & (cJSON_True | cJSON_False)) != 0;
+}
+
+bool cJSON_IsTrue(const cJSON *item) {
+    return item != NULL && (item->type & 0xff) == cJSON_True;
+}
+
+/* Parser */
+
+static const char *skip_whitespace(const char *in) {
+    while (in != NULL && *in != '\0' && (unsigned char) *in <= 32) in++;
+    return in;
+}
+
+static const char *parse_value(cJSON *item, const char *in);
+
+static const char *parse_string_raw(char **out, const char *in) {
+    if (*in != '\"') return NULL;
+    const char *end = in + 1;
+    size_t length = 0;
+    while (*end != '\"') {
+        if (*end == '\0') return NULL;
+        if (*end == '\\') {
+            if (end[1] == '\0') return NULL;
+            end++;
+        }
+        end++;
+        length++;
+    }
+    char *string = malloc(length + 1);
+    if (string == NULL) return NULL;
+    char *dst = string;
+    for (const char *src = in + 1; src < end; src++) {
+        if (*src != '\\') {
+            *dst++ = *src;
+            continue;
+        }
+        switch (*++src) {
+            case 'b': *dst++ = '\b'; break;
+            case 'f': *dst++ = '\f'; break;
+            case 'n': *dst++ = '\n'; break;
+            case 'r': *dst++ = '\r'; break;
+            case 't': *dst++ = '\t'; break;
+            case 'u': {  // only code points below 0x80 are needed by the bridge. Others become '?'
+                unsigned int code = 0;
+                if (sscanf(src + 1, "%4x", &code) != 1) {
+                    free(string);
+                    return NULL;
+                }
+                *dst++ = code < 0x80 ? (char) code : '?';
+                src += 4;
+                break;
+            }
+            default: *dst++ = *src; break;
+        }
+    }
+    *dst = '\0';
+    *out = string;
+    return end + 1;
+}
+
+static const char *parse_container(cJSON *item, const char *in, char close, bool named) {
+    item->type = named ? cJSON_Object : cJSON_Array;
+    in = skip_whitespace(in + 1);
+    if (*in == close) return in + 1;
+    while (1) {
+        cJSON *child = new_item(cJSON_Invalid);
+        if (child == NULL) return NULL;
+        cJSON_AddItemToArray(item, child);
+        if (named) {
+            if ((in = parse_string_raw(&child->string, skip_whitespace(in))) == NULL) return NULL;
+            in = skip_whitespace(in);
+            if (*in != ':') return NULL;
+            in++;
+        }
+        if ((in = skip_whitespace(parse_value(child, skip_whitespace(in)))) == NULL) return NULL;
+        if (*in == close) return in + 1;
+        if (*in != ',') return NULL;
+        in++;
+    }
+}
+
+static const char *parse_value(cJSON *item, const char *in) {
+    if (in == NULL) return NULL;
+    if (strncmp(in, "null", 4) == 0) {
+        item->type = cJSON_NULL;
+        return in + 4;
+    }
+    if (strncmp(in, "false", 5) == 0) {
+        item->type = cJSON_False;
+        return in + 5;
+    }
+    if (strncmp(in, "true", 4) == 0) {
+        item->type = cJSON_True;
+        item->valueint = 1;
+        return in + 4;
+    }
+    if (*in == '\"') {
+        item->type = cJSON_String;
+        return parse_string_raw(&item->valuestring, in);
+    }
+    if (*in == '-' || (*in >= '0' && *in <= '9')) {
+        char *end;
+        double number = strtod(in, &end);
+        if (end == in) return NULL;
+        cJSON *parsed = cJSON_CreateNumber(number);
+        if (parsed == NULL) return NULL;
+        item->type = cJSON_Number;
+        item->valuedouble = parsed->valuedouble;
+        item->valueint = parsed->valueint;
+        free(parsed);
+        return end;
+    }
+    if (*in == '[') return parse_container(item, in, ']', false);
+    if (*in == '{') return parse_container(item, in, '}', true);
+    return NULL;
+}
+
+cJSON *cJSON_Parse(const char *value) {
+    if (value == NULL) return NULL;
+    cJSON *item = new_item(cJSON_Invalid);
+    if (item == NULL) return NULL;
+    if (parse_value(item, skip_whitespace(value)) == NULL) {
+        cJSON_Delete(item);
+        return NULL;
+    }
+    return item;
+}
+
+/* Printer */
+
+static void append(print_buffer_t *out, const char *text, size_t length) {
+    if (out->failed) return;
+    if (out->length + length + 1 > out->size) {
+        size_t size = (out->size + length + 1) * 2;
+        char *buffer = realloc(out->buffer, size);
+        if (buffer == NULL) {
+            out->failed = true;
+            return;
+        }
+        out->buffer = buffer;
+        out->size = size;
+    }
+    memcpy(&out->buffer[out->length], text, length);
+    out->length += length;
+    out->buffer[out->length] = '\0';
+}
+
+static void append_string(print_buffer_t *out, const char *string) {
+    append(out, "\"", 1);
+    for (const char *c = string; *c != '\0'; c++) {
+        char escaped[7];
+        switch (*c) {
+            case '\"': append(out, "\\\"", 2); break;
+            case '\\': append(out, "\\\\", 2); break;
+            case '\n': append(out, "\\n", 2); break;
+            case '\r': append(out, "\\r", 2); break;
+            case '\t': append(out, "\\t", 2); break;
+            default:
+                if ((unsigned char) *c < 32) {
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char) *c);
+                    append(out, escaped, 6);
+                } else {
+                    append(out, c, 1);
+                }
+        }
+    }
+    append(out, "\"", 1);
+}
+
+static void append_indent(print_buffer_t *out, int depth) {
+    for (int i = 0; i < depth; i++) append(out, "\t", 1);
+}
+
+static void print_value(print_buffer_t *out, const cJSON *item, int depth, bool formatted) {
+    char number[32];
+    switch (item->type & 0xff) {
+        case cJSON_NULL: append(out, "null", 4); break;
+        case cJSON_False: append(out, "false", 5); break;
+        case cJSON_True: append(out, "true", 4); break;
+        case cJSON_String: append_string(out, item->valuestring); break;
+        case cJSON_Number:
+            if (isfinite(item->valuedouble) && item->valuedouble == (double) item->valueint) {
+                snprintf(number, sizeof(number), "%d", item->valueint);
+            } else if (isfinite(item->valuedouble)) {
+                snprintf(number, sizeof(number), "%.17g", item->valuedouble);
+                double check;
+                char shorter[32];
+                snprintf(shorter, sizeof(shorter), "%.15g", item->valuedouble);
+                if (sscanf(shorter, "%lg", &check) == 1 && check == item->valuedouble) strcpy(number, shorter);
+            } else {
+                strcpy(number, "null");
+            }
+            append(out, number, strlen(number));
+            break;
+        case cJSON_Array:
+        case cJSON_Object: {
+            bool named = (item->type & 0xff) == cJSON_Object;
+            append(out, named ? "{" : "[", 1);
+            if (formatted && named) append(out, "\n", 1);
+            for (const cJSON *child = item->child; child != NULL; child = child->next) {
+                if (formatted && named) append_indent(out, depth + 1);
+                if (named) {
+                    append_string(out, child->string != NULL ? child->string : "");
+                    append(out, formatted ? ":\t" : ":", formatted ? 2 : 1);
+                }
+                print_value(out, child, depth + 1, formatted);
+                if (child->next != NULL) append(out, formatted && !named ? ", " : ",", formatted && !named ? 2 : 1);
+                if (formatted && named) append(out, "\n", 1);
+            }
+            if (formatted && named) append_indent(out, depth);
+            append(out, named ? "}" : "]", 1);
+            break;
+        }
+        default:
+            out->failed = true;
+    }
+}
+
+static char *print(const cJSON *item, bool formatted) {
+    if (item == NULL) return NULL;
+    print_buffer_t out = {0};
+    print_value(&out, item, 0, formatted);
+    if (out.failed) {
+        free(out.buffer);
+        return NULL;
+    }
+    return out.buffer;
+}
+
+char *cJSON_Print(const cJSON *item) {
+    return print(item, true);
+}
+
+char *cJSON_PrintUnformatted(const cJSON *item) {
+    return print(item, false);
+}
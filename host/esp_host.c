@@ -0,0 +1,212 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+/**
+ * Host build only. FreeRTOS queues, semaphores, event groups & delays, ESP-IDF logging and error names on top of
+ * pthreads and stdio. Just enough for the bridge core - no scheduler, priorities or core affinity.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+
+struct db_host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+struct db_host_event_group {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    EventBits_t bits;
+};
+
+static esp_log_level_t log_level = ESP_LOG_INFO;
+
+static void init_monotonic_cond(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/**
+ * Absolute CLOCK_MONOTONIC deadline ticks (= ms) from now
+ */
+static struct timespec deadline_after(TickType_t ticks) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += ticks / 1000;
+    deadline.tv_nsec += (long) (ticks % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return deadline;
+}
+
+/**
+ * Waits on cond until woken up or the deadline passed. portMAX_DELAY waits forever
+ *
+ * @return false if the deadline passed
+ */
+static bool wait_until(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, const struct timespec *deadline) {
+    if (ticks == 0) return false;
+    if (ticks == portMAX_DELAY) return pthread_cond_wait(cond, lock) == 0;
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct timespec delay = {.tv_sec = ticks / 1000, .tv_nsec = (long) (ticks % 1000) * 1000000};
+    while (nanosleep(&delay, &delay) == -1 && errno == EINTR);
+}
+
+/**
+ * Only ends the calling thread - tasks are never deleted by others in the bridge
+ */
+void vTaskDelete(TaskHandle_t task) {
+    (void) task;
+    pthread_exit(NULL);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    struct db_host_queue *queue = calloc(1, sizeof(struct db_host_queue));
+    if (queue == NULL) return NULL;
+    if (item_size > 0 && (queue->items = malloc((size_t) length * item_size)) == NULL) {
+        free(queue);
+        return NULL;
+    }
+    queue->length = length;
+    queue->item_size = item_size;
+    pthread_mutex_init(&queue->lock, NULL);
+    init_monotonic_cond(&queue->changed);
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    struct timespec deadline = deadline_after(ticks);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length) {
+        if (!wait_until(&queue->changed, &queue->lock, ticks, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+    }
+    if (queue->item_size > 0) {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(&queue->items[tail * queue->item_size], item, queue->item_size);
+    }
+    queue->count++;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    struct timespec deadline = deadline_after(ticks);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        if (!wait_until(&queue->changed, &queue->lock, ticks, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+    }
+    if (queue->item_size > 0) memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+EventGroupHandle_t xEventGroupCreate() {
+    struct db_host_event_group *group = calloc(1, sizeof(struct db_host_event_group));
+    if (group == NULL) return NULL;
+    pthread_mutex_init(&group->lock, NULL);
+    init_monotonic_cond(&group->changed);
+    return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    EventBits_t current = group->bits;
+    pthread_cond_broadcast(&group->changed);
+    pthread_mutex_unlock(&group->lock);
+    return current;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks) {
+    struct timespec deadline = deadline_after(ticks);
+    pthread_mutex_lock(&group->lock);
+    while (wait_for_all ? (group->bits & bits) != bits : (group->bits & bits) == 0) {
+        if (!wait_until(&group->changed, &group->lock, ticks, &deadline)) break;
+    }
+    EventBits_t current = group->bits;
+    if (clear_on_exit && (wait_for_all ? (current & bits) == bits : (current & bits) != 0)) group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return current;
+}
+
+/**
+ * The tag is ignored - one level for all
+ */
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    (void) tag;
+    log_level = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    static const char level_chars[] = "NEWIDV";
+    if (level > log_level) return;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    char line[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    fprintf(stderr, "%c (%lld) %s: %s\n", level_chars[level], (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000,
+            tag, line);
+}
+
+/**
+ * The bridge also passes errno values. Those are named by strerror()
+ */
+const char *esp_err_to_name(esp_err_t code) {
+    if (code == ESP_OK) return "ESP_OK";
+    if (code == ESP_FAIL) return "ESP_FAIL";
+    return strerror(code);
+}
@@ -0,0 +1,46 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#ifndef DB_HOST_LWIP_SOCKETS_H
+#define DB_HOST_LWIP_SOCKETS_H
+
+/**
+ * Host build only. Maps the lwIP socket API used by the bridge to BSD sockets
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "freertos/task.h"        // lwIP pulls in FreeRTOS on the ESP32 as well
+
+#define lwip_send send
+#define lwip_recv recv
+#define lwip_close close
+
+// lwIP takes any 4 byte IPv4 address (struct in_addr or its s_addr)
+#define inet_ntoa_r(addr, buf, buflen) inet_ntop(AF_INET, &(addr), buf, buflen)
+
+#endif //DB_HOST_LWIP_SOCKETS_H
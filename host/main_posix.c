@@ -0,0 +1,83 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "esp_log.h"
+#include "globals.h"
+#include "db_esp32_control.h"
+#include "db_esp32_comm.h"
+#include "db_esp32_settings.h"
+#include "http_server.h"
+
+EventGroupHandle_t wifi_event_group;
+
+static void print_usage(const char *name) {
+    fprintf(stderr, "Usage: %s [options]\n"
+                    "Runs the bridge on the serial device or pseudo terminal given by DB_UART_DEVICE.\n"
+                    "  -p <1-5>   SERIAL_PROTOCOL: 1,2=MSP/LTM, 3=MAVLink, 4,5=transparent\n"
+                    "  -b <baud>  UART baud rate\n"
+                    "  -t <bytes> TRANSPARENT_BUF_SIZE\n"
+                    "  -m <bytes> MSP_LTM_PACKET_SIZE (0 = one frame per packet)\n"
+                    "  -w <us>    SERIAL_HOLD_TIME_US\n"
+                    "  -P <list>  MSP_POLL_LIST, e.g. \"108:10,109:5\"\n"
+                    "  -u <mode>  UDP_DOWNLINK_MODE: 0=unicast, 1=broadcast, 2=multicast\n"
+                    "  -v         debug log\n", name);
+}
+
+/**
+ * Native Linux build of the bridge. Runs the same control, comm & HTTP modules as the ESP32 - only the platform layer
+ * (db_platform_posix.c) and the FreeRTOS/lwIP shims of host/include differ. Listens on all local interfaces: TCP
+ * APP_PORT_PROXY, UDP APP_PORT_PROXY_UDP, comm protocol on APP_PORT_COMM and the settings page on HTTP_SERVER_PORT.
+ * Settings are not stored - options override the defaults.
+ */
+int main(int argc, char *argv[]) {
+    read_settings_nvs();
+    int option;
+    while ((option = getopt(argc, argv, "p:b:t:m:w:P:u:vh")) != -1) {
+        switch (option) {
+            case 'p': SERIAL_PROTOCOL = (uint8_t) atoi(optarg); break;
+            case 'b': DB_UART_BAUD_RATE = (uint32_t) atoi(optarg); break;
+            case 't': TRANSPARENT_BUF_SIZE = (uint16_t) atoi(optarg); break;
+            case 'm': MSP_LTM_PACKET_SIZE = (uint16_t) atoi(optarg); break;
+            case 'w': SERIAL_HOLD_TIME_US = (uint32_t) atoi(optarg); break;
+            case 'P':
+                strncpy(MSP_POLL_LIST, optarg, sizeof(MSP_POLL_LIST) - 1);
+                MSP_POLL_LIST[sizeof(MSP_POLL_LIST) - 1] = '\0';
+                break;
+            case 'u': UDP_DOWNLINK_MODE = (uint8_t) atoi(optarg); break;
+            case 'v': esp_log_level_set("*", ESP_LOG_DEBUG); break;
+            default:
+                print_usage(argv[0]);
+                return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);  // lwIP reports a closed peer as send() error only. So do we
+    wifi_event_group = xEventGroupCreate();
+    xEventGroupSetBits(wifi_event_group, BIT2);  // the network of the host is always up
+    control_module();
+    start_tcp_server();
+    communication_module();
+    while (1) pause();
+}
@@ -0,0 +1,54 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#ifndef DB_HOST_TEST_H
+#define DB_HOST_TEST_H
+
+#include <stdio.h>
+
+/**
+ * Minimal test helpers of the host tests. A test executable returns db_test_failures != 0 as exit code
+ */
+
+static int db_test_failures = 0;
+
+#define CHECK(condition) do {                                                       \
+        if (!(condition)) {                                                         \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            db_test_failures++;                                                     \
+        }                                                                           \
+    } while (0)
+
+#define CHECK_EQ(expected, actual) do {                                             \
+        long long expected_ = (long long) (expected), actual_ = (long long) (actual); \
+        if (expected_ != actual_) {                                                 \
+            fprintf(stderr, "%s:%d: CHECK_EQ failed: %s = %lld, expected %lld\n",   \
+                    __FILE__, __LINE__, #actual, actual_, expected_);               \
+            db_test_failures++;                                                     \
+        }                                                                           \
+    } while (0)
+
+#define RUN_TEST(test) do {                                                         \
+        int failures_before_ = db_test_failures;                                    \
+        test();                                                                     \
+        printf("%s %s\n", db_test_failures == failures_before_ ? "PASS" : "FAIL", #test); \
+    } while (0)
+
+#endif //DB_HOST_TEST_H
@@ -0,0 +1,112 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "db_comm.h"
+#include "db_test.h"
+
+#define BENCH_BUFFER_SIZE 4096  // TCP_COMM_BUF_SIZE
+#define BENCH_ROUNDS 20000
+
+/**
+ * The bit-wise CRC32 that calc_crc32() replaced. Reference for the known-answer test & the throughput comparison
+ */
+static uint32_t crc32_bitwise(uint32_t crc, const unsigned char *buf, size_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int k = 0; k < 8; k++)
+            crc = crc & 1 ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+    }
+    return ~crc;
+}
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void test_known_answers() {
+    static unsigned char zeros[4096], counting[4096];
+    for (int i = 0; i < 4096; i++) counting[i] = (unsigned char) i;
+    struct {
+        unsigned char *data;
+        size_t length;
+        uint32_t crc;   // zlib crc32()
+    } vectors[] = {
+            {(unsigned char *) "", 0, 0x00000000},
+            {(unsigned char *) "a", 1, 0xe8b7be43},
+            {(unsigned char *) "123456789", 9, 0xcbf43926},
+            {(unsigned char *) "The quick brown fox jumps over the lazy dog", 43, 0x414fa339},
+            {zeros, sizeof(zeros), 0xc71c0011},
+            {counting, sizeof(counting), 0xa2912082},
+    };
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        CHECK_EQ(vectors[i].crc, calc_crc32(0, vectors[i].data, vectors[i].length));
+        CHECK_EQ(vectors[i].crc, crc32_bitwise(0, vectors[i].data, vectors[i].length));
+    }
+}
+
+/**
+ * Every start alignment & every length up to a few words, plus chained calls, against the bit-wise reference
+ */
+static void test_matches_bitwise() {
+    unsigned char buffer[600];
+    srand(1);
+    for (size_t i = 0; i < sizeof(buffer); i++) buffer[i] = (unsigned char) rand();
+    int mismatches = 0;
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t length = 0; length + offset <= sizeof(buffer); length++) {
+            uint32_t expected = crc32_bitwise(0, buffer + offset, length);
+            if (calc_crc32(0, buffer + offset, length) != expected) mismatches++;
+            size_t split = length / 3;
+            if (calc_crc32(calc_crc32(0, buffer + offset, split), buffer + offset + split, length - split) != expected)
+                mismatches++;
+        }
+    }
+    CHECK_EQ(0, mismatches);
+}
+
+static void bench_throughput() {
+    static unsigned char buffer[BENCH_BUFFER_SIZE];
+    for (int i = 0; i < BENCH_BUFFER_SIZE; i++) buffer[i] = (unsigned char) (i * 13);
+    volatile uint32_t sink = 0;
+    double start = now_s();
+    for (int i = 0; i < BENCH_ROUNDS; i++) sink ^= calc_crc32(0, buffer, BENCH_BUFFER_SIZE);
+    double table_s = now_s() - start;
+    start = now_s();
+    for (int i = 0; i < BENCH_ROUNDS / 10; i++) sink ^= crc32_bitwise(0, buffer, BENCH_BUFFER_SIZE);
+    double bitwise_s = (now_s() - start) * 10;
+    double mbytes = (double) BENCH_ROUNDS * BENCH_BUFFER_SIZE / 1e6;
+    printf("CRC32 over %i byte buffers: slicing-by-4 %.0f MB/s, bit-wise %.0f MB/s (x%.1f)\n", BENCH_BUFFER_SIZE,
+           mbytes / table_s, mbytes / bitwise_s, bitwise_s / table_s);
+    CHECK(table_s < bitwise_s);
+}
+
+int main() {
+    RUN_TEST(test_known_answers);
+    RUN_TEST(test_matches_bitwise);
+    RUN_TEST(bench_throughput);
+    return db_test_failures != 0;
+}
@@ -0,0 +1,85 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+#include "db_filter.h"
+#include "db_test.h"
+
+#define CLIENT_IP 0x0104A8C0    // 192.168.4.1
+
+static const uint8_t ltm_frames[] = {
+        '$', 'T', 'S', 0, 0, 0, 0, 0, 0, 0, 0,      // status frame
+        '$', 'T', 'A', 0, 0, 0, 0, 0, 0, 0          // attitude frame
+};
+
+static void set_status_filter(uint32_t max_rate_hz) {
+    db_filter_rule_t rule = {.protocol = DB_FILTER_LTM, .msg_id = 'S', .min_interval_us = 1000000 / max_rate_hz};
+    CHECK(db_filter_set(CLIENT_IP, &rule, 1));
+}
+
+static void test_unfiltered_client() {
+    db_filter_state_t state;
+    memset(&state, 0, sizeof(state));
+    uint8_t out[64];
+    CHECK_EQ(-1, db_filter_apply(0x0204A8C0, &state, ltm_frames, sizeof(ltm_frames), out, sizeof(out), 1000));
+}
+
+/**
+ * Every connection of the same client gets its own rate limit
+ */
+static void test_rate_limit_per_connection() {
+    set_status_filter(10);
+    db_filter_state_t tcp_state, udp_state;
+    memset(&tcp_state, 0, sizeof(tcp_state));
+    memset(&udp_state, 0, sizeof(udp_state));
+    uint8_t out[64];
+    CHECK_EQ(11, db_filter_apply(CLIENT_IP, &tcp_state, ltm_frames, sizeof(ltm_frames), out, sizeof(out), 1000));
+    CHECK_EQ('S', out[2]);
+    CHECK_EQ(11, db_filter_apply(CLIENT_IP, &udp_state, ltm_frames, sizeof(ltm_frames), out, sizeof(out), 2000));
+    CHECK_EQ(0, db_filter_apply(CLIENT_IP, &tcp_state, ltm_frames, sizeof(ltm_frames), out, sizeof(out), 50000));
+    CHECK_EQ(11, db_filter_apply(CLIENT_IP, &tcp_state, ltm_frames, sizeof(ltm_frames), out, sizeof(out), 101000));
+    CHECK_EQ(2, tcp_state.passed_frames);
+    CHECK_EQ(4, tcp_state.filtered_frames);
+    CHECK_EQ(1, udp_state.passed_frames);
+}
+
+/**
+ * A new filter starts with a fresh rate limit
+ */
+static void test_new_filter_resets_rate_limit() {
+    set_status_filter(10);
+    db_filter_state_t state;
+    memset(&state, 0, sizeof(state));
+    uint8_t out[64];
+    CHECK_EQ(11, db_filter_apply(CLIENT_IP, &state, ltm_frames, sizeof(ltm_frames), out, sizeof(out), 1000));
+    set_status_filter(1);
+    CHECK_EQ(11, db_filter_apply(CLIENT_IP, &state, ltm_frames, sizeof(ltm_frames), out, sizeof(out), 2000));
+    CHECK_EQ(0, db_filter_apply(CLIENT_IP, &state, ltm_frames, sizeof(ltm_frames), out, sizeof(out), 500000));
+    CHECK(db_filter_set(CLIENT_IP, NULL, 0));
+    CHECK(!db_filter_active());
+}
+
+int main() {
+    RUN_TEST(test_unfiltered_client);
+    RUN_TEST(test_rate_limit_per_connection);
+    RUN_TEST(test_new_filter_resets_rate_limit);
+    return db_test_failures != 0;
+}
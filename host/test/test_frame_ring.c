@@ -0,0 +1,188 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include "db_frame_ring.h"
+#include "db_test.h"
+
+#define STRESS_FRAMES 1000000
+#define STRESS_RING_SIZE 1024       // small so frames wrap around all the time
+#define STRESS_MAX_LENGTH 300
+#define WAKEUP_TIMEOUT_MS 2000      // consumer sleeping this long with frames in the ring = lost wakeup
+
+typedef struct {
+    db_frame_ring_t ring;
+    uint32_t wakeup_pending;
+    int wakeup_pipe[2];             // stands in for the loopback socket of the network task
+    uint32_t full_retries;
+} stress_context_t;
+
+static uint16_t frame_length(uint32_t seq) {
+    return (uint16_t) ((seq * 7919u) % (STRESS_MAX_LENGTH + 1));
+}
+
+static uint8_t frame_byte(uint32_t seq, uint32_t i) {
+    return (uint8_t) (seq * 31u + i);
+}
+
+static void test_push_peek_pop() {
+    db_frame_ring_t ring;
+    CHECK(!db_frame_ring_init(&ring, 1000));  // not a power of two
+    CHECK(db_frame_ring_init(&ring, 256));
+    uint8_t *data;
+    uint16_t length;
+    uint8_t tag;
+    db_frame_stamp_t stamp = {.first_byte = 11, .queued = 22}, read_stamp;
+    CHECK(!db_frame_ring_peek(&ring, &data, &length, &tag, &read_stamp));
+    uint8_t frame[100];
+    for (int i = 0; i < 100; i++) frame[i] = (uint8_t) i;
+    CHECK(db_frame_ring_push(&ring, frame, 100, 7, &stamp));
+    CHECK(db_frame_ring_push(&ring, frame, 50, 8, &stamp));
+    CHECK(!db_frame_ring_push(&ring, frame, 100, 9, &stamp));  // does not fit
+    CHECK_EQ(1, ring.dropped_frames);
+    CHECK(db_frame_ring_peek(&ring, &data, &length, &tag, &read_stamp));
+    CHECK_EQ(100, length);
+    CHECK_EQ(7, tag);
+    CHECK_EQ(11, read_stamp.first_byte);
+    CHECK_EQ(22, read_stamp.queued);
+    CHECK(memcmp(data, frame, 100) == 0);
+    db_frame_ring_pop(&ring);
+    // next frame does not fit into the rest of the buffer - wraps to the start
+    CHECK(db_frame_ring_push(&ring, frame, 80, 10, &stamp));
+    CHECK(db_frame_ring_peek(&ring, &data, &length, &tag, &read_stamp));
+    CHECK_EQ(50, length);
+    CHECK_EQ(8, tag);
+    db_frame_ring_pop(&ring);
+    CHECK(db_frame_ring_peek(&ring, &data, &length, &tag, &read_stamp));
+    CHECK_EQ(80, length);
+    CHECK_EQ(10, tag);
+    CHECK(data == ring.buffer + 12);
+    CHECK(memcmp(data, frame, 80) == 0);
+    db_frame_ring_pop(&ring);
+    CHECK_EQ(0, db_frame_ring_used(&ring));
+    free(ring.buffer);
+}
+
+/**
+ * db_frame_ring_room() must report exactly the largest frame a push accepts, wherever head and tail are
+ */
+static void test_room() {
+    db_frame_ring_t ring;
+    CHECK(db_frame_ring_init(&ring, 256));
+    uint8_t frame[256] = {0};
+    uint8_t *data;
+    uint16_t length;
+    uint8_t tag;
+    db_frame_stamp_t stamp = {0};
+    CHECK_EQ(256 - 12, db_frame_ring_room(&ring));
+    for (uint32_t seq = 0; seq < 2000; seq++) {
+        uint16_t room = db_frame_ring_room(&ring);
+        if (room < 255) {
+            db_frame_ring_t copy = ring;
+            CHECK(!db_frame_ring_push(&copy, frame, room + 1, 0, &stamp));
+        }
+        if (room > 0) CHECK(db_frame_ring_push(&ring, frame, MIN(room, frame_length(seq) % 120), 0, &stamp));
+        if ((room == 0 || seq % 3 != 0) && db_frame_ring_peek(&ring, &data, &length, &tag, &stamp)) {
+            db_frame_ring_pop(&ring);
+        }
+    }
+    CHECK_EQ(0, ring.dropped_frames);
+    free(ring.buffer);
+}
+
+static void *stress_producer(void *arg) {
+    stress_context_t *context = arg;
+    uint8_t frame[STRESS_MAX_LENGTH];
+    for (uint32_t seq = 0; seq < STRESS_FRAMES; seq++) {
+        uint16_t length = frame_length(seq);
+        for (uint32_t i = 0; i < length; i++) frame[i] = frame_byte(seq, i);
+        db_frame_stamp_t stamp = {.first_byte = seq, .queued = ~seq};
+        while (!db_frame_ring_push(&context->ring, frame, length, (uint8_t) seq, &stamp)) {
+            context->full_retries++;
+            sched_yield();
+        }
+        if (db_wakeup_request(&context->wakeup_pending)) {
+            uint8_t wakeup_byte = 1;
+            if (write(context->wakeup_pipe[1], &wakeup_byte, 1) != 1) abort();
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Producer & consumer thread as UART reader & network task: the consumer sleeps until woken up through a pipe and
+ * drains the ring. Checks that no frame is lost, duplicated, reordered or corrupted and that no wakeup is lost
+ */
+static void test_stress_with_wakeups() {
+    stress_context_t context;
+    memset(&context, 0, sizeof(context));
+    CHECK(db_frame_ring_init(&context.ring, STRESS_RING_SIZE));
+    CHECK(pipe(context.wakeup_pipe) == 0);
+    pthread_t producer;
+    pthread_create(&producer, NULL, stress_producer, &context);
+    uint32_t expected_seq = 0, bad_frames = 0, lost_wakeups = 0, wakeups = 0;
+    while (expected_seq < STRESS_FRAMES && lost_wakeups == 0) {
+        struct pollfd pfd = {.fd = context.wakeup_pipe[0], .events = POLLIN};
+        if (poll(&pfd, 1, WAKEUP_TIMEOUT_MS) == 0) {
+            if (db_frame_ring_used(&context.ring) > 0) lost_wakeups++;
+            continue;
+        }
+        uint8_t wakeup_bytes[16];
+        if (read(context.wakeup_pipe[0], wakeup_bytes, sizeof(wakeup_bytes)) > 0) wakeups++;
+        db_wakeup_rearm(&context.wakeup_pending);
+        uint8_t *data;
+        uint16_t length;
+        uint8_t tag;
+        db_frame_stamp_t stamp;
+        while (db_frame_ring_peek(&context.ring, &data, &length, &tag, &stamp)) {
+            bool ok = stamp.first_byte == expected_seq && stamp.queued == ~expected_seq &&
+                      tag == (uint8_t) expected_seq && length == frame_length(expected_seq);
+            for (uint32_t i = 0; ok && i < length; i++) ok = data[i] == frame_byte(expected_seq, i);
+            if (!ok) bad_frames++;
+            db_frame_ring_pop(&context.ring);
+            expected_seq = stamp.first_byte + 1;
+        }
+    }
+    if (lost_wakeups > 0) {
+        fprintf(stderr, "Consumer slept with %u bytes in the ring\n", db_frame_ring_used(&context.ring));
+        _exit(1);  // producer might be stuck
+    }
+    pthread_join(producer, NULL);
+    CHECK_EQ(STRESS_FRAMES, expected_seq);
+    CHECK_EQ(0, bad_frames);
+    CHECK_EQ(0, context.ring.dropped_frames - context.full_retries);
+    printf("%u frames, %u wakeups, %u pushes retried on full ring, high water mark %u bytes\n", expected_seq, wakeups,
+           context.full_retries, context.ring.high_water_mark);
+    close(context.wakeup_pipe[0]);
+    close(context.wakeup_pipe[1]);
+    free(context.ring.buffer);
+}
+
+int main() {
+    RUN_TEST(test_push_peek_pop);
+    RUN_TEST(test_room);
+    RUN_TEST(test_stress_with_wakeups);
+    return db_test_failures != 0;
+}
@@ -0,0 +1,159 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+#include "db_crc.h"
+#include "mavlink_serial.h"
+#include "db_test.h"
+
+/**
+ * Builds a MAVLink v2 frame. Payload bytes are 0x10, 0x11, ...
+ */
+static uint16_t build_frame(uint8_t frame[], uint32_t msg_id, uint8_t crc_extra, uint8_t payload_length) {
+    uint8_t header[] = {MAVLINK_STX_V2, payload_length, 0, 0, 7, 1, 1, (uint8_t) msg_id, (uint8_t) (msg_id >> 8),
+                        (uint8_t) (msg_id >> 16)};
+    memcpy(frame, header, sizeof(header));
+    for (uint8_t i = 0; i < payload_length; i++) frame[MAVLINK_HEADER_LEN_V2 + i] = (uint8_t) (0x10 + i);
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 1; i < MAVLINK_HEADER_LEN_V2 + payload_length; i++) crc = crc_x25_accumulate(crc, frame[i]);
+    crc = crc_x25_accumulate(crc, crc_extra);
+    frame[MAVLINK_HEADER_LEN_V2 + payload_length] = (uint8_t) crc;
+    frame[MAVLINK_HEADER_LEN_V2 + payload_length + 1] = (uint8_t) (crc >> 8);
+    return MAVLINK_HEADER_LEN_V2 + payload_length + MAVLINK_CHECKSUM_LEN;
+}
+
+static int parse_all(mavlink_port_t *port, const uint8_t *stream, size_t length, uint32_t msg_ids[], bool validated[]) {
+    size_t pos = 0;
+    int frames = 0;
+    while (parse_mavlink_buffer(port, stream, length, &pos)) {
+        msg_ids[frames] = port->msg_id;
+        validated[frames] = port->validated;
+        frames++;
+    }
+    return frames;
+}
+
+static uint8_t skipped[128];
+static uint16_t skipped_length;
+
+static void collect_skipped_byte(uint8_t skipped_byte) {
+    skipped[skipped_length++] = skipped_byte;
+}
+
+static void test_known_message() {
+    mavlink_port_t port;
+    init_mavlink_port(&port);
+    uint8_t stream[64];
+    uint16_t length = build_frame(stream, 30, 39, 28);  // ATTITUDE
+    uint32_t msg_ids[4];
+    bool validated[4];
+    CHECK_EQ(1, parse_all(&port, stream, length, msg_ids, validated));
+    CHECK_EQ(30, msg_ids[0]);
+    CHECK(validated[0]);
+    CHECK_EQ(length, port.frame_length);
+    CHECK_EQ(1, port.frames_received);
+    CHECK_EQ(0, port.unvalidated);
+}
+
+static void test_bad_crc_of_known_message_is_dropped() {
+    mavlink_port_t port;
+    init_mavlink_port(&port);
+    uint8_t stream[128];
+    uint16_t length = build_frame(stream, 30, 39, 28);
+    stream[MAVLINK_HEADER_LEN_V2 + 3] ^= 0x01;
+    length += build_frame(&stream[length], 0, 50, 9);  // HEARTBEAT
+    uint32_t msg_ids[4];
+    bool validated[4];
+    CHECK_EQ(1, parse_all(&port, stream, length, msg_ids, validated));
+    CHECK_EQ(0, msg_ids[0]);
+    CHECK(port.bad_crcs >= 1);  // CRC bytes of the corrupted frame may make another false start
+}
+
+/**
+ * No CRC_EXTRA for msg_id 12345 - passed on as it is, whatever its CRC, and counted separately
+ */
+static void test_unknown_message_is_passed_unvalidated() {
+    mavlink_port_t port;
+    init_mavlink_port(&port);
+    uint8_t stream[128];
+    uint16_t length = build_frame(stream, 12345, 0xAB, 20);
+    length += build_frame(&stream[length], 0, 50, 9);
+    uint32_t msg_ids[4];
+    bool validated[4];
+    CHECK_EQ(2, parse_all(&port, stream, length, msg_ids, validated));
+    CHECK_EQ(12345, msg_ids[0]);
+    CHECK(!validated[0]);
+    CHECK_EQ(0, msg_ids[1]);
+    CHECK(validated[1]);
+    CHECK_EQ(1, port.unvalidated);
+    CHECK_EQ(1, port.frames_received);
+    CHECK_EQ(0, port.bad_crcs);
+}
+
+/**
+ * A frame starting inside a rejected frame is found on the replay
+ */
+static void test_frame_inside_rejected_frame() {
+    mavlink_port_t port;
+    init_mavlink_port(&port);
+    uint8_t stream[128] = {MAVLINK_STX_V1, 30, 0, 1, 1, 30};  // false start: v1 ATTITUDE header, 30 byte payload
+    uint16_t length = 6 + build_frame(&stream[6], 0, 50, 9);
+    memset(&stream[length], 0, 30);
+    length += 30;
+    uint32_t msg_ids[4];
+    bool validated[4];
+    CHECK_EQ(1, parse_all(&port, stream, length, msg_ids, validated));
+    CHECK_EQ(0, msg_ids[0]);
+    CHECK(validated[0]);
+}
+
+/**
+ * Every byte is either part of a returned frame or reported as skipped, in stream order
+ */
+static void test_skipped_bytes_are_reported() {
+    mavlink_port_t port;
+    init_mavlink_port(&port);
+    port.on_skipped_byte = collect_skipped_byte;
+    skipped_length = 0;
+    uint8_t stream[128] = {'a', 'b'};
+    uint16_t length = 2 + build_frame(&stream[2], 30, 39, 28);
+    stream[2 + MAVLINK_HEADER_LEN_V2 + 3] ^= 0x01;  // bad CRC - all bytes of the frame are skipped
+    uint16_t frame_start = length;
+    length += build_frame(&stream[length], 0, 50, 9);
+    size_t pos = 0;
+    CHECK(parse_mavlink_buffer(&port, stream, length, &pos));
+    CHECK_EQ(frame_start, skipped_length);
+    CHECK(memcmp(skipped, stream, frame_start) == 0);
+    CHECK_EQ(length - frame_start, port.frame_length);
+    stream[length] = 'c';
+    CHECK(!parse_mavlink_buffer(&port, stream, length + 1, &pos));
+    CHECK_EQ(frame_start + 1, skipped_length);
+    CHECK_EQ('c', skipped[frame_start]);
+}
+
+int main() {
+    RUN_TEST(test_known_message);
+    RUN_TEST(test_bad_crc_of_known_message_is_dropped);
+    RUN_TEST(test_unknown_message_is_passed_unvalidated);
+    RUN_TEST(test_frame_inside_rejected_frame);
+    RUN_TEST(test_skipped_bytes_are_reported);
+    return db_test_failures != 0;
+}
@@ -0,0 +1,172 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+#include "db_crc.h"
+#include "msp_cache.h"
+#include "db_test.h"
+
+#define PERIOD_US 100000    // "108:10"
+
+/**
+ * Builds a MSP v1 frame. Payload bytes are 0x10, 0x11, ...
+ */
+static uint16_t build_v1_frame(uint8_t frame[], uint8_t direction, uint8_t cmd, uint8_t payload_size) {
+    frame[0] = '$';
+    frame[1] = 'M';
+    frame[2] = direction;
+    frame[3] = payload_size;
+    frame[4] = cmd;
+    for (uint8_t i = 0; i < payload_size; i++) frame[5 + i] = (uint8_t) (0x10 + i);
+    frame[5 + payload_size] = 0;
+    for (uint16_t i = 3; i < 5 + payload_size; i++) frame[5 + payload_size] ^= frame[i];
+    return 6 + payload_size;
+}
+
+/**
+ * Builds a native MSP v2 frame. Payload bytes are 0x10, 0x11, ...
+ */
+static uint16_t build_v2_frame(uint8_t frame[], uint8_t direction, uint16_t cmd, uint8_t payload_size) {
+    uint8_t header[] = {'$', 'X', direction, 0, (uint8_t) cmd, (uint8_t) (cmd >> 8), payload_size, 0};
+    memcpy(frame, header, sizeof(header));
+    for (uint8_t i = 0; i < payload_size; i++) frame[8 + i] = (uint8_t) (0x10 + i);
+    frame[8 + payload_size] = crc8_dvb_s2_buffer(0, &frame[3], 5 + payload_size);
+    return 9 + payload_size;
+}
+
+/**
+ * Builds a MSP v2 frame tunneled in a v1 frame with command 255
+ */
+static uint16_t build_v2_over_v1_frame(uint8_t frame[], uint8_t direction, uint16_t cmd, uint8_t payload_size) {
+    build_v2_frame(&frame[2], direction, cmd, payload_size);
+    frame[0] = '$';
+    frame[1] = 'M';
+    frame[2] = direction;
+    frame[3] = (uint8_t) (payload_size + 6);
+    frame[4] = MSP_V2_FRAME_ID;
+    frame[11 + payload_size] = 0;
+    for (uint16_t i = 3; i < 11 + payload_size; i++) frame[11 + payload_size] ^= frame[i];
+    return 12 + payload_size;
+}
+
+static bool parse_frame(msp_ltm_port_t *port, const uint8_t *frame, uint16_t length) {
+    memset(port, 0, sizeof(*port));
+    bool complete = false;
+    for (uint16_t i = 0; i < length; i++) complete = parse_msp_ltm_byte(port, frame[i]);
+    return complete;
+}
+
+/**
+ * Passes the frame through the parser & the cache
+ */
+static bool update(const uint8_t *frame, uint16_t length, int64_t now) {
+    msp_ltm_port_t port;
+    CHECK(parse_frame(&port, frame, length));
+    return msp_cache_update(&port, now);
+}
+
+static uint16_t lookup(const uint8_t *request, uint16_t length, int64_t now, uint8_t response[]) {
+    msp_ltm_port_t port;
+    CHECK(parse_frame(&port, request, length));
+    return msp_cache_lookup(&port, now, response, MSP_MAX_FRAME_SIZE);
+}
+
+/**
+ * The cached response must be a valid frame of the expected version that carries the payload of the FC response
+ */
+static void check_response(const uint8_t *response, uint16_t length, mspVersion_e version, uint16_t cmd,
+                           uint8_t payload_size) {
+    msp_ltm_port_t port;
+    CHECK(parse_frame(&port, response, length));
+    CHECK_EQ(version, port.mspVersion);
+    CHECK_EQ('>', port.msp_direction);
+    CHECK_EQ(cmd, port.cmdMSP);
+    CHECK_EQ(payload_size, port.dataSize);
+    for (uint8_t i = 0; i < payload_size; i++) CHECK_EQ(0x10 + i, port.inBuf[i]);
+}
+
+static void test_v1_response_answers_all_versions() {
+    CHECK_EQ(1, msp_cache_init("108:10"));
+    uint8_t frame[MSP_MAX_FRAME_SIZE], response[MSP_MAX_FRAME_SIZE];
+    uint16_t length = build_v1_frame(frame, '>', 108, 6);  // MSP_ATTITUDE
+    CHECK(!update(frame, length, 1000));
+
+    length = build_v1_frame(frame, '<', 108, 0);
+    uint16_t response_length = lookup(frame, length, 2000, response);
+    CHECK_EQ(12, response_length);
+    check_response(response, response_length, MSP_V1, 108, 6);
+
+    length = build_v2_frame(frame, '<', 108, 0);
+    response_length = lookup(frame, length, 2000, response);
+    CHECK_EQ(15, response_length);
+    check_response(response, response_length, MSP_V2_NATIVE, 108, 6);
+
+    length = build_v2_over_v1_frame(frame, '<', 108, 0);
+    response_length = lookup(frame, length, 2000, response);
+    CHECK_EQ(18, response_length);
+    check_response(response, response_length, MSP_V2_OVER_V1, 108, 6);
+
+    msp_cache_stats_t stats;
+    msp_cache_get_stats(&stats);
+    CHECK_EQ(3, stats.hits);
+    CHECK_EQ(0, stats.misses);
+}
+
+static void test_v2_response_answers_v2_over_v1() {
+    CHECK_EQ(1, msp_cache_init("8194:10"));
+    uint8_t frame[MSP_MAX_FRAME_SIZE], response[MSP_MAX_FRAME_SIZE];
+    uint16_t length = build_v2_frame(frame, '>', 0x2002, 40);
+    CHECK(!update(frame, length, 1000));
+
+    length = build_v2_over_v1_frame(frame, '<', 0x2002, 0);
+    uint16_t response_length = lookup(frame, length, 2000, response);
+    CHECK_EQ(52, response_length);
+    check_response(response, response_length, MSP_V2_OVER_V1, 0x2002, 40);
+}
+
+/**
+ * A miss passes the request on to the FC. The next response is forwarded to the clients and updates the cache.
+ */
+static void test_stale_entry_forwards_next_response() {
+    CHECK_EQ(1, msp_cache_init("108:10"));
+    uint8_t frame[MSP_MAX_FRAME_SIZE], response[MSP_MAX_FRAME_SIZE];
+    uint16_t length = build_v1_frame(frame, '>', 108, 6);
+    CHECK(!update(frame, length, 1000));
+
+    length = build_v2_frame(frame, '<', 108, 0);
+    CHECK_EQ(0, lookup(frame, length, 1000 + 2 * PERIOD_US, response));
+    length = build_v2_frame(frame, '>', 108, 6);
+    CHECK(update(frame, length, 1000 + 2 * PERIOD_US));
+    CHECK(!update(frame, length, 1000 + 3 * PERIOD_US));
+
+    msp_cache_stats_t stats;
+    msp_cache_get_stats(&stats);
+    CHECK_EQ(0, stats.hits);
+    CHECK_EQ(1, stats.misses);
+    CHECK_EQ(3, stats.updates);
+}
+
+int main() {
+    RUN_TEST(test_v1_response_answers_all_versions);
+    RUN_TEST(test_v2_response_answers_v2_over_v1);
+    RUN_TEST(test_stale_entry_forwards_next_response);
+    return db_test_failures != 0;
+}
@@ -0,0 +1,68 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+#include "msp_router.h"
+#include "db_test.h"
+
+static void parse_request(msp_ltm_port_t *port, uint8_t cmd) {
+    uint8_t frame[] = {'$', 'M', '<', 0, cmd, cmd};
+    memset(port, 0, sizeof(*port));
+    for (uint16_t i = 0; i < sizeof(frame); i++) parse_msp_ltm_byte(port, frame[i]);
+    CHECK_EQ(MSP_PACKET_RECEIVED, port->parse_state);
+}
+
+/**
+ * A TCP slot reused by a new client while the request was pending is a different requester
+ */
+static void test_tcp_requesters_keep_their_socket() {
+    msp_router_init();
+    msp_ltm_port_t port;
+    parse_request(&port, 108);
+    CHECK(msp_router_request(&port, 1000, 0, 7, NULL));
+    CHECK(!msp_router_request(&port, 2000, 0, 7, NULL));
+    CHECK(!msp_router_request(&port, 3000, 0, 9, NULL));
+
+    uint8_t response[] = {'$', 'M', '>', 0, 108, 108};
+    msp_pending_request_t requesters;
+    CHECK(msp_router_response(response, sizeof(response), &requesters));
+    CHECK_EQ(2, requesters.tcp_count);
+    CHECK_EQ(0, requesters.tcp_requesters[0].tcp_index);
+    CHECK_EQ(7, requesters.tcp_requesters[0].tcp_socket);
+    CHECK_EQ(9, requesters.tcp_requesters[1].tcp_socket);
+    CHECK_EQ(0, requesters.udp_count);
+}
+
+static void test_too_many_requesters_are_sent_to_all() {
+    msp_router_init();
+    msp_ltm_port_t port;
+    parse_request(&port, 109);
+    for (int i = 0; i <= MSP_ROUTER_MAX_TCP_REQUESTERS; i++) msp_router_request(&port, 1000, i, 10 + i, NULL);
+    uint8_t response[] = {'$', 'M', '>', 0, 109, 109};
+    msp_pending_request_t requesters;
+    CHECK(!msp_router_response(response, sizeof(response), &requesters));
+}
+
+int main() {
+    RUN_TEST(test_tcp_requesters_keep_their_socket);
+    RUN_TEST(test_too_many_requesters_are_sent_to_all);
+    return db_test_failures != 0;
+}
@@ -0,0 +1,183 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "lwip/sockets.h"
+#include "tcp_server.h"
+#include "db_platform.h"
+#include "db_latency.h"
+#include "db_test.h"
+
+#define SOCKET_BUFFER 4096
+
+/**
+ * Client slot connected over TCP loopback with small socket buffers, so sends are partial
+ *
+ * @return Socket of the receiving peer
+ */
+static int connect_client(db_tcp_client_t *client) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0), peer = socket(AF_INET, SOCK_STREAM, 0);
+    int size = SOCKET_BUFFER;
+    setsockopt(peer, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addr_length = sizeof(addr);
+    bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr));
+    listen(listen_fd, 1);
+    getsockname(listen_fd, (struct sockaddr *) &addr, &addr_length);
+    connect(peer, (struct sockaddr *) &addr, sizeof(addr));
+    int fd = accept(listen_fd, NULL, NULL);
+    close(listen_fd);
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    memset(client, 0, sizeof(*client));
+    client->socket = -1;
+    add_tcp_client(client, fd, addr.sin_addr.s_addr);
+    return peer;
+}
+
+static size_t receive_all(int fd, uint8_t *buffer, size_t size) {
+    size_t received = 0;
+    ssize_t n;
+    while (received < size && (n = recv(fd, &buffer[received], size - received, MSG_DONTWAIT)) > 0) received += n;
+    return received;
+}
+
+static void fill(uint8_t *data, size_t length, uint8_t seed) {
+    for (size_t i = 0; i < length; i++) data[i] = (uint8_t) (seed + i * 7);
+}
+
+/**
+ * Packets the socket only takes partially are completed from the send queue. The receiver gets every byte in order
+ */
+static void test_partial_send_is_completed() {
+    db_tcp_client_t client;
+    int peer = connect_client(&client);
+    static uint8_t sent[64 * 1024], received[64 * 1024];
+    size_t total = 0, got = 0;
+    int partially_sent = 0;
+    for (int i = 0; i < 40; i++) {
+        uint16_t length = (uint16_t) (200 + i * 37);
+        fill(&sent[total], length, (uint8_t) i);
+        send_to_tcp_client(&client, &sent[total], length);
+        if (client.first_packet_sent > 0) partially_sent++;
+        total += length;
+        if (i % 10 == 9) {  // slow reader
+            got += receive_all(peer, &received[got], sizeof(received) - got);
+            flush_tcp_client(&client);
+        }
+    }
+    CHECK(client.socket >= 0);
+    CHECK(partially_sent > 0);
+    while (tcp_client_has_pending(&client)) {
+        got += receive_all(peer, &received[got], sizeof(received) - got);
+        flush_tcp_client(&client);
+    }
+    got += receive_all(peer, &received[got], sizeof(received) - got);
+    CHECK_EQ(total - client.dropped_bytes, got);
+    // whole packets only: what arrived is the sent stream with complete packets left out
+    size_t pos_sent = 0, pos_received = 0;
+    for (int i = 0; i < 40 && pos_received < got; i++) {
+        uint16_t length = (uint16_t) (200 + i * 37);
+        if (memcmp(&sent[pos_sent], &received[pos_received], length) == 0) pos_received += length;
+        pos_sent += length;
+    }
+    CHECK_EQ(got, pos_received);
+    close_tcp_client(&client);
+    close(peer);
+}
+
+/**
+ * The start of a packet went out but its rest does not fit into the send queue. Dropping it would corrupt the stream
+ */
+static void test_partial_send_without_queue_space_disconnects() {
+    db_tcp_client_t client;
+    int peer = connect_client(&client);
+    static uint8_t data[3 * TCP_CLIENT_QUEUE_SIZE];
+    fill(data, sizeof(data), 1);
+    send_to_tcp_client(&client, data, sizeof(data));
+    CHECK_EQ(-1, client.socket);
+    CHECK_EQ(1, client.evictions);
+    close(peer);
+}
+
+/**
+ * A packet that had to wait in the send queue records its send latency once the socket took it - not when it was queued
+ */
+static void test_send_latency_recorded_when_sent() {
+    db_tcp_client_t client;
+    int peer = connect_client(&client);
+    static uint8_t data[2048], received[64 * 1024];
+    fill(data, sizeof(data), 3);
+    db_latency_reset();
+    while (client.packet_count == 0) send_to_tcp_client(&client, data, sizeof(data));  // not telemetry - no stamp
+    uint32_t now = (uint32_t) db_time_us();
+    db_tcp_stamp_t stamp = {.first_byte = now - 1000, .dequeued = now - 500};
+    set_tcp_send_stamp(&stamp);
+    send_to_tcp_client(&client, data, 100);
+    set_tcp_send_stamp(NULL);
+    db_latency_summary_t summary;
+    db_latency_get_summary(DB_LATENCY_SEND, &summary);
+    CHECK_EQ(0, summary.count);
+    while (tcp_client_has_pending(&client)) {
+        receive_all(peer, received, sizeof(received));
+        flush_tcp_client(&client);
+    }
+    db_latency_get_summary(DB_LATENCY_SEND, &summary);
+    CHECK_EQ(1, summary.count);
+    CHECK(summary.max_us >= 500);
+    db_latency_get_summary(DB_LATENCY_TOTAL, &summary);
+    CHECK_EQ(1, summary.count);
+    CHECK(summary.max_us >= 1000);
+    close_tcp_client(&client);
+    close(peer);
+}
+
+/**
+ * A profile set at runtime applies to the connected clients of that address, here the disconnect policy
+ */
+static void test_profile_applies_to_connected_client() {
+    static db_tcp_client_t clients[CONFIG_LWIP_MAX_ACTIVE_TCP];
+    init_tcp_clients(clients);
+    int peer = connect_client(&clients[0]);
+    CHECK(clients[0].low_latency);
+    CHECK_EQ(TCP_OVERFLOW_DROP_OLDEST, clients[0].overflow_policy);
+    CHECK(db_tcp_profile_set(htonl(INADDR_LOOPBACK), false, TCP_OVERFLOW_DISCONNECT));
+    update_tcp_profiles(clients);
+    CHECK(!clients[0].low_latency);
+    CHECK_EQ(TCP_OVERFLOW_DISCONNECT, clients[0].overflow_policy);
+    static uint8_t data[1024];
+    fill(data, sizeof(data), 5);
+    for (int i = 0; i < 64 && clients[0].socket >= 0; i++) send_to_tcp_client(&clients[0], data, sizeof(data));
+    CHECK_EQ(-1, clients[0].socket);
+    CHECK_EQ(0, clients[0].dropped_packets);
+    CHECK_EQ(1, clients[0].evictions);
+    CHECK(db_tcp_profile_set(htonl(INADDR_LOOPBACK), DB_TCP_LOW_LATENCY, DB_TCP_OVERFLOW_POLICY));  // back to default
+    close(peer);
+}
+
+int main() {
+    RUN_TEST(test_partial_send_is_completed);
+    RUN_TEST(test_partial_send_without_queue_space_disconnects);
+    RUN_TEST(test_send_latency_recorded_when_sent);
+    RUN_TEST(test_profile_applies_to_connected_client);
+    return db_test_failures != 0;
+}
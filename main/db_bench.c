@@ -0,0 +1,276 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#include <string.h>
+#include "db_crc.h"
+#include "mavlink_serial.h"
+#include "db_bench.h"
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <driver/uart.h>
+#include <soc/uart_struct.h>
+#include "globals.h"
+#include "db_metrics.h"
+#include "db_latency.h"
+
+#define TAG "DB_BENCH"
+#define DB_BENCH_TASK_PRIO 4    // below the UART reader & network task - the generator must not starve the bridge
+#endif
+
+typedef enum {
+    BENCH_LTM_G,
+    BENCH_LTM_A,
+    BENCH_LTM_S,
+    BENCH_MSP_V1,
+    BENCH_MSP_V2,
+    BENCH_MAVLINK_V2_HEARTBEAT,
+    BENCH_MAVLINK_V2_ATTITUDE,
+    BENCH_MAVLINK_V1_GLOBAL_POSITION
+} db_bench_frame_e;
+
+// Traffic mix of a typical flight controller. LTM at its usual rates with some MSP responses in between
+static const db_bench_frame_e msp_ltm_mix[] = {BENCH_LTM_A, BENCH_LTM_G, BENCH_LTM_A, BENCH_MSP_V1, BENCH_LTM_A,
+                                               BENCH_LTM_S, BENCH_LTM_A, BENCH_MSP_V2};
+// Mostly MAVLink v2 attitude & position with heartbeats. Also used for transparent mode
+static const db_bench_frame_e mavlink_mix[] = {BENCH_MAVLINK_V2_ATTITUDE, BENCH_MAVLINK_V1_GLOBAL_POSITION,
+                                               BENCH_MAVLINK_V2_ATTITUDE, BENCH_MAVLINK_V2_HEARTBEAT};
+
+/**
+ * Payload of every generated frame: the sequence number (little endian) followed by pseudo random bytes. Receivers
+ * find lost & duplicated frames with db_bench_frame_sequence()
+ */
+static void fill_payload(uint8_t *payload, uint8_t length, uint32_t sequence) {
+    for (uint8_t i = 0; i < length; i++) {
+        payload[i] = i < DB_BENCH_SEQUENCE_SIZE ? (uint8_t) (sequence >> (8 * i)) : (uint8_t) (sequence * 31 + i * 7);
+    }
+}
+
+static uint16_t build_ltm(uint8_t frame[], char type, uint8_t payload_length, uint32_t sequence) {
+    frame[0] = '$';
+    frame[1] = 'T';
+    frame[2] = (uint8_t) type;
+    fill_payload(&frame[3], payload_length, sequence);
+    uint8_t checksum = 0;
+    for (uint8_t i = 0; i < payload_length; i++) checksum ^= frame[3 + i];
+    frame[3 + payload_length] = checksum;
+    return 4 + payload_length;
+}
+
+static uint16_t build_msp_v1(uint8_t frame[], uint8_t cmd, uint8_t payload_length, uint32_t sequence) {
+    frame[0] = '$';
+    frame[1] = 'M';
+    frame[2] = '>';
+    frame[3] = payload_length;
+    frame[4] = cmd;
+    fill_payload(&frame[5], payload_length, sequence);
+    uint8_t checksum = 0;
+    for (uint8_t i = 3; i < 5 + payload_length; i++) checksum ^= frame[i];
+    frame[5 + payload_length] = checksum;
+    return 6 + payload_length;
+}
+
+static uint16_t build_msp_v2(uint8_t frame[], uint16_t cmd, uint8_t payload_length, uint32_t sequence) {
+    frame[0] = '$';
+    frame[1] = 'X';
+    frame[2] = '>';
+    frame[3] = 0;  // flags
+    frame[4] = (uint8_t) cmd;
+    frame[5] = (uint8_t) (cmd >> 8);
+    frame[6] = payload_length;
+    frame[7] = 0;
+    fill_payload(&frame[8], payload_length, sequence);
+    frame[8 + payload_length] = crc8_dvb_s2_buffer(0, &frame[3], 5 + payload_length);
+    return 9 + payload_length;
+}
+
+static uint16_t build_mavlink(uint8_t frame[], bool v2, uint32_t msg_id, uint8_t crc_extra, uint8_t payload_length,
+                              uint32_t sequence) {
+    uint16_t header_length = v2 ? MAVLINK_HEADER_LEN_V2 : MAVLINK_HEADER_LEN_V1;
+    frame[0] = v2 ? MAVLINK_STX_V2 : MAVLINK_STX_V1;
+    frame[1] = payload_length;
+    uint8_t *header = &frame[2];
+    if (v2) {
+        *header++ = 0;  // incompat flags
+        *header++ = 0;  // compat flags
+    }
+    *header++ = (uint8_t) sequence;
+    *header++ = 1;      // system ID of the flight controller
+    *header++ = 1;      // component ID: autopilot
+    *header++ = (uint8_t) msg_id;
+    if (v2) {
+        *header++ = (uint8_t) (msg_id >> 8);
+        *header++ = (uint8_t) (msg_id >> 16);
+    }
+    fill_payload(&frame[header_length], payload_length, sequence);
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 1; i < header_length + payload_length; i++) crc = crc_x25_accumulate(crc, frame[i]);
+    crc = crc_x25_accumulate(crc, crc_extra);
+    frame[header_length + payload_length] = (uint8_t) crc;
+    frame[header_length + payload_length + 1] = (uint8_t) (crc >> 8);
+    return header_length + payload_length + MAVLINK_CHECKSUM_LEN;
+}
+
+/**
+ * Generates the next frame a flight controller would send in the given serial protocol mode. MSP/LTM mode gets a mix
+ * of LTM & MSP v1/v2 responses, MAVLink & transparent mode a mix of MAVLink v1/v2 messages. All frames have valid
+ * checksums. Does not depend on the ESP-IDF
+ *
+ * @param generator Generator state
+ * @param serial_protocol SERIAL_PROTOCOL setting
+ * @param frame Buffer for the frame
+ * @return Length of the frame
+ */
+uint16_t db_bench_next_frame(db_bench_generator_t *generator, uint8_t serial_protocol,
+                             uint8_t frame[DB_BENCH_MAX_FRAME_SIZE]) {
+    db_bench_frame_e type;
+    if (serial_protocol == 1 || serial_protocol == 2) {
+        type = msp_ltm_mix[generator->sequence % (sizeof(msp_ltm_mix) / sizeof(msp_ltm_mix[0]))];
+    } else {
+        type = mavlink_mix[generator->sequence % (sizeof(mavlink_mix) / sizeof(mavlink_mix[0]))];
+    }
+    uint32_t sequence = generator->sequence++;
+    uint16_t length;
+    switch (type) {
+        case BENCH_LTM_G:
+            length = build_ltm(frame, 'G', 14, sequence);
+            break;
+        case BENCH_LTM_A:
+            length = build_ltm(frame, 'A', 6, sequence);
+            break;
+        case BENCH_LTM_S:
+            length = build_ltm(frame, 'S', 7, sequence);
+            break;
+        case BENCH_MSP_V1:
+            length = build_msp_v1(frame, 108, 6, sequence);      // MSP_ATTITUDE
+            break;
+        case BENCH_MSP_V2:
+            length = build_msp_v2(frame, 0x2002, 9, sequence);   // MSP2_INAV_ANALOG
+            break;
+        case BENCH_MAVLINK_V2_HEARTBEAT:
+            length = build_mavlink(frame, true, 0, 50, 9, sequence);
+            break;
+        case BENCH_MAVLINK_V1_GLOBAL_POSITION:
+            length = build_mavlink(frame, false, 33, 104, 28, sequence);
+            break;
+        default:
+        case BENCH_MAVLINK_V2_ATTITUDE:
+            length = build_mavlink(frame, true, 30, 39, 28, sequence);
+            break;
+    }
+    generator->frames++;
+    generator->bytes += length;
+    return length;
+}
+
+/**
+ * Reads the sequence number of a frame made by db_bench_next_frame()
+ *
+ * @param frame Complete & valid LTM, MSP or MAVLink frame
+ * @param frame_length Length of the frame
+ * @param sequence Set to the sequence number of the frame
+ * @return false if the frame is of an unknown type or too short to be a generated one
+ */
+bool db_bench_frame_sequence(const uint8_t *frame, uint16_t frame_length, uint32_t *sequence) {
+    uint16_t payload_offset;
+    if (frame_length >= 2 && frame[0] == '$') {
+        switch (frame[1]) {
+            case 'T': payload_offset = 3; break;
+            case 'M': payload_offset = 5; break;
+            case 'X': payload_offset = 8; break;
+            default: return false;
+        }
+    } else if (frame_length >= 1 && frame[0] == MAVLINK_STX_V1) {
+        payload_offset = MAVLINK_HEADER_LEN_V1;
+    } else if (frame_length >= 1 && frame[0] == MAVLINK_STX_V2) {
+        payload_offset = MAVLINK_HEADER_LEN_V2;
+    } else {
+        return false;
+    }
+    if (frame_length < payload_offset + DB_BENCH_SEQUENCE_SIZE + 1) return false;
+    *sequence = 0;
+    for (int i = 0; i < DB_BENCH_SEQUENCE_SIZE; i++) *sequence |= (uint32_t) frame[payload_offset + i] << (8 * i);
+    return true;
+}
+
+#ifdef ESP_PLATFORM
+/**
+ * Logs throughput & drop counters since the last report and the latency percentiles since boot. Frames lost on the way
+ * to a client are only visible to the client: host/bench/bench_bridge -R <ip> checks the sequence numbers
+ */
+static void report(const db_bench_generator_t *generator, int64_t interval_us) {
+    static uint32_t last_generated = 0, last_rx = 0, last_downlink = 0;
+    uint32_t generated = generator->bytes - last_generated;
+    uint32_t rx = db_metrics.uart_rx_bytes - last_rx;
+    uint32_t downlink = db_metrics.downlink_bytes - last_downlink;
+    last_generated = generator->bytes;
+    last_rx = db_metrics.uart_rx_bytes;
+    last_downlink = db_metrics.downlink_bytes;
+    db_latency_summary_t total;
+    db_latency_get_summary(DB_LATENCY_TOTAL, &total);
+    ESP_LOGI(TAG, "proto %i baud %u pkt %i/%i hold %uus: gen %lld B/s uart %lld B/s downlink %lld B/s | "
+                  "fifo_ovf %u buf_full %u bad_crc %u ring_drop %u rx_buf_hwm %u/%u | "
+                  "latency p50 %u p99 %u max %u us",
+             SERIAL_PROTOCOL, DB_UART_BAUD_RATE, TRANSPARENT_BUF_SIZE, MSP_LTM_PACKET_SIZE, SERIAL_HOLD_TIME_US,
+             generated * 1000000LL / interval_us, rx * 1000000LL / interval_us, downlink * 1000000LL / interval_us,
+             db_metrics.uart_fifo_overflows, db_metrics.uart_buffer_full, db_metrics.parser_bad_checksums,
+             db_metrics.downlink_dropped, db_metrics.uart_rx_buffered_max, DB_UART_RX_BUF_SIZE, total.p50_us, total.p99_us, total.max_us);
+}
+
+/**
+ * Writes generated frames to UART2 which is looped back internally. Paced to DB_BENCH_RATE_BPS if set, else limited by
+ * the UART - uart_write_bytes() blocks until the frame is in the TX FIFO
+ */
+static void bench_task(void *parameters) {
+    db_bench_generator_t generator;
+    memset(&generator, 0, sizeof(generator));
+    uint8_t frame[DB_BENCH_MAX_FRAME_SIZE];
+    int64_t start = esp_timer_get_time();
+    int64_t last_report = start;
+    ESP_LOGW(TAG, "Benchmark mode: UART2 is looped back. Generating %s traffic at %i B/s (0 = max)",
+             (SERIAL_PROTOCOL == 1 || SERIAL_PROTOCOL == 2) ? "MSP/LTM" : "MAVLink", DB_BENCH_RATE_BPS);
+    while (1) {
+        int64_t now = esp_timer_get_time();
+        if (DB_BENCH_RATE_BPS > 0 && (int64_t) generator.bytes * 1000000 > (now - start) * DB_BENCH_RATE_BPS) {
+            vTaskDelay(1);  // ahead of schedule
+        } else {
+            uint16_t length = db_bench_next_frame(&generator, SERIAL_PROTOCOL, frame);
+            uart_write_bytes(UART_NUM_2, (const char *) frame, length);
+            db_metrics.bench_bytes = generator.bytes;
+            db_metrics.bench_frames = generator.frames;
+        }
+        if (now - last_report >= DB_BENCH_REPORT_INTERVAL_US) {
+            report(&generator, now - last_report);
+            last_report = now;
+        }
+    }
+}
+
+/**
+ * Puts UART2 into loopback and starts the traffic generator. UART driver must be installed. Client data written to the
+ * UART and MSP polls are looped back as well and count as received
+ */
+void db_bench_start() {
+    UART2.conf0.loopback = 1;
+    xTaskCreate(&bench_task, "db_bench", 4096, NULL, DB_BENCH_TASK_PRIO, NULL);
+}
+#endif
@@ -0,0 +1,50 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#ifndef DB_ESP32_DB_BENCH_H
+#define DB_ESP32_DB_BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Define DB_BENCHMARK to replace the flight controller with a traffic generator. UART2 is put into internal loopback:
+// everything written to TX is received on RX at the configured baud rate and goes through the normal data path.
+//#define DB_BENCHMARK
+#ifndef DB_BENCH_RATE_BPS
+#define DB_BENCH_RATE_BPS 0                 // generated bytes per second. 0 = as fast as the baud rate allows
+#endif
+#ifndef DB_BENCH_REPORT_INTERVAL_US
+#define DB_BENCH_REPORT_INTERVAL_US 5000000
+#endif
+#define DB_BENCH_MAX_FRAME_SIZE 64
+#define DB_BENCH_SEQUENCE_SIZE 4             // bytes of the sequence number at the start of every payload
+
+typedef struct {
+    uint32_t sequence;          // frame counter. Selects the next frame of the mix & changes the payload
+    uint32_t frames;            // statistics: generated frames
+    uint32_t bytes;
+} db_bench_generator_t;
+
+uint16_t db_bench_next_frame(db_bench_generator_t *generator, uint8_t serial_protocol,
+                             uint8_t frame[DB_BENCH_MAX_FRAME_SIZE]);
+bool db_bench_frame_sequence(const uint8_t *frame, uint16_t frame_length, uint32_t *sequence);
+void db_bench_start();
+
+#endif //DB_ESP32_DB_BENCH_H
@@ -22,12 +22,18 @@
 
 #define MAX_ERR_MSG_LENGTH 2048
 
+uint32_t calc_crc32(uint32_t crc, unsigned char *buf, size_t len);
+
 int crc_ok(uint8_t *buf, int msg_length);
 
 int gen_db_comm_sys_ident_json(uint8_t *message_buffer, int new_id, int new_fw_id);
 
-int gen_db_comm_err_resp(uint8_t *message_buffer, int id, char error_message[MAX_ERR_MSG_LENGTH]);
+int gen_db_comm_err_resp(uint8_t *message_buffer, int id, const char *error_message);
 
 int gen_db_comm_ping_resp(uint8_t *message_buffer, int id);
 
+int gen_db_comm_ack_resp(uint8_t *message_buffer, int id);
+
+int gen_db_comm_metrics_resp(uint8_t *message_buffer, int buffer_size, int id);
+
 #endif //DB_ESP32_DB_COMM_H
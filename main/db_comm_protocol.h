@@ -36,6 +36,10 @@
 #define DB_COMM_TYPE_ACK "ack"
 #define DB_COMM_TYPE_SETTINGS_REQUEST "settingsrequest"
 #define DB_COMM_TYPE_SETTINGS_RESPONSE "settingsresponse"
+#define DB_COMM_TYPE_TELEMETRY_FILTER "telemetryfilter"
+#define DB_COMM_TYPE_TCP_PROFILE "tcpprofile"
+#define DB_COMM_TYPE_METRICS_REQUEST "metricsrequest"
+#define DB_COMM_TYPE_METRICS_RESPONSE "metricsresponse"
 #define DB_COMM_REQUEST_TYPE_WBC "wbc"
 #define DB_COMM_REQUEST_TYPE_DB "db"
 
@@ -53,6 +57,20 @@
 #define DB_COMM_KEY_HARDWID "HID"   // Hardware ID
 #define DB_COMM_KEY_FIRMWID "FID"   // Firmware version
 #define DB_COMM_KEY_MSG "message"
+#define DB_COMM_KEY_FILTERS "filters"       // array of {"protocol": "msp"|"ltm"|"mavlink", "msgid": .., "maxrate": Hz}
+#define DB_COMM_KEY_PROTOCOL "protocol"
+#define DB_COMM_KEY_MSG_ID "msgid"          // MSP command, LTM frame type ("G", "A", ...) or MAVLink message ID
+#define DB_COMM_KEY_MAX_RATE "maxrate"      // optional. Max. messages per second of that type
+#define DB_COMM_KEY_LOW_LATENCY "lowlatency" // optional. true: TCP_NODELAY, false: small packets are coalesced
+#define DB_COMM_KEY_OVERFLOW "overflow"     // optional. "dropoldest" or "disconnect" once the send queue is full
+#define DB_COMM_KEY_METRICS "metrics"       // data path counters. Same object as served on http://<esp>/metrics
+
+#define DB_COMM_PROTOCOL_MSP "msp"
+#define DB_COMM_PROTOCOL_LTM "ltm"
+#define DB_COMM_PROTOCOL_MAVLINK "mavlink"
+
+#define DB_COMM_OVERFLOW_DROP_OLDEST "dropoldest"
+#define DB_COMM_OVERFLOW_DISCONNECT "disconnect"
 
 #define DB_COMM_CHANGE_DB "db"
 #define DB_COMM_CHANGE_DBESP32 "dbesp32"
@@ -57,4 +57,30 @@ uint8_t crc8_dvb_s2(uint8_t crc, unsigned char a)
 uint8_t crc8_dvb_s2_table(uint8_t crc, unsigned char a)
 {
     return (uint8_t) (crc_dvb_s2_table[(crc ^ a)] & 0xff);
+}
+
+/**
+ * crc8_dvb_s2_table over a buffer
+ * @param crc The current crc value
+ * @param data Bytes to add
+ * @param data_len Number of bytes
+ * @return The new crc value
+ */
+uint8_t crc8_dvb_s2_buffer(uint8_t crc, const uint8_t *data, size_t data_len)
+{
+    while (data_len--) crc = (uint8_t) crc_dvb_s2_table[crc ^ *data++];
+    return crc;
+}
+
+/**
+ * CRC-16/MCRF4XX (X.25 polynomial) as used by MAVLink. Start with crc = 0xFFFF
+ * @param crc The current crc value
+ * @param a The next byte
+ * @return The new crc value
+ */
+uint16_t crc_x25_accumulate(uint16_t crc, uint8_t a)
+{
+    uint8_t tmp = a ^ (uint8_t) (crc & 0xff);
+    tmp ^= (tmp << 4);
+    return (crc >> 8) ^ ((uint16_t) tmp << 8) ^ ((uint16_t) tmp << 3) ^ (tmp >> 4);
 }
\ No newline at end of file
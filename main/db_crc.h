@@ -145,6 +145,8 @@ static inline crc_t crc_finalize(crc_t crc)
 
 uint8_t crc8_dvb_s2(uint8_t crc, unsigned char a);
 uint8_t crc8_dvb_s2_table(uint8_t crc, unsigned char a);
+uint8_t crc8_dvb_s2_buffer(uint8_t crc, const uint8_t *data, size_t data_len);
+uint16_t crc_x25_accumulate(uint16_t crc, uint8_t a);
 
 #ifdef __cplusplus
 }           /* closing brace for extern "C" */
@@ -19,6 +19,7 @@
 
 #include <esp_log.h>
 #include <string.h>
+#include <sys/param.h>
 #include <cJSON.h>
 #include "lwip/sockets.h"
 #include "globals.h"
@@ -26,6 +27,8 @@
 #include "db_comm_protocol.h"
 #include "db_comm.h"
 #include "tcp_server.h"
+#include "db_filter.h"
+#include "db_platform.h"
 
 
 #define TCP_COMM_BUF_SIZE 4096
@@ -34,7 +37,73 @@
 uint8_t tcp_comm_buffer[TCP_COMM_BUF_SIZE];
 uint8_t comm_resp_buf[TCP_COMM_BUF_SIZE];
 
-void parse_comm_protocol(int client_socket, char *new_json_bytes) {
+/**
+ * Registers the telemetry filter of a client. Applies to all telemetry connections from the same IP address
+ *
+ * @param json_pointer Message containing the filter list. Empty or missing list removes the filter
+ * @param client_ip IPv4 address of the client in network byte order
+ * @param id Communication message ID to respond to
+ * @return Length of response
+ */
+int set_telemetry_filter(cJSON *json_pointer, uint32_t client_ip, int id) {
+    db_filter_rule_t rules[DB_FILTER_MAX_RULES];
+    memset(rules, 0, sizeof(rules));
+    uint8_t rule_count = 0;
+    cJSON *j_filters = cJSON_GetObjectItem(json_pointer, DB_COMM_KEY_FILTERS);
+    cJSON *j_filter;
+    cJSON_ArrayForEach(j_filter, j_filters) {
+        if (rule_count == DB_FILTER_MAX_RULES)
+            return gen_db_comm_err_resp(comm_resp_buf, id, "Too many telemetry filters");
+        cJSON *j_protocol = cJSON_GetObjectItem(j_filter, DB_COMM_KEY_PROTOCOL);
+        cJSON *j_msg_id = cJSON_GetObjectItem(j_filter, DB_COMM_KEY_MSG_ID);
+        cJSON *j_max_rate = cJSON_GetObjectItem(j_filter, DB_COMM_KEY_MAX_RATE);
+        if (!cJSON_IsString(j_protocol) || j_msg_id == NULL)
+            return gen_db_comm_err_resp(comm_resp_buf, id, "Invalid telemetry filter");
+        db_filter_rule_t *rule = &rules[rule_count++];
+        if (strcmp(j_protocol->valuestring, DB_COMM_PROTOCOL_MSP) == 0) rule->protocol = DB_FILTER_MSP;
+        else if (strcmp(j_protocol->valuestring, DB_COMM_PROTOCOL_LTM) == 0) rule->protocol = DB_FILTER_LTM;
+        else if (strcmp(j_protocol->valuestring, DB_COMM_PROTOCOL_MAVLINK) == 0) rule->protocol = DB_FILTER_MAVLINK;
+        else return gen_db_comm_err_resp(comm_resp_buf, id, "Unknown telemetry filter protocol");
+        if (cJSON_IsString(j_msg_id)) rule->msg_id = (uint8_t) j_msg_id->valuestring[0];  // LTM frame type
+        else rule->msg_id = (uint32_t) j_msg_id->valueint;
+        if (cJSON_IsNumber(j_max_rate) && j_max_rate->valueint > 0)
+            rule->min_interval_us = 1000000 / MIN(j_max_rate->valueint, DB_FILTER_MAX_RATE_HZ);
+    }
+    if (!db_filter_set(client_ip, rules, rule_count))
+        return gen_db_comm_err_resp(comm_resp_buf, id, "Too many clients with telemetry filters");
+    ESP_LOGI(TAG, "Client set %i telemetry filter(s)", rule_count);
+    return gen_db_comm_ack_resp(comm_resp_buf, id);
+}
+
+/**
+ * Sets the latency profile & overflow policy of the TCP telemetry connections of a client. Missing keys are set to
+ * their defaults
+ *
+ * @param json_pointer Message containing the profile
+ * @param client_ip IPv4 address of the client in network byte order
+ * @param id Communication message ID to respond to
+ * @return Length of response
+ */
+int set_tcp_profile(cJSON *json_pointer, uint32_t client_ip, int id) {
+    bool low_latency = DB_TCP_LOW_LATENCY;
+    uint8_t overflow_policy = DB_TCP_OVERFLOW_POLICY;
+    cJSON *j_low_latency = cJSON_GetObjectItem(json_pointer, DB_COMM_KEY_LOW_LATENCY);
+    cJSON *j_overflow = cJSON_GetObjectItem(json_pointer, DB_COMM_KEY_OVERFLOW);
+    if (cJSON_IsBool(j_low_latency)) low_latency = cJSON_IsTrue(j_low_latency);
+    if (cJSON_IsString(j_overflow)) {
+        if (strcmp(j_overflow->valuestring, DB_COMM_OVERFLOW_DROP_OLDEST) == 0)
+            overflow_policy = TCP_OVERFLOW_DROP_OLDEST;
+        else if (strcmp(j_overflow->valuestring, DB_COMM_OVERFLOW_DISCONNECT) == 0)
+            overflow_policy = TCP_OVERFLOW_DISCONNECT;
+        else return gen_db_comm_err_resp(comm_resp_buf, id, "Unknown TCP overflow policy");
+    }
+    if (!db_tcp_profile_set(client_ip, low_latency, overflow_policy))
+        return gen_db_comm_err_resp(comm_resp_buf, id, "Too many clients with TCP profiles");
+    ESP_LOGI(TAG, "Client set TCP profile: low latency %i, overflow policy %i", low_latency, overflow_policy);
+    return gen_db_comm_ack_resp(comm_resp_buf, id);
+}
+
+void parse_comm_protocol(int client_socket, uint32_t client_ip, char *new_json_bytes) {
     cJSON *json_pointer = cJSON_Parse(new_json_bytes);
     int dest = cJSON_GetObjectItem(json_pointer, DB_COMM_KEY_DEST)->valueint;
     if (dest == DB_COMM_DST_GND) {
@@ -50,6 +119,12 @@ void parse_comm_protocol(int client_socket, char *new_json_bytes) {
             resp_length = gen_db_comm_sys_ident_json(comm_resp_buf, id, DB_ESP32_FID);
         } else if (strcmp(type, DB_COMM_TYPE_PING_REQUEST) == 0) {
             resp_length = gen_db_comm_ping_resp(comm_resp_buf, id);
+        } else if (strcmp(type, DB_COMM_TYPE_TELEMETRY_FILTER) == 0) {
+            resp_length = set_telemetry_filter(json_pointer, client_ip, id);
+        } else if (strcmp(type, DB_COMM_TYPE_TCP_PROFILE) == 0) {
+            resp_length = set_tcp_profile(json_pointer, client_ip, id);
+        } else if (strcmp(type, DB_COMM_TYPE_METRICS_REQUEST) == 0) {
+            resp_length = gen_db_comm_metrics_resp(comm_resp_buf, TCP_COMM_BUF_SIZE, id);
         } else {
             resp_length = gen_db_comm_err_resp(comm_resp_buf, id, "Command not supported by DB for ESP32");
         }
@@ -84,7 +159,8 @@ void communication_module_server(void *parameters) {
                 if (crc_ok(tcp_comm_buffer, received_from_client)) {
                     uint8_t json_byte_buf[(received_from_client - 4)];
                     memcpy(json_byte_buf, tcp_comm_buffer, (size_t) (received_from_client - 4));
-                    parse_comm_protocol(new_tcp_client, (char *) tcp_comm_buffer);
+                    parse_comm_protocol(new_tcp_client, ((struct sockaddr_in *) &source_addr)->sin_addr.s_addr,
+                                        (char *) tcp_comm_buffer);
                 } else {
                     ESP_LOGE(TAG, "Bad CRC!");
                     uint8_t rsp_buffer[4096];
@@ -100,5 +176,5 @@ void communication_module_server(void *parameters) {
 
 
 void communication_module() {
-    xTaskCreate(&communication_module_server, "comm_server", 8192, NULL, 5, NULL);
+    db_task_create(&communication_module_server, "comm_server", 8192, 5, DB_TASK_NO_AFFINITY);
 }
\ No newline at end of file
@@ -20,55 +20,135 @@
 #include <sys/fcntl.h>
 #include <sys/param.h>
 #include <string.h>
-#include <esp_task_wdt.h>
-#include <esp_vfs_dev.h>
-#include <esp_wifi.h>
 #include <lwip/inet.h>
+#include <freertos/semphr.h>
 #include "esp_log.h"
 #include "lwip/sockets.h"
-#include "driver/uart.h"
 #include "globals.h"
 #include "msp_ltm_serial.h"
+#include "mavlink_serial.h"
 #include "db_protocol.h"
 #include "tcp_server.h"
+#include "db_frame_ring.h"
+#include "db_packer.h"
+#include "msp_cache.h"
+#include "msp_router.h"
+#include "db_filter.h"
+#include "mavlink_router.h"
+#include "db_udp_clients.h"
+#include "db_metrics.h"
+#include "db_latency.h"
+#include "db_bench.h"
+#include "db_platform.h"
+#include "db_uplink.h"
 
 #define TAG "DB_CONTROL"
-#define TRANS_RD_BYTES_NUM  8   // amount of bytes read form serial port at once when transparent is selected
 #define UDP_BUF_SIZE    2048
 #define UART_BUF_SIZE   (1024)
-#define MAX_UDP_CLIENTS 8
+#define MAVLINK_DATAGRAM_BUDGET 1024  // max. payload of a UDP/TCP packet containing MAVLink frames
+#define UDP_BRDC_UPDATE_INTERVAL_US 1000000  // check for idle UDP clients every second
+#define DOWNLINK_RING_SIZE 16384  // bytes. Buffers packets between UART reader and network task. Power of two
+#define MSP_REPLY_BUF_SIZE 1024   // responses from the MSP cache to one client read
+#define DOWNLINK_BROADCAST 0      // downlink ring tag: packet for all clients
+#define DOWNLINK_MSP_RESPONSE 1   // downlink ring tag: single MSP response for the clients that requested it
+#define DOWNLINK_MAVLINK_TARGETED 2  // downlink ring tag: single MAVLink frame addressed to a specific system
+#define MAVLINK_MAX_ROUTES_PER_SYSTEM 4
+#define MAX_AP_STATIONS 10        // max_connection of the AP
+#define STATION_EVENT_QUEUE_SIZE 10
+#define UDP_GROUP_ERROR_LOG_INTERVAL 100  // log every n-th failed broadcast/multicast send
+#define UPLINK_MIN_FRAME_SIZE 6   // "$M<" + size + cmd + checksum. No MAVLink or LTM frame is shorter
+#define UPLINK_RAW_BUF_SIZE 256   // client bytes outside of frames are queued in chunks of up to this size
+
+// Reader/parser task gets its own core so a slow Wi-Fi send can not cause UART RX overruns
+#ifndef DB_UART_TASK_CORE
+#ifdef CONFIG_FREERTOS_UNICORE
+#define DB_UART_TASK_CORE 0
+#else
+#define DB_UART_TASK_CORE 1
+#endif
+#endif
+#ifndef DB_UART_TASK_PRIO
+#define DB_UART_TASK_PRIO 10
+#endif
+#ifndef DB_NET_TASK_CORE
+#define DB_NET_TASK_CORE 0  // same core as the Wi-Fi task
+#endif
+#ifndef DB_NET_TASK_PRIO
+#define DB_NET_TASK_PRIO 5
+#endif
+// Uplink writer mostly waits for the UART. Shares the core of the reader so Wi-Fi can not delay control frames
+#ifndef DB_UPLINK_TASK_CORE
+#define DB_UPLINK_TASK_CORE DB_UART_TASK_CORE
+#endif
+#ifndef DB_UPLINK_TASK_PRIO
+#define DB_UPLINK_TASK_PRIO 9
+#endif
 
 struct db_udp_connection_t {
     int udp_socket;
-    struct sockaddr_in udp_clients[MAX_UDP_CLIENTS];
-    bool is_broadcast[MAX_UDP_CLIENTS];  // sockaddr_in at index is added because of station that connected
+    db_udp_client_table_t clients;
+    struct sockaddr_in group_addr;  // broadcast/multicast destination. sin_family = 0 if not (yet) known
 };
 
 uint16_t app_port_proxy = APP_PORT_PROXY;
-uint8_t ltm_frame_buffer[MAX_LTM_FRAMES_IN_BUFFER * LTM_MAX_FRAME_SIZE];
-uint ltm_frames_in_buffer = 0;
-uint ltm_frames_in_buffer_pnt = 0;
+db_packer_t msp_ltm_packer;             // packs MSP & LTM frames into one packet
+int64_t serial_buffer_start_time = 0;   // time the first byte of the transparent/MAVLink packet buffer was read
+int64_t uart_read_time = 0;             // time the last chunk was read from the UART
+int64_t frame_start_time = 0;           // time the first byte of the MSP/LTM/MAVLink frame in progress was read
+db_frame_ring_t downlink_ring;          // UART reader task -> network task
+int wakeup_rx_socket = -1;              // loopback socket. Wakes up the network task waiting in select()
+int wakeup_tx_socket = -1;
+struct sockaddr_in wakeup_addr;
+uint32_t wakeup_pending = 0;            // a wakeup datagram is on its way. Limits wakeups to one per drain
+QueueHandle_t station_event_queue;      // Wi-Fi event task -> network task
+SemaphoreHandle_t uplink_semaphore;     // network task -> uplink writer task. Given when frames were queued
+uint32_t uplink_stalled = 0;            // network task waits for room in the uplink queues. See uplink_read_budget()
+
+/**
+ * Frame parser of an uplink stream. Frames of a TCP client may be split across reads
+ */
+typedef union {
+    msp_ltm_port_t msp_ltm;
+    mavlink_port_t mavlink;
+} db_uplink_parser_t;
+
+static db_uplink_parser_t tcp_uplink_parsers[CONFIG_LWIP_MAX_ACTIVE_TCP];  // only used by the network task
+static uint8_t uplink_raw[UPLINK_RAW_BUF_SIZE];     // client bytes outside of frames. Only used by the network task
+static uint16_t uplink_raw_length = 0;
+
+typedef enum {
+    STATION_IP_ASSIGNED,
+    STATION_DISCONNECTED,
+    STATION_RESYNC          // station left that is not in ap_stations. Rebuild from the station list
+} db_station_event_type_e;
+
+typedef struct {
+    db_station_event_type_e type;
+    uint32_t ip_addr;       // network byte order
+} db_station_event_t;
+
+typedef struct {
+    uint8_t mac[6];
+    uint32_t ip_addr;       // network byte order. 0 = unused
+} db_ap_station_t;
+
+static db_ap_station_t ap_stations[MAX_AP_STATIONS];  // only used by the Wi-Fi event task
 
 int open_serial_socket() {
-    int serial_socket;
-    uart_config_t uart_config = {
+    db_uart_config_t uart_config = {
             .baud_rate = DB_UART_BAUD_RATE,
-            .data_bits = UART_DATA_8_BITS,
-            .parity    = UART_PARITY_DISABLE,
-            .stop_bits = UART_STOP_BITS_1,
-            .flow_ctrl = UART_HW_FLOWCTRL_DISABLE
+            .tx_pin = DB_UART_PIN_TX,
+            .rx_pin = DB_UART_PIN_RX,
+            .rx_buffer_size = DB_UART_RX_BUF_SIZE,
+            .tx_buffer_size = DB_UART_TX_BUF_SIZE,
+            .rx_full_threshold = DB_UART_RX_THRESH,
+            .rx_timeout = DB_UART_RX_TIMEOUT
     };
-    ESP_ERROR_CHECK(uart_param_config(UART_NUM_2, &uart_config));
-    ESP_ERROR_CHECK(uart_set_pin(UART_NUM_2, DB_UART_PIN_TX, DB_UART_PIN_RX, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
-    ESP_ERROR_CHECK(uart_driver_install(UART_NUM_2, 1024, 0, 0, NULL, 0));
-    if ((serial_socket = open("/dev/uart/2", O_RDWR)) == -1) {
-        ESP_LOGE(TAG, "Cannot open UART2");
-        close(serial_socket);
-        uart_driver_delete(UART_NUM_2);
+    if (!db_uart_open(&uart_config)) {
+        ESP_LOGE(TAG, "Cannot open UART");
         return ESP_FAIL;
     }
-    esp_vfs_dev_uart_use_driver(2);
-    return serial_socket;
+    return ESP_OK;
 }
 
 int open_udp_socket() {
@@ -99,91 +179,693 @@ int open_udp_socket() {
 }
 
 /**
- * Send to all connected TCP & UDP clients
+ * Sends to one UDP client. Client is removed from the list if sending fails
+ */
+static void send_to_udp_client(struct db_udp_connection_t *udp_conn, db_udp_client_t *client, const uint8_t data[],
+                               uint data_length) {
+    int sent = sendto(udp_conn->udp_socket, data, data_length, 0, (struct sockaddr *) &client->addr,
+                      sizeof(client->addr));
+    if (sent != data_length) {
+        ESP_LOGE(TAG, "UDP - Error sending (%i/%i) because of %d", sent, data_length, errno);
+        db_metrics.udp_send_errors++;
+        db_udp_clients_remove(&udp_conn->clients, client);
+        return;
+    }
+    client->tx_bytes += sent;
+}
+
+static uint8_t filtered_buf[UDP_BUF_SIZE];  // only used by the network task
+
+/**
+ * Sends telemetry to one TCP client. Only the frames it subscribed to if the client registered a filter
+ */
+static void send_filtered_to_tcp_client(db_tcp_client_t *tcp_client, uint8_t data[], uint data_length, int64_t now) {
+    if (tcp_client->socket < 0) return;
+    int length = -1;
+    if (db_filter_active() && SERIAL_PROTOCOL <= 3)
+        length = db_filter_apply(tcp_client->ip_addr, &tcp_client->filter_state, data, data_length, filtered_buf,
+                                 sizeof(filtered_buf), now);
+    if (length < 0) send_to_tcp_client(tcp_client, data, data_length);
+    else if (length > 0) send_to_tcp_client(tcp_client, filtered_buf, length);
+}
+
+/**
+ * Sends telemetry to one UDP client. Only the frames it subscribed to if the client registered a filter
+ */
+static void send_filtered_to_udp_client(struct db_udp_connection_t *udp_conn, db_udp_client_t *client, uint8_t data[],
+                                        uint data_length, int64_t now) {
+    int length = -1;
+    if (db_filter_active() && SERIAL_PROTOCOL <= 3)
+        length = db_filter_apply(client->addr.sin_addr.s_addr, &client->filter_state, data, data_length, filtered_buf,
+                                 sizeof(filtered_buf), now);
+    if (length < 0) send_to_udp_client(udp_conn, client, data, data_length);
+    else if (length > 0) send_to_udp_client(udp_conn, client, filtered_buf, length);
+}
+
+/**
+ * Send to all connected TCP & UDP clients. Clients that registered a filter via the comm protocol only get the frames
+ * they subscribed to.
  *
  * @param tcp_clients
  * @param udp_conn
  * @param data
  * @param data_length
  */
-void send_to_all_clients(int tcp_clients[], struct db_udp_connection_t *udp_conn, uint8_t data[], uint data_length) {
-    send_to_all_tcp_clients(tcp_clients, data, data_length);
-
-    for (int i = 0; i < MAX_UDP_CLIENTS; i++) {  // send to all UDP clients
-        if (udp_conn->udp_clients[i].sin_len > 0) {
-            int sent = sendto(udp_conn->udp_socket, data, data_length, 0, (struct sockaddr *) &udp_conn->udp_clients[i],
-                              sizeof(udp_conn->udp_clients[i]));
-            if (sent != data_length) {
-                ESP_LOGE(TAG, "UDP - Error sending (%i/%i) because of %d", sent, data_length, errno);
-                udp_conn->udp_clients[i].sin_len = 0;
+void send_to_all_clients(db_tcp_client_t tcp_clients[], struct db_udp_connection_t *udp_conn, uint8_t data[], uint data_length) {
+    if (udp_conn->group_addr.sin_family == PF_INET) {
+        // one datagram serves all UDP clients. They can not be filtered individually
+        int sent = sendto(udp_conn->udp_socket, data, data_length, 0, (struct sockaddr *) &udp_conn->group_addr,
+                          sizeof(udp_conn->group_addr));
+        if (sent != data_length) {
+            db_metrics.udp_group_send_errors++;
+            if (db_metrics.udp_group_send_errors % UDP_GROUP_ERROR_LOG_INTERVAL == 1) {  // every packet might fail
+                ESP_LOGW(TAG, "UDP - Error sending to group (%i/%i): %d. %u errors so far", sent, data_length, errno,
+                         db_metrics.udp_group_send_errors);
             }
         }
     }
+    if (!db_filter_active() || SERIAL_PROTOCOL > 3) {
+        send_to_all_tcp_clients(tcp_clients, data, data_length);
+        if (udp_conn->group_addr.sin_family == PF_INET) return;
+        for (int i = 0; i < DB_UDP_MAX_CLIENTS; i++) {  // send to all UDP clients
+            db_udp_client_t *client = &udp_conn->clients.entries[i];
+            if (client->used) send_to_udp_client(udp_conn, client, data, data_length);
+        }
+        return;
+    }
+    int64_t now = db_time_us();
+    for (int i = 0; i < CONFIG_LWIP_MAX_ACTIVE_TCP; i++)
+        send_filtered_to_tcp_client(&tcp_clients[i], data, data_length, now);
+    if (udp_conn->group_addr.sin_family == PF_INET) return;
+    for (int i = 0; i < DB_UDP_MAX_CLIENTS; i++) {
+        db_udp_client_t *client = &udp_conn->clients.entries[i];
+        if (client->used) send_filtered_to_udp_client(udp_conn, client, data, data_length, now);
+    }
+}
+
+/**
+ * Sends all MSP requests of the poller that are due
+ *
+ * @return Time in us until the next request is due
+ */
+int64_t poll_msp_commands() {
+    int64_t now = db_time_us();
+    uint8_t request[MSP_REQUEST_MAX_SIZE];
+    uint16_t request_length;
+    while ((request_length = msp_cache_due_request(now, request)) > 0) {
+        db_uart_write(request, request_length);  // not client data - not counted as uart_tx_bytes
+    }
+    return msp_cache_next_poll() - now;
+}
+
+/**
+ * Opens the loopback socket pair used to wake up the network task when new packets are in the downlink ring
+ *
+ * @return ESP_OK on success else ESP_FAIL
+ */
+int open_wakeup_sockets() {
+    wakeup_addr.sin_family = AF_INET;
+    wakeup_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    wakeup_addr.sin_port = 0;   // any free port
+    socklen_t addr_len = sizeof(wakeup_addr);
+    wakeup_rx_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    wakeup_tx_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (wakeup_rx_socket < 0 || wakeup_tx_socket < 0 ||
+        bind(wakeup_rx_socket, (struct sockaddr *) &wakeup_addr, sizeof(wakeup_addr)) < 0 ||
+        getsockname(wakeup_rx_socket, (struct sockaddr *) &wakeup_addr, &addr_len) < 0) {
+        ESP_LOGE(TAG, "Unable to create wakeup sockets: errno %d", errno);
+        return ESP_FAIL;
+    }
+    fcntl(wakeup_rx_socket, F_SETFL, O_NONBLOCK);
+    fcntl(wakeup_tx_socket, F_SETFL, O_NONBLOCK);
+    return ESP_OK;
+}
+
+/**
+ * Makes the network task return from select(). Sends at most one wakeup datagram until the network task drained them
+ */
+static void wakeup_network_task() {
+    if (wakeup_tx_socket >= 0 && db_wakeup_request(&wakeup_pending)) {
+        uint8_t wakeup_byte = 1;
+        sendto(wakeup_tx_socket, &wakeup_byte, 1, 0, (struct sockaddr *) &wakeup_addr, sizeof(wakeup_addr));
+    }
+}
+
+/**
+ * Hands a packet over to the network task. Called by the UART reader task. Packet is copied
+ *
+ * @param data Packet to send
+ * @param data_length Length of the packet
+ * @param tag DOWNLINK_BROADCAST, DOWNLINK_MSP_RESPONSE or DOWNLINK_MAVLINK_TARGETED
+ * @param first_byte_time Time the first byte of the packet was read from the UART
+ */
+static void queue_packet(const uint8_t data[], uint data_length, uint8_t tag, int64_t first_byte_time) {
+    db_frame_stamp_t stamp = {.first_byte = (uint32_t) first_byte_time, .queued = (uint32_t) db_time_us()};
+    if (!db_frame_ring_push(&downlink_ring, data, data_length, tag, &stamp)) {
+        ESP_LOGD(TAG, "Downlink ring full - dropped packet of %i bytes", data_length);
+        db_metrics.downlink_dropped++;
+        return;
+    }
+    db_metrics.downlink_queued++;
+    db_latency_record(DB_LATENCY_BATCH, stamp.queued - stamp.first_byte);
+    wakeup_network_task();
+}
+
+/**
+ * Hands a packet for all clients over to the network task. Called by the UART reader task
+ *
+ * @param data Packet to send to all clients
+ * @param data_length Length of the packet
+ * @param first_byte_time Time the first byte of the packet was read from the UART
+ */
+void queue_for_sending(uint8_t data[], uint data_length, int64_t first_byte_time) {
+    queue_packet(data, data_length, DOWNLINK_BROADCAST, first_byte_time);
+}
+
+/**
+ * Sends a MSP response to the clients that requested it. Clients that did not ask for it do not get it. Responses
+ * nobody is known to have asked for are sent to all clients
+ */
+static void send_msp_response(db_tcp_client_t tcp_clients[], struct db_udp_connection_t *udp_conn, uint8_t data[],
+                              uint16_t data_length) {
+    msp_pending_request_t requesters;
+    if (!msp_router_response(data, data_length, &requesters)) {
+        send_to_all_clients(tcp_clients, udp_conn, data, data_length);
+        return;
+    }
+    for (int i = 0; i < requesters.tcp_count; i++) {
+        db_tcp_client_t *tcp_client = &tcp_clients[requesters.tcp_requesters[i].tcp_index];
+        if (tcp_client->socket >= 0 && tcp_client->socket == requesters.tcp_requesters[i].tcp_socket)
+            send_to_tcp_client(tcp_client, data, data_length);
+    }
+    for (int i = 0; i < requesters.udp_count; i++) {
+        db_udp_client_t *client = db_udp_clients_find(&udp_conn->clients, &requesters.udp_requesters[i]);
+        if (client != NULL) {
+            send_to_udp_client(udp_conn, client, data, data_length);
+            continue;
+        }
+        // requester was removed from the client list meanwhile - answer anyway
+        int sent = sendto(udp_conn->udp_socket, data, data_length, 0,
+                          (struct sockaddr *) &requesters.udp_requesters[i], sizeof(struct sockaddr_in));
+        if (sent != data_length) {
+            ESP_LOGE(TAG, "UDP - Error sending MSP response (%i/%i) because of %d", sent, data_length, errno);
+            db_metrics.udp_send_errors++;
+        }
+    }
+}
+
+/**
+ * Sends a MAVLink frame to one client link learned by the MAVLink router. Links of clients that disconnected or timed
+ * out are skipped
+ */
+static void send_to_mavlink_route(db_tcp_client_t tcp_clients[], struct db_udp_connection_t *udp_conn,
+                                  const mavlink_route_t *route, uint8_t data[], uint16_t data_length, int64_t now) {
+    if (route->tcp_index >= 0) {
+        if (tcp_clients[route->tcp_index].socket >= 0 && tcp_clients[route->tcp_index].socket == route->tcp_socket)
+            send_filtered_to_tcp_client(&tcp_clients[route->tcp_index], data, data_length, now);
+    } else {
+        db_udp_client_t *client = db_udp_clients_find(&udp_conn->clients, &route->udp_addr);
+        if (client != NULL) send_filtered_to_udp_client(udp_conn, client, data, data_length, now);
+    }
+}
+
+/**
+ * Sends a MAVLink frame addressed to a specific system only to the client links that system was seen on. Frames for
+ * unknown systems are sent to all clients
+ */
+static void send_mavlink_targeted(db_tcp_client_t tcp_clients[], struct db_udp_connection_t *udp_conn,
+                                  uint8_t data[], uint16_t data_length) {
+    uint8_t target_system, target_component;
+    const mavlink_route_t *routes[MAVLINK_MAX_ROUTES_PER_SYSTEM];
+    get_mavlink_target(data, &target_system, &target_component);
+    int64_t now = db_time_us();
+    int route_count = mavlink_router_find(target_system, now, routes, MAVLINK_MAX_ROUTES_PER_SYSTEM);
+    if (route_count == 0) {
+        send_to_all_clients(tcp_clients, udp_conn, data, data_length);
+        return;
+    }
+    for (int i = 0; i < route_count; i++)
+        send_to_mavlink_route(tcp_clients, udp_conn, routes[i], data, data_length, now);
 }
 
-void write_to_uart(const char tcp_client_buffer[], const size_t data_length) {
-    int written = uart_write_bytes(UART_NUM_2, tcp_client_buffer, data_length);
-    if (written > 0)
+/**
+ * Writes client data to the UART. Blocks until the UART driver took it. Only called by the uplink writer task
+ */
+void write_to_uart(const uint8_t data[], const size_t data_length) {
+    int written = db_uart_write(data, data_length);
+    if (written > 0) {
+        db_metrics.uart_tx_bytes += written;
         ESP_LOGD(TAG, "Wrote %i bytes", written);
-    else
+    } else {
         ESP_LOGE(TAG, "Error writing to UART %s", esp_err_to_name(errno));
+    }
 }
 
 /**
- * @brief Parses & sends complete MSP & LTM messages
+ * Worst case: all frames of a read go to the class with the least room and every frame is a minimal frame preceded by
+ * a single byte outside of a frame - two records per UPLINK_MIN_FRAME_SIZE + 1 bytes. The incomplete frame carried over
+ * from the last read of a TCP client, chunks of bytes outside of frames and the leading/trailing chunk are covered by a
+ * reserve.
+ *
+ * @return Bytes of client data that can be parsed without overflowing an uplink queue
  */
-void parse_msp_ltm(int tcp_clients[], struct db_udp_connection_t *udp_conn, uint8_t msp_message_buffer[],
-                   uint *serial_read_bytes,
-                   msp_ltm_port_t *db_msp_ltm_port) {
-    uint8_t serial_bytes[TRANS_RD_BYTES_NUM];
-    uint read = 0;
-    if ((read = uart_read_bytes(UART_NUM_2, serial_bytes, TRANS_RD_BYTES_NUM, 200 / portTICK_RATE_MS)) > 0) {
-        for (uint j = 0; j < read; j++) {
-            (*serial_read_bytes)++;
-            uint8_t serial_byte = serial_bytes[j];
-            if (parse_msp_ltm_byte(db_msp_ltm_port, serial_byte)) {
-                msp_message_buffer[(*serial_read_bytes - 1)] = serial_byte;
-                if (db_msp_ltm_port->parse_state == MSP_PACKET_RECEIVED) {
-                    *serial_read_bytes = 0;
-                    send_to_all_clients(tcp_clients, udp_conn, msp_message_buffer, *serial_read_bytes);
-                } else if (db_msp_ltm_port->parse_state == LTM_PACKET_RECEIVED) {
-                    memcpy(&ltm_frame_buffer[ltm_frames_in_buffer_pnt], db_msp_ltm_port->ltm_frame_buffer,
-                           (db_msp_ltm_port->ltm_payload_cnt + 4));
-                    ltm_frames_in_buffer_pnt += (db_msp_ltm_port->ltm_payload_cnt + 4);
-                    ltm_frames_in_buffer++;
-                    if (ltm_frames_in_buffer == LTM_FRAME_NUM_BUFFER &&
-                        (LTM_FRAME_NUM_BUFFER <= MAX_LTM_FRAMES_IN_BUFFER)) {
-                        send_to_all_clients(tcp_clients, udp_conn, ltm_frame_buffer, *serial_read_bytes);
-                        ESP_LOGV(TAG, "Sent %i LTM message(s) to telemetry port!", LTM_FRAME_NUM_BUFFER);
-                        ltm_frames_in_buffer = 0;
-                        ltm_frames_in_buffer_pnt = 0;
-                        *serial_read_bytes = 0;
-                    }
+static uint16_t uplink_queues_budget() {
+    if (SERIAL_PROTOCOL > 3) return db_uplink_room(DB_UPLINK_BULK);  // one bulk record per read
+    uint16_t room = UINT16_MAX;
+    for (uint8_t i = 0; i < DB_UPLINK_CLASS_COUNT; i++) room = MIN(room, db_uplink_room(i));
+    uint16_t reserve = ((SERIAL_PROTOCOL == 3) ? MAVLINK_MAX_FRAME_SIZE : MSP_MAX_FRAME_SIZE) +
+                       8 * DB_FRAME_RING_RECORD_OVERHEAD;
+    if (room <= reserve) return 0;
+    return (room - reserve) * (UPLINK_MIN_FRAME_SIZE + 1) /
+           (UPLINK_MIN_FRAME_SIZE + 1 + 2 * DB_FRAME_RING_RECORD_OVERHEAD + 1);  // + 1: chunks of UPLINK_RAW_BUF_SIZE
+}
+
+/**
+ * Limits every read from a client to what the uplink queues can take, so client data is never dropped and the network
+ * task never waits for the UART. Clients are not read while the budget is 0 - their data stays in the socket and TCP
+ * clients are slowed down by the TCP window. UDP datagrams can only be read as a whole - frames of a datagram that do
+ * not fit are dropped. Called by the network task
+ *
+ * @return Bytes that can be read from a client now. If 0 the uplink writer task wakes up the network task once it made
+ * room
+ */
+static uint16_t uplink_read_budget() {
+    uint16_t budget = uplink_queues_budget();
+    if (budget > 0) return budget;
+    __atomic_exchange_n(&uplink_stalled, 1, __ATOMIC_ACQ_REL);
+    return uplink_queues_budget();  // writer task might have made room before it saw the flag
+}
+
+/**
+ * Queues client data for the uplink writer task. Never waits - data that does not fit is dropped and counted
+ * (uplink stats). Reads are limited by uplink_read_budget() so this only happens with UDP datagrams
+ */
+static void queue_uplink(const uint8_t frame[], uint16_t length, uint8_t priority_class) {
+    if (!db_uplink_queue(frame, length, priority_class))
+        ESP_LOGD(TAG, "Uplink queue %i full - dropped frame of %i bytes", priority_class, length);
+}
+
+/**
+ * Queues the collected client bytes that are not part of a frame as bulk data. Called before every frame so the bytes
+ * are queued in front of the frames that follow them in the same class. Frames in the control and normal class
+ * overtake them like they overtake bulk frames
+ */
+static void flush_uplink_raw() {
+    if (uplink_raw_length == 0) return;
+    queue_uplink(uplink_raw, uplink_raw_length, DB_UPLINK_BULK);
+    uplink_raw_length = 0;
+}
+
+/**
+ * Collects client bytes that are not part of a frame. The flight controller may understand them (CLI, other
+ * protocols). See flush_uplink_raw()
+ */
+static void add_uplink_raw(const uint8_t data[], uint16_t length) {
+    while (length > 0) {
+        uint16_t span = MIN(length, UPLINK_RAW_BUF_SIZE - uplink_raw_length);
+        memcpy(&uplink_raw[uplink_raw_length], data, span);
+        uplink_raw_length += span;
+        data += span;
+        length -= span;
+        if (uplink_raw_length == UPLINK_RAW_BUF_SIZE) flush_uplink_raw();
+    }
+}
+
+static void add_uplink_raw_byte(uint8_t skipped_byte) {
+    add_uplink_raw(&skipped_byte, 1);
+}
+
+/**
+ * Passes a MAVLink frame received from one client on to the other clients. Learns which systems are behind which
+ * client. Broadcasts go to all other clients, frames addressed to a system seen on another client only to that client
+ *
+ * @param tcp_index Index of the TCP client that sent the frame. -1 for UDP clients
+ * @param udp_addr Address of the UDP client that sent the frame. NULL for TCP clients
+ */
+static void route_mavlink_uplink(db_tcp_client_t tcp_clients[], struct db_udp_connection_t *udp_conn, uint8_t frame[],
+                                 uint16_t frame_length, int tcp_index, const struct sockaddr_in *udp_addr,
+                                 int64_t now) {
+    int tcp_socket = (tcp_index >= 0) ? tcp_clients[tcp_index].socket : -1;
+    mavlink_router_learn(get_mavlink_source_system(frame), tcp_index, tcp_socket, udp_addr, now);
+    uint8_t target_system, target_component;
+    if (get_mavlink_target(frame, &target_system, &target_component)) {
+        const mavlink_route_t *routes[MAVLINK_MAX_ROUTES_PER_SYSTEM];
+        int route_count = mavlink_router_find(target_system, now, routes, MAVLINK_MAX_ROUTES_PER_SYSTEM);
+        for (int i = 0; i < route_count; i++) {
+            if (routes[i]->tcp_index == tcp_index && (tcp_index >= 0 ||
+                (routes[i]->udp_addr.sin_addr.s_addr == udp_addr->sin_addr.s_addr &&
+                 routes[i]->udp_addr.sin_port == udp_addr->sin_port))) continue;  // sender
+            send_to_mavlink_route(tcp_clients, udp_conn, routes[i], frame, frame_length, now);
+        }
+        return;
+    }
+    for (int i = 0; i < CONFIG_LWIP_MAX_ACTIVE_TCP; i++) {
+        if (i != tcp_index) send_filtered_to_tcp_client(&tcp_clients[i], frame, frame_length, now);
+    }
+    for (int i = 0; i < DB_UDP_MAX_CLIENTS; i++) {
+        db_udp_client_t *client = &udp_conn->clients.entries[i];
+        if (!client->used || (tcp_index < 0 && client->addr.sin_addr.s_addr == udp_addr->sin_addr.s_addr &&
+                              client->addr.sin_port == udp_addr->sin_port)) continue;
+        send_filtered_to_udp_client(udp_conn, client, frame, frame_length, now);
+    }
+}
+
+/**
+ * Parses client data and queues it for the uplink writer task. Complete frames are queued, each in the priority class
+ * of its message, so frames of different clients never interleave on the UART. Frames are only in order within their
+ * class - a control frame of a client is written before the bulk frames it sent earlier. Bytes outside of frames are
+ * queued as bulk data, so are the bytes of an incomplete frame at the end of a UDP datagram. Transparent data is queued
+ * as bulk data as received.
+ * MSP: Requests that can be answered from the MSP cache are not queued - their cached responses are collected in
+ * reply. Requests without payload that are already waiting for a response from the flight controller are not queued
+ * either - the client gets the response of the pending request.
+ * MAVLink: Frames are passed on to the other clients as well - see route_mavlink_uplink()
+ *
+ * @param parser Parser of the client stream. Keeps incomplete frames of TCP clients until the next read
+ * @param data Data received from a client
+ * @param data_length Length of the data
+ * @param reply Buffer for the cached responses. Must be sent to the client that sent the data
+ * @param reply_size Size of the reply buffer
+ * @param tcp_index Index of the TCP client that sent the data. -1 for UDP clients
+ * @param udp_addr Address of the UDP client that sent the data. NULL for TCP clients
+ * @return Length of the cached responses in reply
+ */
+uint16_t handle_uplink(db_tcp_client_t tcp_clients[], struct db_udp_connection_t *udp_conn, db_uplink_parser_t *parser,
+                       const uint8_t data[], size_t data_length, uint8_t reply[], uint16_t reply_size, int tcp_index,
+                       const struct sockaddr_in *udp_addr) {
+    uint16_t reply_length = 0;
+    int64_t now = db_time_us();
+    if (SERIAL_PROTOCOL == 1 || SERIAL_PROTOCOL == 2) {
+        msp_ltm_port_t *request_port = &parser->msp_ltm;
+        int tcp_socket = (tcp_index >= 0) ? tcp_clients[tcp_index].socket : -1;
+        const uint8_t *frame;
+        uint16_t frame_length;
+        for (size_t i = 0; i < data_length; i++) {
+            if (!parse_msp_ltm_byte(request_port, data[i])) {
+                add_uplink_raw_byte(data[i]);
+                continue;
+            }
+            if (request_port->parse_state == IDLE) {  // frame rejected - all its bytes are in the frame buffer
+                add_uplink_raw(request_port->msp_frame_buffer, request_port->msp_frame_length);
+            } else if (request_port->parse_state == MSP_PACKET_RECEIVED) {
+                uint16_t length = 0;
+                if (msp_cache_enabled())
+                    length = msp_cache_lookup(request_port, now, &reply[reply_length], reply_size - reply_length);
+                if (length > 0 || !msp_router_request(request_port, now, tcp_index, tcp_socket, udp_addr)) {
+                    reply_length += length;
+                    continue;
                 }
+                frame_length = get_msp_ltm_frame(request_port, &frame);
+                flush_uplink_raw();
+                queue_uplink(frame, frame_length, db_uplink_msp_class(request_port->cmdMSP, request_port->dataSize));
+            } else if (request_port->parse_state == LTM_PACKET_RECEIVED) {
+                frame_length = get_msp_ltm_frame(request_port, &frame);
+                flush_uplink_raw();
+                queue_uplink(frame, frame_length, DB_UPLINK_NORMAL);
             }
         }
+        if (tcp_index < 0 && request_port->parse_state != IDLE && request_port->parse_state != MSP_PACKET_RECEIVED &&
+            request_port->parse_state != LTM_PACKET_RECEIVED) {
+            add_uplink_raw(request_port->msp_frame_buffer, request_port->msp_frame_length);
+        }
+    } else if (SERIAL_PROTOCOL == 3) {
+        mavlink_port_t *uplink_port = &parser->mavlink;
+        size_t pos = 0;
+        while (parse_mavlink_buffer(uplink_port, data, data_length, &pos)) {
+            flush_uplink_raw();
+            queue_uplink(uplink_port->frame_buffer, uplink_port->frame_length,
+                         db_uplink_mavlink_class(uplink_port->msg_id));
+            route_mavlink_uplink(tcp_clients, udp_conn, uplink_port->frame_buffer, uplink_port->frame_length,
+                                 tcp_index, udp_addr, now);
+        }
+        if (tcp_index < 0 && uplink_port->parse_state != MAV_IDLE && uplink_port->parse_state != MAV_FRAME_RECEIVED)
+            add_uplink_raw(uplink_port->frame_buffer, uplink_port->frame_length);
+    } else {
+        queue_uplink(data, data_length, DB_UPLINK_BULK);
     }
+    flush_uplink_raw();
+    xSemaphoreGive(uplink_semaphore);
+    return reply_length;
 }
 
+/**
+ * Resets the parser of a client stream. Called before the first data of a new client is parsed
+ */
+static void init_uplink_parser(db_uplink_parser_t *parser) {
+    if (SERIAL_PROTOCOL == 3) {
+        init_mavlink_port(&parser->mavlink);
+        parser->mavlink.on_skipped_byte = add_uplink_raw_byte;
+    } else {
+        memset(&parser->msp_ltm, 0, sizeof(parser->msp_ltm));
+    }
+}
 
 /**
- * Reads one byte from UART and checks if we already got enough bytes to send them out
+ * Sends all packets queued by the UART reader task to the clients. Called by the network task. Records the latency of
+ * every packet - times are compared as 32 bit so a wrap of the lower bits does not matter
+ */
+void send_queued_packets(db_tcp_client_t tcp_clients[], struct db_udp_connection_t *udp_conn) {
+    uint8_t wakeup_bytes[16];
+    while (recv(wakeup_rx_socket, wakeup_bytes, sizeof(wakeup_bytes), 0) > 0);
+    // clear before draining - a packet pushed after this point triggers a new wakeup
+    db_wakeup_rearm(&wakeup_pending);
+    uint8_t *data;
+    uint16_t data_length;
+    uint8_t tag;
+    db_frame_stamp_t stamp;
+    while (db_frame_ring_peek(&downlink_ring, &data, &data_length, &tag, &stamp)) {
+        uint32_t dequeued = (uint32_t) db_time_us();
+        db_metrics.downlink_packets++;
+        db_metrics.downlink_bytes += data_length;
+        db_latency_record(DB_LATENCY_QUEUE, dequeued - stamp.queued);
+        // TCP clients record the send latency once their socket took the packet - maybe later from the send queue
+        db_tcp_stamp_t tcp_stamp = {.first_byte = stamp.first_byte, .dequeued = dequeued};
+        set_tcp_send_stamp(&tcp_stamp);
+        if (tag == DOWNLINK_MSP_RESPONSE) {
+            send_msp_response(tcp_clients, udp_conn, data, data_length);
+        } else if (tag == DOWNLINK_MAVLINK_TARGETED) {
+            send_mavlink_targeted(tcp_clients, udp_conn, data, data_length);
+        } else {
+            send_to_all_clients(tcp_clients, udp_conn, data, data_length);
+        }
+        set_tcp_send_stamp(NULL);
+        db_frame_ring_pop(&downlink_ring);
+        if (udp_conn->clients.count > 0 || udp_conn->group_addr.sin_family == PF_INET) {
+            // sendto() returns once the datagram is sent
+            uint32_t sent = (uint32_t) db_time_us();
+            db_latency_record(DB_LATENCY_SEND, sent - dequeued);
+            db_latency_record(DB_LATENCY_TOTAL, sent - stamp.first_byte);
+        }
+    }
+}
+
+/**
+ * Waits for data from the UART and logs & counts lost and corrupted data
+ *
+ * @param timeout_us Max. time to wait for data
+ * @return Number of bytes currently waiting in the UART RX buffer
+ */
+size_t wait_for_uart(int64_t timeout_us) {
+    db_uart_events_t events = {0};
+    size_t available = db_uart_wait(timeout_us, &events);
+    if (events.fifo_overflows > 0) {
+        ESP_LOGW(TAG, "UART: HW FIFO overflow - bytes were lost");
+        db_metrics.uart_fifo_overflows += events.fifo_overflows;
+    }
+    if (events.buffer_full > 0) {
+        ESP_LOGW(TAG, "UART: RX ring buffer full - reading is too slow");
+        db_metrics.uart_buffer_full += events.buffer_full;
+    }
+    if (events.frame_errors > 0) {
+        ESP_LOGW(TAG, "UART: Framing/parity error - check baud rate & wiring");
+        db_metrics.uart_frame_errors += events.frame_errors;
+    }
+    if (available > db_metrics.uart_rx_buffered_max) db_metrics.uart_rx_buffered_max = available;
+    return available;
+}
+
+/**
+ * Queues the packet of the MSP/LTM packer for sending
+ */
+void send_msp_ltm_packet() {
+    queue_for_sending(msp_ltm_packer.buffer, msp_ltm_packer.length, msp_ltm_packer.start_time);
+    ESP_LOGV(TAG, "Sent %i MSP/LTM frame(s) to telemetry port!", msp_ltm_packer.frames);
+    db_packer_reset(&msp_ltm_packer);
+    db_metrics.packer_packets = msp_ltm_packer.packets_total;
+    db_metrics.packer_frames = msp_ltm_packer.frames_total;
+    db_metrics.packer_efficiency = db_packer_efficiency(&msp_ltm_packer);
+}
+
+/**
+ * Adds a complete MSP or LTM frame to the current packet. Packet is sent once MSP_LTM_PACKET_SIZE is reached or the
+ * next frame would exceed it.
+ *
+ * @param first_byte_time Time the first byte of the frame was read from the UART
+ */
+void pack_msp_ltm_frame(const uint8_t frame[], uint16_t frame_length, int64_t first_byte_time) {
+    if (!db_packer_fits(&msp_ltm_packer, frame_length, MSP_LTM_PACKET_SIZE)) send_msp_ltm_packet();
+    db_packer_add(&msp_ltm_packer, frame, frame_length, first_byte_time);
+    if (msp_ltm_packer.length >= db_packer_budget(MSP_LTM_PACKET_SIZE)) send_msp_ltm_packet();
+}
+
+/**
+ * Called by the parser for every complete & valid MSP/LTM frame. Frame is packed straight from the parser buffer.
+ * Responses to polled commands are stored in the MSP cache. Other MSP responses are not packed but queued on their own
+ * so the network task can send them to the clients that requested them
+ */
+void on_msp_ltm_frame(msp_ltm_port_t *msp_ltm_port) {
+    if (msp_ltm_port->parse_state == MSP_PACKET_RECEIVED && msp_cache_enabled() &&
+        !msp_cache_update(msp_ltm_port, db_time_us())) {
+        frame_start_time = uart_read_time;
+        return;  // response to a poll nobody asked for. Clients get it from the cache
+    }
+    const uint8_t *frame;
+    uint16_t frame_length = get_msp_ltm_frame(msp_ltm_port, &frame);
+    if (msp_ltm_port->parse_state == MSP_PACKET_RECEIVED && msp_ltm_port->msp_direction == '>') {
+        queue_packet(frame, frame_length, DOWNLINK_MSP_RESPONSE, frame_start_time);
+    } else {
+        pack_msp_ltm_frame(frame, frame_length, frame_start_time);
+    }
+    frame_start_time = uart_read_time;  // next frame starts in the same chunk at the earliest
+}
+
+/**
+ * @return true if the parser is not in the middle of a frame. The next frame starts in the next chunk at the earliest
+ */
+static bool msp_ltm_between_frames(const msp_ltm_port_t *msp_ltm_port) {
+    return msp_ltm_port->parse_state == IDLE || msp_ltm_port->parse_state == MSP_PACKET_RECEIVED ||
+           msp_ltm_port->parse_state == LTM_PACKET_RECEIVED;
+}
+
+/**
+ * @brief Parses & packs complete MSP & LTM messages for sending. Reads until the UART RX buffer is drained.
+ * Does not block.
+ *
+ * @param available Number of bytes waiting in the UART RX buffer
+ */
+void parse_msp_ltm(msp_ltm_port_t *db_msp_ltm_port, size_t available) {
+    uint8_t serial_bytes[UART_BUF_SIZE];
+    int read = 0;
+    while (available > 0 &&
+           (read = db_uart_read(serial_bytes, MIN(available, UART_BUF_SIZE))) > 0) {
+        available -= MIN(available, (size_t) read);
+        db_metrics.uart_rx_bytes += read;
+        uart_read_time = db_time_us();
+        if (msp_ltm_between_frames(db_msp_ltm_port)) frame_start_time = uart_read_time;
+        parse_msp_ltm_buffer(db_msp_ltm_port, serial_bytes, read, on_msp_ltm_frame);
+    }
+    db_metrics.parser_frames = db_msp_ltm_port->frames_received;
+    db_metrics.parser_bad_checksums = db_msp_ltm_port->bad_checksums;
+    db_metrics.parser_resyncs = db_msp_ltm_port->resyncs;
+    db_metrics.parser_skipped_bytes = db_msp_ltm_port->skipped_bytes;
+}
+
+
+/**
+ * Reads all available bytes from UART directly into the packet buffer and queues it once it is full. Does not block.
  *
- * @param tcp_clients Array of connected TCP clients
  * @param serial_read_bytes Number of bytes already read for the current packet
+ * @param available Number of bytes waiting in the UART RX buffer
  */
-void parse_transparent(int tcp_clients[], struct db_udp_connection_t *udp_conn, uint8_t serial_buffer[],
-                       uint *serial_read_bytes) {
-    uint8_t serial_bytes[TRANS_RD_BYTES_NUM];
-    uint read = 0;
-    if ((read = uart_read_bytes(UART_NUM_2, serial_bytes, TRANS_RD_BYTES_NUM, 200 / portTICK_RATE_MS)) > 0) {
-        memcpy(&serial_buffer[*serial_read_bytes], serial_bytes, read);
+void parse_transparent(uint8_t serial_buffer[], uint *serial_read_bytes, size_t available) {
+    int read = 0;
+    while (available > 0 && (read = db_uart_read(&serial_buffer[*serial_read_bytes],
+                                                 MIN(available, TRANSPARENT_BUF_SIZE - *serial_read_bytes))) > 0) {
+        available -= MIN(available, (size_t) read);
+        db_metrics.uart_rx_bytes += read;
+        if (*serial_read_bytes == 0) serial_buffer_start_time = db_time_us();
         *serial_read_bytes += read;
         if (*serial_read_bytes >= TRANSPARENT_BUF_SIZE) {
-            send_to_all_clients(tcp_clients, udp_conn, serial_buffer, *serial_read_bytes);
+            queue_for_sending(serial_buffer, *serial_read_bytes, serial_buffer_start_time);
+            *serial_read_bytes = 0;
+        }
+    }
+}
+
+/**
+ * Reads all available bytes from UART, parses MAVLink frames and packs complete frames into one packet. Packet is
+ * queued once TRANSPARENT_BUF_SIZE is reached or the next frame would exceed MAVLINK_DATAGRAM_BUDGET. Frames with bad
+ * CRC are dropped, frames of messages with unknown CRC_EXTRA are passed on. Does not block.
+ *
+ * @param serial_buffer Packet buffer. Must be at least MAVLINK_DATAGRAM_BUDGET in size
+ * @param serial_read_bytes Number of bytes already in the packet buffer
+ * @param mavlink_port MAVLink parser state
+ * @param available Number of bytes waiting in the UART RX buffer
+ */
+void parse_mavlink(uint8_t serial_buffer[], uint *serial_read_bytes, mavlink_port_t *mavlink_port, size_t available) {
+    uint8_t serial_bytes[UART_BUF_SIZE];
+    int read = 0;
+    while (available > 0 &&
+           (read = db_uart_read(serial_bytes, MIN(available, UART_BUF_SIZE))) > 0) {
+        available -= MIN(available, (size_t) read);
+        db_metrics.uart_rx_bytes += read;
+        uart_read_time = db_time_us();
+        if (mavlink_port->parse_state == MAV_IDLE || mavlink_port->parse_state == MAV_FRAME_RECEIVED)
+            frame_start_time = uart_read_time;
+        size_t pos = 0;
+        while (parse_mavlink_buffer(mavlink_port, serial_bytes, read, &pos)) {
+            uint8_t target_system, target_component;
+            if (get_mavlink_target(mavlink_port->frame_buffer, &target_system, &target_component)) {
+                // sent on its own so the network task can route it. Keep the order of frames
+                if (*serial_read_bytes > 0) {
+                    queue_for_sending(serial_buffer, *serial_read_bytes, serial_buffer_start_time);
+                    *serial_read_bytes = 0;
+                }
+                queue_packet(mavlink_port->frame_buffer, mavlink_port->frame_length, DOWNLINK_MAVLINK_TARGETED,
+                             frame_start_time);
+                frame_start_time = uart_read_time;
+                continue;
+            }
+            if (*serial_read_bytes + mavlink_port->frame_length > MAVLINK_DATAGRAM_BUDGET) {
+                queue_for_sending(serial_buffer, *serial_read_bytes, serial_buffer_start_time);
+                *serial_read_bytes = 0;
+            }
+            if (*serial_read_bytes == 0) serial_buffer_start_time = frame_start_time;
+            frame_start_time = uart_read_time;
+            memcpy(&serial_buffer[*serial_read_bytes], mavlink_port->frame_buffer, mavlink_port->frame_length);
+            *serial_read_bytes += mavlink_port->frame_length;
+            if (*serial_read_bytes >= TRANSPARENT_BUF_SIZE) {
+                queue_for_sending(serial_buffer, *serial_read_bytes, serial_buffer_start_time);
+                *serial_read_bytes = 0;
+            }
+        }
+    }
+    db_metrics.parser_frames = mavlink_port->frames_received;
+    db_metrics.parser_unvalidated = mavlink_port->unvalidated;
+    db_metrics.parser_bad_checksums = mavlink_port->bad_crcs;
+    db_metrics.parser_resyncs = mavlink_port->resyncs;
+}
+
+/**
+ * Sends partially filled transparent/MAVLink & MSP/LTM packets once their oldest data waited for SERIAL_HOLD_TIME_US.
+ * Limits the latency of the last packet of a burst. Disabled if SERIAL_HOLD_TIME_US is 0
+ *
+ * @param serial_buffer Transparent/MAVLink packet buffer
+ * @param serial_read_bytes Number of bytes in the transparent/MAVLink packet buffer
+ * @return Time in us until the next packet must be flushed. UDP_BRDC_UPDATE_INTERVAL_US if nothing is pending
+ */
+int64_t flush_expired_packets(uint8_t serial_buffer[], uint *serial_read_bytes) {
+    int64_t next_flush = UDP_BRDC_UPDATE_INTERVAL_US;
+    if (SERIAL_HOLD_TIME_US == 0) return next_flush;
+    int64_t now = db_time_us();
+    if (*serial_read_bytes > 0) {
+        int64_t remaining = serial_buffer_start_time + SERIAL_HOLD_TIME_US - now;
+        if (remaining <= 0) {
+            queue_for_sending(serial_buffer, *serial_read_bytes, serial_buffer_start_time);
             *serial_read_bytes = 0;
+        } else {
+            next_flush = MIN(next_flush, remaining);
+        }
+    }
+    if (msp_ltm_packer.length > 0) {
+        int64_t remaining = msp_ltm_packer.start_time + SERIAL_HOLD_TIME_US - now;
+        if (remaining <= 0) {
+            send_msp_ltm_packet();
+        } else {
+            next_flush = MIN(next_flush, remaining);
         }
     }
+    return next_flush;
 }
 
 /**
@@ -192,15 +874,16 @@ void parse_transparent(int tcp_clients[], struct db_udp_connection_t *udp_conn,
  * @param tcp_master_socket
  * @param tcp_clients
  */
-void handle_tcp_master(const int tcp_master_socket, int tcp_clients[]) {
+void handle_tcp_master(const int tcp_master_socket, db_tcp_client_t tcp_clients[]) {
     struct sockaddr_in6 source_addr; // Large enough for both IPv4 or IPv6
     uint addr_len = sizeof(source_addr);
     int new_tcp_client = accept(tcp_master_socket, (struct sockaddr *) &source_addr, &addr_len);
     if (new_tcp_client > 0) {
         for (int i = 0; i < CONFIG_LWIP_MAX_ACTIVE_TCP; i++) {
-            if (tcp_clients[i] <= 0) {
-                tcp_clients[i] = new_tcp_client;
-                fcntl(tcp_clients[i], F_SETFL, O_NONBLOCK);
+            if (tcp_clients[i].socket < 0) {
+                if (!add_tcp_client(&tcp_clients[i], new_tcp_client,
+                                    ((struct sockaddr_in *) &source_addr)->sin_addr.s_addr)) break;
+                init_uplink_parser(&tcp_uplink_parsers[i]);
                 char addr_str[128];
                 inet_ntoa_r(((struct sockaddr_in *) &source_addr)->sin_addr.s_addr, addr_str, sizeof(addr_str) - 1);
                 ESP_LOGI(TAG, "TCP: New client connected: %s", addr_str);
@@ -208,151 +891,393 @@ void handle_tcp_master(const int tcp_master_socket, int tcp_clients[]) {
             }
         }
         ESP_LOGI(TAG, "TCP: Could not accept connection. Too many clients connected.");
+        close(new_tcp_client);
     }
 }
 
 /**
- * Add a new client to the list of known UDP clients. Check if client is already known
+ * Read all available data from a TCP client and queue it for the UART. Every read is limited to what the uplink queues
+ * can take - see uplink_read_budget(). Closes the connection on error/disconnect
+ *
+ * @param tcp_clients Array of connected TCP clients
+ * @param udp_conn UDP clients. MAVLink frames from the TCP client might be routed to them
+ * @param client_index Index of the client that is ready to be read
+ * @param tcp_client_buffer Buffer to receive into. Must be TCP_BUFF_SIZ in size
+ */
+void handle_tcp_client(db_tcp_client_t tcp_clients[], struct db_udp_connection_t *udp_conn, int client_index,
+                       char tcp_client_buffer[]) {
+    ssize_t recv_length;
+    uint8_t msp_reply[MSP_REPLY_BUF_SIZE];
+    uint16_t budget;
+    while ((budget = uplink_read_budget()) > 0) {
+        recv_length = recv(tcp_clients[client_index].socket, tcp_client_buffer, MIN(TCP_BUFF_SIZ, budget), 0);
+        if (recv_length == 0) {
+            close_tcp_client(&tcp_clients[client_index]);
+            ESP_LOGI(TAG, "TCP client disconnected");
+            return;
+        } else if (recv_length < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ESP_LOGE(TAG, "Error receiving from TCP client %i (fd: %i): %d", client_index,
+                         tcp_clients[client_index].socket, errno);
+                close_tcp_client(&tcp_clients[client_index]);
+            }
+            return;
+        }
+        ESP_LOGD(TAG, "TCP: Received %i bytes", recv_length);
+        tcp_clients[client_index].received_bytes += recv_length;
+        db_metrics.uplink_packets++;
+        db_metrics.uplink_bytes += recv_length;
+        uint16_t reply_length = handle_uplink(tcp_clients, udp_conn, &tcp_uplink_parsers[client_index],
+                                              (const uint8_t *) tcp_client_buffer, recv_length, msp_reply,
+                                              MSP_REPLY_BUF_SIZE, client_index, NULL);
+        if (reply_length > 0) send_to_tcp_client(&tcp_clients[client_index], msp_reply, reply_length);
+    }
+}
+
+/**
+ * Add a new client to the list of known UDP clients or refresh its last seen time if it is already known
  *
  * @param connections Structure containing all UDP connection information
  * @param new_client_addr Address of new client
+ * @param is_brdcst true if client is added because its station is connected to the AP
+ * @return The client. NULL if it could not be added
  */
-void
+db_udp_client_t *
 add_udp_to_known_clients(struct db_udp_connection_t *connections, struct sockaddr_in new_client_addr, bool is_brdcst) {
-    for (int i = 0; i < MAX_UDP_CLIENTS; i++) {
-        if (connections->udp_clients[i].sin_port == new_client_addr.sin_port && new_client_addr.sin_family == PF_INET &&
-            ((struct sockaddr_in *) &connections->udp_clients[i])->sin_addr.s_addr ==
-            ((struct sockaddr_in *) &new_client_addr)->sin_addr.s_addr) {
-            return;
-        } else if (connections->udp_clients[i].sin_len == 0) {
-            connections->udp_clients[i] = new_client_addr;
-            char addr_str[128];
-            if (new_client_addr.sin_family == PF_INET) {
-                inet_ntoa_r(((struct sockaddr_in *) &new_client_addr)->sin_addr.s_addr, addr_str, sizeof(addr_str) - 1);
+    if (new_client_addr.sin_family != PF_INET) return NULL;
+    bool is_new;
+    db_udp_client_t *client = db_udp_clients_add(&connections->clients, &new_client_addr, is_brdcst,
+                                                  db_time_us(), &is_new);
+    if (client == NULL) {
+        ESP_LOGW(TAG, "UDP: Could not add client. Too many clients");
+    } else if (is_new && !is_brdcst) {
+        char addr_str[128];
+        inet_ntoa_r(new_client_addr.sin_addr.s_addr, addr_str, sizeof(addr_str) - 1);
+        ESP_LOGI(TAG, "UDP: New client connected: %s:%i", addr_str, ntohs(new_client_addr.sin_port));
+    }
+    return client;
+}
+
+/**
+ * Sets the destination of broadcast/multicast downlink mode. The subnet broadcast address follows the IP address of
+ * the interface, which may change in station mode
+ */
+static void update_udp_group_addr(struct db_udp_connection_t *connections, bool ap_mode) {
+    struct sockaddr_in group_addr;
+    memset(&group_addr, 0, sizeof(group_addr));
+    if (UDP_DOWNLINK_MODE == UDP_DOWNLINK_BROADCAST) {
+        uint32_t ip_addr, netmask;
+        if (db_wifi_get_ip_info(ap_mode, &ip_addr, &netmask)) group_addr.sin_addr.s_addr = ip_addr | ~netmask;
+    } else if (UDP_DOWNLINK_MODE == UDP_DOWNLINK_MULTICAST) {
+        inet_aton(UDP_MULTICAST_GROUP, &group_addr.sin_addr);
+    }
+    if (group_addr.sin_addr.s_addr != 0) {
+        group_addr.sin_family = PF_INET;
+        group_addr.sin_port = htons(APP_PORT_PROXY_UDP);
+    }
+    if (group_addr.sin_addr.s_addr != connections->group_addr.sin_addr.s_addr) {
+        char addr_str[16];
+        inet_ntoa_r(group_addr.sin_addr, addr_str, sizeof(addr_str));
+        ESP_LOGI(TAG, "UDP: Sending downlink to %s:%i", addr_str, APP_PORT_PROXY_UDP);
+    }
+    connections->group_addr = group_addr;
+}
+
+/**
+ * Removes idle UDP clients and updates the broadcast/multicast destination. Runs once per UDP_BRDC_UPDATE_INTERVAL_US
+ *
+ * @param last_update Time of the last update. Updated
+ * @param connections Structure containing all UDP connection information
+ * @param ap_mode true if the ESP32 is the access point
+ */
+void update_udp_clients(int64_t *last_update, struct db_udp_connection_t *connections, bool ap_mode) {
+    if ((db_time_us() - *last_update) < UDP_BRDC_UPDATE_INTERVAL_US) return;
+    *last_update = db_time_us();
+    int expired = db_udp_clients_expire(&connections->clients, *last_update);
+    if (expired > 0) ESP_LOGI(TAG, "UDP: Removed %i idle client(s)", expired);
+    if (UDP_DOWNLINK_MODE != UDP_DOWNLINK_UNICAST) update_udp_group_addr(connections, ap_mode);
+}
+
+/**
+ * Builds a UDP client address of a station connected to the local AP. Stations get telemetry on APP_PORT_PROXY_UDP
+ */
+static struct sockaddr_in station_udp_addr(uint32_t ip_addr) {
+    struct sockaddr_in station_addr;
+    memset(&station_addr, 0, sizeof(station_addr));
+    station_addr.sin_family = PF_INET;
+    station_addr.sin_port = htons(APP_PORT_PROXY_UDP);
+    station_addr.sin_addr.s_addr = ip_addr;
+    return station_addr;
+}
+
+/**
+ * Adds all stations connected to the local AP to the UDP clients. Replaces all station entries. Called on start of the
+ * network task and if a station left that could not be mapped to its IP address
+ */
+static void add_connected_stations(struct db_udp_connection_t *connections) {
+    db_wifi_station_t stations[MAX_AP_STATIONS];
+    int station_count = db_wifi_get_stations(stations, MAX_AP_STATIONS);
+    if (station_count < 0) return;
+    for (int i = 0; i < DB_UDP_MAX_CLIENTS; i++) {
+        if (connections->clients.entries[i].is_broadcast)
+            db_udp_clients_remove(&connections->clients, &connections->clients.entries[i]);
+    }
+    for (int i = 0; i < station_count; i++) {
+        // DHCP bug. Assigns 0.0.0.0 to station when directly connected on startup
+        if (stations[i].ip_addr != 0)
+            add_udp_to_known_clients(connections, station_udp_addr(stations[i].ip_addr), true);
+    }
+}
+
+/**
+ * Adds & removes UDP clients based on the stations connecting to/leaving the local AP. Called by the network task
+ */
+void handle_station_events(struct db_udp_connection_t *connections) {
+    db_station_event_t station_event;
+    while (xQueueReceive(station_event_queue, &station_event, 0) == pdTRUE) {
+        struct sockaddr_in station_addr = station_udp_addr(station_event.ip_addr);
+        switch (station_event.type) {
+            case STATION_IP_ASSIGNED:
+                add_udp_to_known_clients(connections, station_addr, true);
+                break;
+            case STATION_DISCONNECTED: {
+                db_udp_client_t *client = db_udp_clients_find(&connections->clients, &station_addr);
+                if (client != NULL) db_udp_clients_remove(&connections->clients, client);
+                break;
             }
-            connections->is_broadcast[i] = is_brdcst;
-            if (!is_brdcst)
-                ESP_LOGI(TAG, "UDP: New client connected: %s:%i", addr_str, new_client_addr.sin_port);
-            return;
+            case STATION_RESYNC:
+                add_connected_stations(connections);
+                break;
         }
     }
 }
 
+static void post_station_event(db_station_event_type_e type, uint32_t ip_addr) {
+    if (station_event_queue == NULL) return;  // control module not started yet. Network task adds stations on start
+    db_station_event_t station_event = {.type = type, .ip_addr = ip_addr};
+    if (xQueueSend(station_event_queue, &station_event, 0) != pdTRUE)
+        ESP_LOGW(TAG, "Station event queue full");
+    wakeup_network_task();
+}
+
 /**
- * Get all connected clients to local AP and add to UDP connection list. List is updated every second
+ * Called by the Wi-Fi event handler when the DHCP server assigned an address to a station of the local AP. Station gets
+ * telemetry right away
  *
- * @param pInt
- */
-void update_udp_broadcast(int64_t *last_update, struct db_udp_connection_t *connections, const wifi_mode_t *wifi_mode) {
-    if (*wifi_mode == WIFI_MODE_AP && (esp_timer_get_time() - *last_update) >= 1000000) {
-        *last_update = esp_timer_get_time();
-        // clear all entries
-        for (int i = 0; i < MAX_UDP_CLIENTS; i++) {
-            if (connections->is_broadcast[i]) {
-                memset(&connections->udp_clients[i], 0, sizeof(connections->udp_clients[i]));
+ * @param ip_addr Assigned IPv4 address in network byte order
+ */
+void db_station_ip_assigned(uint32_t ip_addr) {
+    if (ip_addr == 0) return;
+    db_wifi_station_t stations[MAX_AP_STATIONS];
+    int station_count = db_wifi_get_stations(stations, MAX_AP_STATIONS);
+    for (int i = 0; i < station_count; i++) {  // remember MAC. Disconnect event only contains the MAC
+        if (stations[i].ip_addr != ip_addr) continue;
+        db_ap_station_t *free_slot = NULL;
+        for (int k = 0; k < MAX_AP_STATIONS; k++) {
+            if (ap_stations[k].ip_addr == 0 || memcmp(ap_stations[k].mac, stations[i].mac, 6) == 0) {
+                free_slot = &ap_stations[k];
+                if (ap_stations[k].ip_addr != 0) break;  // prefer the slot of the same station
             }
         }
-        // add based on connected stations
-        wifi_sta_list_t sta_list;
-        tcpip_adapter_sta_list_t tcpip_sta_list;
-        memset(&sta_list, 0, sizeof(sta_list));
-        memset(&tcpip_sta_list, 0, sizeof(tcpip_sta_list));
-        ESP_ERROR_CHECK(esp_wifi_ap_get_sta_list(&sta_list));
-        ESP_ERROR_CHECK(tcpip_adapter_get_sta_list(&sta_list, &tcpip_sta_list));
-        for (int i = 0; i < tcpip_sta_list.num; i++) {
-            tcpip_adapter_sta_info_t station = tcpip_sta_list.sta[i];
-
-            struct sockaddr_in new_client_addr;
-            new_client_addr.sin_family = PF_INET;
-            new_client_addr.sin_port = htons(APP_PORT_PROXY_UDP);
-            new_client_addr.sin_len = 16;
-            char ip[100];
-            sprintf(ip, IPSTR, IP2STR(&station.ip));
-            inet_pton(AF_INET, ip, &new_client_addr.sin_addr);
-            ESP_LOGD(TAG, "%i %s " IPSTR " " MACSTR "", tcpip_sta_list.num, ip4addr_ntoa(&(station.ip)),
-                    IP2STR(&station.ip), MAC2STR(station.mac));
-            if (ip[0] != '0')  // DHCP bug. Assigns 0.0.0.0 to station when directly connected on startup
-                add_udp_to_known_clients(connections, new_client_addr, true);
+        if (free_slot != NULL) {
+            memcpy(free_slot->mac, stations[i].mac, 6);
+            free_slot->ip_addr = ip_addr;
+        }
+        break;
+    }
+    post_station_event(STATION_IP_ASSIGNED, ip_addr);
+}
+
+/**
+ * Called by the Wi-Fi event handler when a station left the local AP
+ *
+ * @param mac MAC address of the station
+ */
+void db_station_disconnected(const uint8_t mac[6]) {
+    for (int i = 0; i < MAX_AP_STATIONS; i++) {
+        if (ap_stations[i].ip_addr != 0 && memcmp(ap_stations[i].mac, mac, 6) == 0) {
+            post_station_event(STATION_DISCONNECTED, ap_stations[i].ip_addr);
+            ap_stations[i].ip_addr = 0;
+            return;
+        }
+    }
+    post_station_event(STATION_RESYNC, 0);
+}
+
+/**
+ * UART reader/parser task. Reads & parses everything the FC sends and hands complete packets to the network task via
+ * the downlink ring. Never touches a socket so it can not be stalled by Wi-Fi.
+ */
+void control_module_uart() {
+    uint read_transparent = 0;
+    uint8_t serial_buffer[MAX(TRANSPARENT_BUF_SIZE, MAVLINK_DATAGRAM_BUDGET)];
+    msp_ltm_port_t db_msp_ltm_port;
+    memset(&db_msp_ltm_port, 0, sizeof(db_msp_ltm_port));
+    db_packer_init(&msp_ltm_packer);
+    mavlink_port_t db_mavlink_port;
+    init_mavlink_port(&db_mavlink_port);
+
+    ESP_LOGI(TAG, "Started UART reader on core %i", xPortGetCoreID());
+    int64_t next_flush = UDP_BRDC_UPDATE_INTERVAL_US;
+    while (1) {
+        size_t available = wait_for_uart(next_flush);  // wake up on new data or when a pending packet must be flushed
+        switch (SERIAL_PROTOCOL) {
+            case 1:
+            case 2:
+                parse_msp_ltm(&db_msp_ltm_port, available);
+                break;
+            case 3:
+                parse_mavlink(serial_buffer, &read_transparent, &db_mavlink_port, available);
+                break;
+            default:
+            case 4:
+            case 5:
+                parse_transparent(serial_buffer, &read_transparent, available);
+                break;
+        }
+        next_flush = flush_expired_packets(serial_buffer, &read_transparent);
+    }
+    vTaskDelete(NULL);
+}
+
+/**
+ * Uplink writer task. The only task writing to the UART. Writes the frames queued by the network task one at a time,
+ * highest priority class first, so a control frame only waits for the frame currently being written. Sends the
+ * requests of the MSP poller in between.
+ */
+void control_module_uplink() {
+    ESP_LOGI(TAG, "Started uplink writer on core %i", xPortGetCoreID());
+    while (1) {
+        uint8_t *frame;
+        uint16_t frame_length;
+        uint8_t priority_class;
+        while (db_uplink_peek(&frame, &frame_length, &priority_class)) {
+            write_to_uart(frame, frame_length);
+            db_uplink_pop(priority_class);
+            // network task stopped reading clients - see uplink_read_budget()
+            if (__atomic_exchange_n(&uplink_stalled, 0, __ATOMIC_ACQ_REL)) wakeup_network_task();
+            if (msp_cache_enabled()) poll_msp_commands();
+        }
+        TickType_t wait_ticks = portMAX_DELAY;
+        if (msp_cache_enabled()) {
+            int64_t next_poll = poll_msp_commands();
+            wait_ticks = (next_poll + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000);
         }
+        xSemaphoreTake(uplink_semaphore, wait_ticks);
     }
+    vTaskDelete(NULL);
 }
 
+/**
+ * Network task. Handles TCP & UDP clients, queues their data for the uplink writer task and sends the packets queued by
+ * the UART reader task to all clients.
+ */
 void control_module_tcp() {
-    int uart_socket = open_serial_socket();
     int tcp_master_socket = open_tcp_server(app_port_proxy);
 
-    struct db_udp_connection_t udp_conn;
+    // client tables are too big for the task stack
+    static struct db_udp_connection_t udp_conn;
     udp_conn.udp_socket = open_udp_socket();
     fcntl(udp_conn.udp_socket, F_SETFL, O_NONBLOCK);
     char udp_buffer[UDP_BUF_SIZE];
+    uint8_t msp_reply[MSP_REPLY_BUF_SIZE];
+    db_uplink_parser_t udp_uplink_parser;
     struct sockaddr_in udp_source_addr;
     socklen_t udp_socklen = sizeof(udp_source_addr);
-    for (int i = 0; i < MAX_UDP_CLIENTS; i++)
-        memset(&(udp_conn.udp_clients[i]), 0, sizeof(struct sockaddr_in));
+    db_udp_clients_init(&udp_conn.clients);
 
-    int tcp_clients[CONFIG_LWIP_MAX_ACTIVE_TCP];
-    for (int i = 0; i < CONFIG_LWIP_MAX_ACTIVE_TCP; i++) {
-        tcp_clients[i] = -1;
-    }
-    if (tcp_master_socket == ESP_FAIL || uart_socket == ESP_FAIL) {
+    static db_tcp_client_t tcp_clients[CONFIG_LWIP_MAX_ACTIVE_TCP];
+    init_tcp_clients(tcp_clients);
+    if (tcp_master_socket == ESP_FAIL) {
         ESP_LOGE(TAG, "Can not start control module");
+        vTaskDelete(NULL);
+        return;
     }
     fcntl(tcp_master_socket, F_SETFL, O_NONBLOCK);
-    uint read_transparent = 0;
-    uint read_msp_ltm = 0;
     char tcp_client_buffer[TCP_BUFF_SIZ];
     memset(tcp_client_buffer, 0, TCP_BUFF_SIZ);
-    uint8_t msp_message_buffer[UART_BUF_SIZE];
-    uint8_t serial_buffer[TRANSPARENT_BUF_SIZE];
-    msp_ltm_port_t db_msp_ltm_port;
 
-    int64_t last_udp_brdc_update = esp_timer_get_time();  // time since boot for UDP broadcast update
-    wifi_mode_t wifi_mode;
-    esp_wifi_get_mode(&wifi_mode);
+    int64_t last_udp_expiry = db_time_us();  // time since boot of the last check for idle UDP clients
+    bool ap_mode = db_wifi_is_ap();
+    if (ap_mode) add_connected_stations(&udp_conn);  // stations that connected before we started
+    memset(&udp_conn.group_addr, 0, sizeof(udp_conn.group_addr));
+    if (UDP_DOWNLINK_MODE == UDP_DOWNLINK_BROADCAST) {
+        int broadcast = 1;
+        setsockopt(udp_conn.udp_socket, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+    } else if (UDP_DOWNLINK_MODE == UDP_DOWNLINK_MULTICAST) {
+        uint8_t ttl = 1;  // clients are on the local network
+        setsockopt(udp_conn.udp_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    }
+    if (UDP_DOWNLINK_MODE != UDP_DOWNLINK_UNICAST) update_udp_group_addr(&udp_conn, ap_mode);
 
-    ESP_LOGI(TAG, "Started control module");
+    ESP_LOGI(TAG, "Started control module on core %i", xPortGetCoreID());
+    fd_set read_fds;
+    fd_set write_fds;
+    struct timeval select_timeout;
     while (1) {
-        handle_tcp_master(tcp_master_socket, tcp_clients);
-        for (int i = 0; i < CONFIG_LWIP_MAX_ACTIVE_TCP; i++) {  // handle TCP clients
-            if (tcp_clients[i] > 0) {
-                ssize_t recv_length = recv(tcp_clients[i], tcp_client_buffer, TCP_BUFF_SIZ, 0);
-                if (recv_length > 0) {
-                    ESP_LOGD(TAG, "TCP: Received %i bytes", recv_length);
-                    write_to_uart(tcp_client_buffer, recv_length);
-                } else if (recv_length == 0) {
-                    shutdown(tcp_clients[i], 0);
-                    close(tcp_clients[i]);
-                    tcp_clients[i] = -1;
-                    ESP_LOGI(TAG, "TCP client disconnected");
-                } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                    ESP_LOGE(TAG, "Error receiving from TCP client %i (fd: %i): %d", i, tcp_clients[i], errno);
-                    shutdown(tcp_clients[i], 0);
-                    close(tcp_clients[i]);
-                    tcp_clients[i] = -1;
-                }
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        FD_SET(wakeup_rx_socket, &read_fds);
+        FD_SET(tcp_master_socket, &read_fds);
+        // client data waits in the socket buffers while the uplink queues are full. Writer task wakes us up
+        bool read_clients = uplink_read_budget() > 0;
+        if (read_clients) FD_SET(udp_conn.udp_socket, &read_fds);
+        int max_fd = MAX(wakeup_rx_socket, MAX(tcp_master_socket, udp_conn.udp_socket));
+        for (int i = 0; i < CONFIG_LWIP_MAX_ACTIVE_TCP; i++) {
+            if (tcp_clients[i].socket >= 0) {
+                if (read_clients) FD_SET(tcp_clients[i].socket, &read_fds);
+                // only wait for writable sockets if there is something queued - else select returns right away
+                if (tcp_client_has_pending(&tcp_clients[i])) FD_SET(tcp_clients[i].socket, &write_fds);
+                max_fd = MAX(max_fd, tcp_clients[i].socket);
             }
         }
-        // handle incoming UDP data
-        ssize_t recv_length = recvfrom(udp_conn.udp_socket, udp_buffer, UDP_BUF_SIZE, 0,
-                                       (struct sockaddr *) &udp_source_addr, &udp_socklen);
-        if (recv_length > 0) {
-            ESP_LOGD(TAG, "UDP: Received %i bytes", recv_length);
-            write_to_uart(udp_buffer, recv_length);
-            add_udp_to_known_clients(&udp_conn, udp_source_addr, false);
+        // wake up at least once per UDP client expiry interval even if there is no traffic at all
+        select_timeout.tv_sec = UDP_BRDC_UPDATE_INTERVAL_US / 1000000;
+        select_timeout.tv_usec = UDP_BRDC_UPDATE_INTERVAL_US % 1000000;
+        int num_ready = select(max_fd + 1, &read_fds, &write_fds, NULL, &select_timeout);
+        if (num_ready < 0) {
+            ESP_LOGE(TAG, "Error during select: %d", errno);
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+            continue;
         }
-        update_udp_broadcast(&last_udp_brdc_update, &udp_conn, &wifi_mode);
-        switch (SERIAL_PROTOCOL) {
-            case 1:
-            case 2:
-                parse_msp_ltm(tcp_clients, &udp_conn, msp_message_buffer, &read_msp_ltm, &db_msp_ltm_port);
-                break;
-            default:
-            case 3:
-            case 4:
-            case 5:
-                parse_transparent(tcp_clients, &udp_conn, serial_buffer, &read_transparent);
-                break;
+        if (num_ready > 0) {
+            if (FD_ISSET(tcp_master_socket, &read_fds)) handle_tcp_master(tcp_master_socket, tcp_clients);
+            for (int i = 0; i < CONFIG_LWIP_MAX_ACTIVE_TCP; i++) {  // handle TCP clients
+                if (tcp_clients[i].socket >= 0 && FD_ISSET(tcp_clients[i].socket, &read_fds)) {
+                    handle_tcp_client(tcp_clients, &udp_conn, i, tcp_client_buffer);
+                }
+                if (tcp_clients[i].socket >= 0 && FD_ISSET(tcp_clients[i].socket, &write_fds)) {
+                    flush_tcp_client(&tcp_clients[i]);
+                }
+            }
+            if (FD_ISSET(udp_conn.udp_socket, &read_fds)) {
+                // handle incoming UDP data - drain all queued datagrams
+                ssize_t recv_length;
+                while (uplink_read_budget() > 0 &&
+                       (recv_length = recvfrom(udp_conn.udp_socket, udp_buffer, UDP_BUF_SIZE, 0,
+                                               (struct sockaddr *) &udp_source_addr, &udp_socklen)) > 0) {
+                    ESP_LOGD(TAG, "UDP: Received %i bytes", recv_length);
+                    db_metrics.uplink_packets++;
+                    db_metrics.uplink_bytes += recv_length;
+                    init_uplink_parser(&udp_uplink_parser);  // datagrams contain complete frames
+                    uint16_t reply_length = handle_uplink(tcp_clients, &udp_conn, &udp_uplink_parser,
+                                                          (const uint8_t *) udp_buffer, recv_length, msp_reply,
+                                                          MSP_REPLY_BUF_SIZE, -1, &udp_source_addr);
+                    if (reply_length > 0) {
+                        sendto(udp_conn.udp_socket, msp_reply, reply_length, 0, (struct sockaddr *) &udp_source_addr,
+                               udp_socklen);
+                    }
+                    db_udp_client_t *client = add_udp_to_known_clients(&udp_conn, udp_source_addr, false);
+                    if (client != NULL) client->rx_bytes += recv_length;
+                    udp_socklen = sizeof(udp_source_addr);
+                }
+            }
+            if (FD_ISSET(wakeup_rx_socket, &read_fds)) send_queued_packets(tcp_clients, &udp_conn);
         }
+        handle_station_events(&udp_conn);
+        update_tcp_profiles(tcp_clients);
+        update_udp_clients(&last_udp_expiry, &udp_conn, ap_mode);
+        db_metrics_update(tcp_clients, &udp_conn.clients, &downlink_ring, db_time_us());
     }
     vTaskDelete(NULL);
 }
@@ -360,10 +1285,32 @@ void control_module_tcp() {
 /**
  * @brief DroneBridge control module implementation for a ESP32 device. Bi-directional link between FC and ground. Can
  * handle MSPv1, MSPv2, LTM and MAVLink.
- * MSP & LTM is parsed and sent packet/frame by frame to ground
- * MAVLink is passed through (fully transparent). Can be used with any protocol.
+ * MSP & LTM is parsed and complete frames are packed into packets of up to MSP_LTM_PACKET_SIZE
+ * MAVLink is parsed and only complete & valid frames are packed into packets
+ * Transparent is passed through as is. Can be used with any protocol.
+ * UART reading/parsing and network I/O run in separate tasks pinned to DB_UART_TASK_CORE & DB_NET_TASK_CORE. They are
+ * connected by a lock-free single producer/single consumer ring (downlink_ring). Client data goes the other way through
+ * the priority queues of db_uplink.h to the uplink writer task.
  */
 void control_module() {
     xEventGroupWaitBits(wifi_event_group, BIT2, false, true, portMAX_DELAY);
-    xTaskCreate(&control_module_tcp, "control_tcp", 40960, NULL, 5, NULL);
+    uplink_semaphore = xSemaphoreCreateBinary();
+    if (open_serial_socket() == ESP_FAIL || open_wakeup_sockets() == ESP_FAIL ||
+        !db_frame_ring_init(&downlink_ring, DOWNLINK_RING_SIZE) || !db_uplink_init() || uplink_semaphore == NULL) {
+        ESP_LOGE(TAG, "Can not start control module");
+        return;
+    }
+    station_event_queue = xQueueCreate(STATION_EVENT_QUEUE_SIZE, sizeof(db_station_event_t));
+    if (SERIAL_PROTOCOL == 1 || SERIAL_PROTOCOL == 2) {
+        msp_cache_init(MSP_POLL_LIST);
+        msp_router_init();
+    } else if (SERIAL_PROTOCOL == 3) {
+        mavlink_router_init();
+    }
+#ifdef DB_BENCHMARK
+    db_bench_start();
+#endif
+    db_task_create(&control_module_uart, "control_uart", 10240, DB_UART_TASK_PRIO, DB_UART_TASK_CORE);
+    db_task_create(&control_module_tcp, "control_tcp", 16384, DB_NET_TASK_PRIO, DB_NET_TASK_CORE);
+    db_task_create(&control_module_uplink, "control_uplink", 4096, DB_UPLINK_TASK_PRIO, DB_UPLINK_TASK_CORE);
 }
\ No newline at end of file
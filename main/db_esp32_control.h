@@ -20,6 +20,10 @@
 #ifndef DB_ESP32_DB_ESP32_CONTROL_H
 #define DB_ESP32_DB_ESP32_CONTROL_H
 
+#include <stdint.h>
+
 void control_module();
+void db_station_ip_assigned(uint32_t ip_addr);
+void db_station_disconnected(const uint8_t mac[6]);
 
 #endif //DB_ESP32_DB_ESP32_CONTROL_H
@@ -0,0 +1,123 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#include <string.h>
+#include <driver/gpio.h>
+#include "esp_log.h"
+#include "globals.h"
+#include "db_platform.h"
+#include "db_esp32_settings.h"
+#include "msp_ltm_serial.h"
+
+#define TAG "DB_SETTINGS"
+
+uint8_t DEFAULT_SSID[32] = "DroneBridge ESP32";
+uint8_t DEFAULT_PWD[64] = "dronebridge";
+uint8_t DEFAULT_CHANNEL = 6;
+uint8_t SERIAL_PROTOCOL = 2;  // 1,2=MSP, 3=MAVLink, 4,5=transparent
+uint8_t DB_UART_PIN_TX = GPIO_NUM_17;
+uint8_t DB_UART_PIN_RX = GPIO_NUM_16;
+uint32_t DB_UART_BAUD_RATE = 115200;
+uint32_t DB_UART_RX_BUF_SIZE = 1024;
+uint32_t DB_UART_TX_BUF_SIZE = 0;
+uint8_t DB_UART_RX_THRESH = 120;
+uint8_t DB_UART_RX_TIMEOUT = 10;
+uint16_t TRANSPARENT_BUF_SIZE = 64;
+uint16_t MSP_LTM_PACKET_SIZE = 0;
+char MSP_POLL_LIST[64] = "";
+uint32_t SERIAL_HOLD_TIME_US = 10000;
+uint8_t UDP_DOWNLINK_MODE = UDP_DOWNLINK_UNICAST;
+char UDP_MULTICAST_GROUP[16] = "239.255.145.50";
+
+/**
+ * Stores all settings. Called on first start and when the user saved new settings
+ */
+void write_settings_to_nvs() {
+    ESP_LOGI(TAG, "Saving to NVS");
+    db_kv_t my_handle;
+    ESP_ERROR_CHECK(db_kv_open(true, &my_handle));
+    ESP_ERROR_CHECK(db_kv_set_str(my_handle, "ssid", (char *) DEFAULT_SSID));
+    ESP_ERROR_CHECK(db_kv_set_str(my_handle, "wifi_pass", (char *) DEFAULT_PWD));
+    ESP_ERROR_CHECK(db_kv_set_u8(my_handle, "wifi_chan", DEFAULT_CHANNEL));
+    ESP_ERROR_CHECK(db_kv_set_u32(my_handle, "baud", DB_UART_BAUD_RATE));
+    ESP_ERROR_CHECK(db_kv_set_u8(my_handle, "gpio_tx", DB_UART_PIN_TX));
+    ESP_ERROR_CHECK(db_kv_set_u8(my_handle, "gpio_rx", DB_UART_PIN_RX));
+    ESP_ERROR_CHECK(db_kv_set_u8(my_handle, "proto", SERIAL_PROTOCOL));
+    ESP_ERROR_CHECK(db_kv_set_u16(my_handle, "trans_pack_size", TRANSPARENT_BUF_SIZE));
+    ESP_ERROR_CHECK(db_kv_set_u32(my_handle, "hold_time_us", SERIAL_HOLD_TIME_US));
+    ESP_ERROR_CHECK(db_kv_set_u16(my_handle, "msp_ltm_size", MSP_LTM_PACKET_SIZE));
+    ESP_ERROR_CHECK(db_kv_set_str(my_handle, "msp_poll", MSP_POLL_LIST));
+    ESP_ERROR_CHECK(db_kv_set_u8(my_handle, "udp_mode", UDP_DOWNLINK_MODE));
+    ESP_ERROR_CHECK(db_kv_set_str(my_handle, "mcast_group", UDP_MULTICAST_GROUP));
+    ESP_ERROR_CHECK(db_kv_set_u32(my_handle, "uart_rx_buf", DB_UART_RX_BUF_SIZE));
+    ESP_ERROR_CHECK(db_kv_set_u32(my_handle, "uart_tx_buf", DB_UART_TX_BUF_SIZE));
+    ESP_ERROR_CHECK(db_kv_set_u8(my_handle, "uart_rx_thresh", DB_UART_RX_THRESH));
+    ESP_ERROR_CHECK(db_kv_set_u8(my_handle, "uart_rx_tout", DB_UART_RX_TIMEOUT));
+    ESP_ERROR_CHECK(db_kv_commit(my_handle));
+    db_kv_close(my_handle);
+}
+
+/**
+ * Settings stored before MSP/LTM packing have the number of LTM frames per packet (1-5) instead of the packet size.
+ * One frame per packet stays 0, else the packet gets room for that many of the largest LTM frames. Stored under the new
+ * key the next time the settings are saved
+ */
+static void migrate_ltm_per_packet(db_kv_t kv) {
+    uint8_t ltm_per_packet;
+    if (db_kv_get_u8(kv, "ltm_per_packet", &ltm_per_packet) != DB_KV_OK) return;
+    MSP_LTM_PACKET_SIZE = ltm_per_packet > 1 ? ltm_per_packet * LTM_MAX_FRAME_SIZE : 0;
+    ESP_LOGI(TAG, "Migrated ltm_per_packet %i to msp_ltm_size %i", ltm_per_packet, MSP_LTM_PACKET_SIZE);
+}
+
+/**
+ * Loads the stored settings. Stores the defaults on first start. Settings added in later versions keep their default
+ * until the user saves the settings for the first time
+ */
+void read_settings_nvs() {
+    db_kv_t my_handle;
+    int err = db_kv_open(false, &my_handle);
+    if (err == DB_KV_NOT_FOUND) {
+        // First start
+        write_settings_to_nvs();
+        return;
+    }
+    ESP_ERROR_CHECK(err);
+    ESP_LOGI(TAG, "Reading settings from NVS");
+    ESP_ERROR_CHECK(db_kv_get_str(my_handle, "ssid", (char *) DEFAULT_SSID, sizeof(DEFAULT_SSID)));
+    ESP_ERROR_CHECK(db_kv_get_str(my_handle, "wifi_pass", (char *) DEFAULT_PWD, sizeof(DEFAULT_PWD)));
+    ESP_ERROR_CHECK(db_kv_get_u8(my_handle, "wifi_chan", &DEFAULT_CHANNEL));
+    ESP_ERROR_CHECK(db_kv_get_u32(my_handle, "baud", &DB_UART_BAUD_RATE));
+    ESP_ERROR_CHECK(db_kv_get_u8(my_handle, "gpio_tx", &DB_UART_PIN_TX));
+    ESP_ERROR_CHECK(db_kv_get_u8(my_handle, "gpio_rx", &DB_UART_PIN_RX));
+    ESP_ERROR_CHECK(db_kv_get_u8(my_handle, "proto", &SERIAL_PROTOCOL));
+    ESP_ERROR_CHECK(db_kv_get_u16(my_handle, "trans_pack_size", &TRANSPARENT_BUF_SIZE));
+    // added in later versions. Keep the default if not yet stored
+    db_kv_get_u32(my_handle, "hold_time_us", &SERIAL_HOLD_TIME_US);
+    if (db_kv_get_u16(my_handle, "msp_ltm_size", &MSP_LTM_PACKET_SIZE) != DB_KV_OK) migrate_ltm_per_packet(my_handle);
+    if (db_kv_get_str(my_handle, "msp_poll", MSP_POLL_LIST, sizeof(MSP_POLL_LIST)) != DB_KV_OK)
+        MSP_POLL_LIST[0] = '\0';
+    db_kv_get_u8(my_handle, "udp_mode", &UDP_DOWNLINK_MODE);
+    db_kv_get_str(my_handle, "mcast_group", UDP_MULTICAST_GROUP, sizeof(UDP_MULTICAST_GROUP));
+    db_kv_get_u32(my_handle, "uart_rx_buf", &DB_UART_RX_BUF_SIZE);
+    db_kv_get_u32(my_handle, "uart_tx_buf", &DB_UART_TX_BUF_SIZE);
+    db_kv_get_u8(my_handle, "uart_rx_thresh", &DB_UART_RX_THRESH);
+    db_kv_get_u8(my_handle, "uart_rx_tout", &DB_UART_RX_TIMEOUT);
+    db_kv_close(my_handle);
+}
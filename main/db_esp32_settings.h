@@ -20,4 +20,7 @@
 #ifndef DB_ESP32_DB_ESP32_SETTINGS_H
 #define DB_ESP32_DB_ESP32_SETTINGS_H
 
+void read_settings_nvs();
+void write_settings_to_nvs();
+
 #endif //DB_ESP32_DB_ESP32_SETTINGS_H
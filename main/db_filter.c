@@ -0,0 +1,198 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+#include "db_filter.h"
+#include "msp_ltm_serial.h"
+#include "mavlink_serial.h"
+
+#define TAG "DB_FILTER"
+
+// Set by the comm task, applied by the network task
+static db_client_filter_t client_filters[DB_FILTER_MAX_CLIENTS];
+static int active_filters = 0;
+static uint32_t filter_generation = 0;
+static portMUX_TYPE filter_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Sets the message types a client wants to receive. Replaces the previous filter of that client
+ *
+ * @param ip_addr IPv4 address of the client in network byte order
+ * @param rules Message types to pass on. Everything else is not sent to the client
+ * @param rule_count Number of rules. 0 removes the filter - client gets all messages again
+ * @return false if there is no space for another filtered client
+ */
+bool db_filter_set(uint32_t ip_addr, const db_filter_rule_t rules[], uint8_t rule_count) {
+    if (rule_count > DB_FILTER_MAX_RULES) rule_count = DB_FILTER_MAX_RULES;
+    bool success = true;
+    portENTER_CRITICAL(&filter_lock);
+    db_client_filter_t *filter = NULL;
+    db_client_filter_t *unused = NULL;
+    for (int i = 0; i < DB_FILTER_MAX_CLIENTS; i++) {
+        if (client_filters[i].used && client_filters[i].ip_addr == ip_addr) filter = &client_filters[i];
+        else if (!client_filters[i].used && unused == NULL) unused = &client_filters[i];
+    }
+    if (rule_count == 0) {
+        if (filter != NULL) {
+            filter->used = false;
+            active_filters--;
+        }
+    } else {
+        if (filter == NULL && unused != NULL) {
+            filter = unused;
+            active_filters++;
+        }
+        if (filter != NULL) {
+            memset(filter, 0, sizeof(db_client_filter_t));
+            filter->used = true;
+            filter->ip_addr = ip_addr;
+            filter->generation = ++filter_generation;
+            filter->rule_count = rule_count;
+            memcpy(filter->rules, rules, rule_count * sizeof(db_filter_rule_t));
+        } else {
+            success = false;
+        }
+    }
+    portEXIT_CRITICAL(&filter_lock);
+    return success;
+}
+
+/**
+ * @return true if at least one client registered a filter
+ */
+bool db_filter_active() {
+    return active_filters > 0;
+}
+
+/**
+ * Identifies the frame at the start of data. Downlink packets only contain complete frames as emitted by the parsers
+ *
+ * @return Length of the frame. 0 if it is not a known frame or incomplete
+ */
+static uint16_t identify_frame(const uint8_t *data, uint16_t length, db_filter_protocol_e *protocol,
+                               uint32_t *msg_id) {
+    uint16_t frame_length = 0;
+    if (length >= 6 && data[0] == MAVLINK_STX_V1) {
+        *protocol = DB_FILTER_MAVLINK;
+        *msg_id = data[5];
+        frame_length = MAVLINK_HEADER_LEN_V1 + data[1] + MAVLINK_CHECKSUM_LEN;
+    } else if (length >= 10 && data[0] == MAVLINK_STX_V2) {
+        *protocol = DB_FILTER_MAVLINK;
+        *msg_id = data[7] | (data[8] << 8) | ((uint32_t) data[9] << 16);
+        frame_length = MAVLINK_HEADER_LEN_V2 + data[1] + MAVLINK_CHECKSUM_LEN +
+                       ((data[2] & MAVLINK_IFLAG_SIGNED) ? MAVLINK_SIGNATURE_LEN : 0);
+    } else if (length >= 3 && data[0] == '$' && data[1] == 'T') {
+        *protocol = DB_FILTER_LTM;
+        *msg_id = data[2];
+        switch (data[2]) {
+            case 'A': case 'N': case 'X': frame_length = 4 + LTM_TYPE_A_PAYLOAD_SIZE; break;
+            case 'G': case 'O': frame_length = 4 + LTM_TYPE_G_PAYLOAD_SIZE; break;
+            case 'S': frame_length = 4 + LTM_TYPE_S_PAYLOAD_SIZE; break;
+            default: break;
+        }
+    } else if (length >= 6 && data[0] == '$' && data[1] == 'M') {
+        *protocol = DB_FILTER_MSP;
+        *msg_id = data[4];
+        if (data[4] == MSP_V2_FRAME_ID && length >= 8) *msg_id = data[6] | (data[7] << 8);
+        frame_length = 6 + data[3];
+    } else if (length >= 9 && data[0] == '$' && data[1] == 'X') {
+        *protocol = DB_FILTER_MSP;
+        *msg_id = data[4] | (data[5] << 8);
+        frame_length = 9 + (data[6] | (data[7] << 8));
+    }
+    return (frame_length <= length) ? frame_length : 0;
+}
+
+/**
+ * Checks the filter rules for one frame & updates the rate limit of the connection
+ *
+ * @return true if the frame must be sent to the client
+ */
+static bool frame_passes(const db_client_filter_t *filter, db_filter_state_t *state, db_filter_protocol_e protocol,
+                         uint32_t msg_id, int64_t now) {
+    for (int i = 0; i < filter->rule_count; i++) {
+        const db_filter_rule_t *rule = &filter->rules[i];
+        if (rule->protocol != protocol || rule->msg_id != msg_id) continue;
+        if (rule->min_interval_us > 0 && state->last_sent[i] != 0 && now - state->last_sent[i] < rule->min_interval_us)
+            return false;
+        state->last_sent[i] = now;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Removes all frames a client did not subscribe to from a downlink packet. Bytes that are not a known frame (e.g.
+ * transparent mode) are always passed on.
+ *
+ * @param ip_addr IPv4 address of the client in network byte order
+ * @param state Rate limit state of the connection the packet is sent to
+ * @param data Downlink packet
+ * @param length Length of the packet
+ * @param out Buffer for the filtered packet
+ * @param out_size Size of out. Packets that do not fit are passed on unfiltered
+ * @param now Current time in us
+ * @return -1 if client has no filter - send data as it is. Else length of the filtered packet in out (may be 0)
+ */
+int db_filter_apply(uint32_t ip_addr, db_filter_state_t *state, const uint8_t *data, uint16_t length, uint8_t *out,
+                    uint16_t out_size, int64_t now) {
+    if (length > out_size) return -1;
+    // copy of the rules - parsing the packet must not happen with interrupts disabled
+    db_client_filter_t filter;
+    filter.used = false;
+    portENTER_CRITICAL(&filter_lock);
+    for (int i = 0; i < DB_FILTER_MAX_CLIENTS; i++) {
+        if (client_filters[i].used && client_filters[i].ip_addr == ip_addr) {
+            filter.used = true;
+            filter.generation = client_filters[i].generation;
+            filter.rule_count = client_filters[i].rule_count;
+            memcpy(filter.rules, client_filters[i].rules, filter.rule_count * sizeof(db_filter_rule_t));
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&filter_lock);
+    if (!filter.used) return -1;
+    if (state->generation != filter.generation) {
+        memset(state->last_sent, 0, sizeof(state->last_sent));
+        state->generation = filter.generation;
+    }
+    int out_length = 0;
+    uint16_t pos = 0;
+    while (pos < length) {
+        db_filter_protocol_e protocol;
+        uint32_t msg_id;
+        uint16_t frame_length = identify_frame(&data[pos], length - pos, &protocol, &msg_id);
+        if (frame_length == 0) {  // unknown data - pass on the rest
+            memcpy(&out[out_length], &data[pos], length - pos);
+            out_length += length - pos;
+            break;
+        }
+        if (frame_passes(&filter, state, protocol, msg_id, now)) {
+            memcpy(&out[out_length], &data[pos], frame_length);
+            out_length += frame_length;
+            state->passed_frames++;
+        } else {
+            state->filtered_frames++;
+        }
+        pos += frame_length;
+    }
+    return out_length;
+}
@@ -0,0 +1,69 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#ifndef DB_ESP32_DB_FILTER_H
+#define DB_ESP32_DB_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DB_FILTER_MAX_CLIENTS 8     // max. number of client IPs with a filter
+#define DB_FILTER_MAX_RULES 16      // max. number of message types per client
+#define DB_FILTER_MAX_RATE_HZ 100
+
+typedef enum {
+    DB_FILTER_MSP,
+    DB_FILTER_LTM,
+    DB_FILTER_MAVLINK
+} db_filter_protocol_e;
+
+/**
+ * Message type a client subscribed to
+ */
+typedef struct {
+    db_filter_protocol_e protocol;
+    uint32_t msg_id;            // MSP command, LTM frame type ('G', 'A', ...) or MAVLink message ID
+    uint32_t min_interval_us;   // 0 = every message is passed on
+} db_filter_rule_t;
+
+typedef struct {
+    bool used;
+    uint32_t ip_addr;           // network byte order. Filter applies to all TCP & UDP clients with this address
+    uint32_t generation;        // changes with every update of the filter
+    uint8_t rule_count;
+    db_filter_rule_t rules[DB_FILTER_MAX_RULES];
+} db_client_filter_t;
+
+/**
+ * Rate limit state of one TCP connection or UDP client. Zero when the connection is set up. Only used by the
+ * network task
+ */
+typedef struct {
+    uint32_t generation;                    // filter the state belongs to. Reset when the filter changes
+    int64_t last_sent[DB_FILTER_MAX_RULES]; // per rule
+    uint32_t passed_frames;                 // statistics
+    uint32_t filtered_frames;
+} db_filter_state_t;
+
+bool db_filter_set(uint32_t ip_addr, const db_filter_rule_t rules[], uint8_t rule_count);
+bool db_filter_active();
+int db_filter_apply(uint32_t ip_addr, db_filter_state_t *state, const uint8_t *data, uint16_t length, uint8_t *out,
+                    uint16_t out_size, int64_t now);
+
+#endif //DB_ESP32_DB_FILTER_H
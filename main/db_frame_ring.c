@@ -0,0 +1,132 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "db_frame_ring.h"
+
+#define RING_HEADER_SIZE (4 + sizeof(db_frame_stamp_t))  // length (low 16 bit) & tag as uint32, then the stamp
+#define RING_WRAP_MARKER 0xFFFFFFFF     // rest of the buffer is unused. Next frame starts at index 0
+#define RING_ALIGN(x) (((x) + 3) & ~3U) // keep headers 4 byte aligned
+
+/**
+ * @param ring Ring to initialize
+ * @param size Size of the ring buffer in bytes. Must be a power of two
+ * @return true on success, false if memory could not be allocated or size is invalid
+ */
+bool db_frame_ring_init(db_frame_ring_t *ring, uint32_t size) {
+    memset(ring, 0, sizeof(db_frame_ring_t));
+    if (size < RING_HEADER_SIZE || (size & (size - 1)) != 0) return false;
+    ring->buffer = malloc(size);
+    if (ring->buffer == NULL) return false;
+    ring->size = size;
+    return true;
+}
+
+/**
+ * @return Number of bytes currently used by frames (incl. headers and padding)
+ */
+uint32_t db_frame_ring_used(db_frame_ring_t *ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @return Largest frame db_frame_ring_push() accepts right now. Must only be called by the producer
+ */
+uint16_t db_frame_ring_room(db_frame_ring_t *ring) {
+    uint32_t head = ring->head;
+    uint32_t free_space = ring->size - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+    uint32_t contiguous = ring->size - (head & (ring->size - 1));
+    // a frame either fits in front of the end of the buffer or starts at index 0 after the wrap marker
+    uint32_t space = MAX(MIN(contiguous, free_space), (free_space > contiguous) ? free_space - contiguous : 0) & ~3U;
+    if (space <= RING_HEADER_SIZE) return 0;
+    return (uint16_t) MIN(space - RING_HEADER_SIZE, UINT16_MAX);
+}
+
+/**
+ * Copy a frame into the ring. Must only be called by the producer.
+ *
+ * @param tag Passed on to the consumer with the frame. Tells it what kind of frame it is
+ * @param stamp Passed on to the consumer with the frame
+ * @return true if frame was added, false if there was not enough space. The frame is dropped and counted
+ */
+bool db_frame_ring_push(db_frame_ring_t *ring, const uint8_t *data, uint16_t length, uint8_t tag,
+                        const db_frame_stamp_t *stamp) {
+    uint32_t head = ring->head;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t free_space = ring->size - (head - tail);
+    uint32_t pos = head & (ring->size - 1);
+    uint32_t contiguous = ring->size - pos;
+    uint32_t needed = RING_ALIGN(RING_HEADER_SIZE + length);
+    uint32_t skip = (needed > contiguous) ? contiguous : 0;  // frame must not wrap around
+    if (needed + skip > free_space) {
+        ring->dropped_frames++;
+        ring->dropped_bytes += length;
+        return false;
+    }
+    if (skip) {
+        *(uint32_t *) &ring->buffer[pos] = RING_WRAP_MARKER;
+        pos = 0;
+    }
+    *(uint32_t *) &ring->buffer[pos] = length | ((uint32_t) tag << 16);
+    memcpy(&ring->buffer[pos + 4], stamp, sizeof(db_frame_stamp_t));
+    memcpy(&ring->buffer[pos + RING_HEADER_SIZE], data, length);
+    __atomic_store_n(&ring->head, head + skip + needed, __ATOMIC_RELEASE);
+    if ((head + skip + needed - tail) > ring->high_water_mark) ring->high_water_mark = head + skip + needed - tail;
+    return true;
+}
+
+/**
+ * Get the oldest frame without removing it. Must only be called by the consumer.
+ *
+ * @param data Set to the start of the frame inside the ring
+ * @param length Set to the length of the frame
+ * @param tag Set to the tag the frame was pushed with
+ * @param stamp Set to the stamp the frame was pushed with
+ * @return true if there is a frame, false if ring is empty
+ */
+bool db_frame_ring_peek(db_frame_ring_t *ring, uint8_t **data, uint16_t *length, uint8_t *tag,
+                        db_frame_stamp_t *stamp) {
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (tail == head) return false;
+    uint32_t pos = tail & (ring->size - 1);
+    if (*(uint32_t *) &ring->buffer[pos] == RING_WRAP_MARKER) {
+        tail += ring->size - pos;
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+        pos = 0;
+    }
+    uint32_t header = *(uint32_t *) &ring->buffer[pos];
+    *length = (uint16_t) header;
+    *tag = (uint8_t) (header >> 16);
+    memcpy(stamp, &ring->buffer[pos + 4], sizeof(db_frame_stamp_t));
+    *data = &ring->buffer[pos + RING_HEADER_SIZE];
+    return true;
+}
+
+/**
+ * Remove the frame returned by the last db_frame_ring_peek(). Must only be called by the consumer.
+ */
+void db_frame_ring_pop(db_frame_ring_t *ring) {
+    uint32_t tail = ring->tail;
+    uint32_t pos = tail & (ring->size - 1);
+    uint32_t length = *(uint32_t *) &ring->buffer[pos] & 0xFFFF;
+    __atomic_store_n(&ring->tail, tail + RING_ALIGN(RING_HEADER_SIZE + length), __ATOMIC_RELEASE);
+}
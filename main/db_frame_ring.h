@@ -0,0 +1,77 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#ifndef DB_ESP32_DB_FRAME_RING_H
+#define DB_ESP32_DB_FRAME_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Timestamps travelling with a frame. Not interpreted by the ring
+ */
+typedef struct {
+    uint32_t first_byte;        // us. First byte of the frame was read from its source
+    uint32_t queued;            // us. Frame was pushed
+} db_frame_stamp_t;
+
+#define DB_FRAME_RING_RECORD_OVERHEAD (4 + sizeof(db_frame_stamp_t) + 3)  // max. bytes a frame uses on top of its length
+
+/**
+ * Single producer/single consumer lock-free ring of variable length frames. Every frame is stored contiguously so the
+ * consumer can use it in place. Producer and consumer may run on different cores.
+ */
+typedef struct {
+    uint8_t *buffer;
+    uint32_t size;              // power of two
+    volatile uint32_t head;     // free running write counter. Only modified by producer
+    volatile uint32_t tail;     // free running read counter. Only modified by consumer
+    uint32_t high_water_mark;   // max. number of bytes used
+    uint32_t dropped_frames;    // frames that did not fit into the ring
+    uint32_t dropped_bytes;
+} db_frame_ring_t;
+
+bool db_frame_ring_init(db_frame_ring_t *ring, uint32_t size);
+bool db_frame_ring_push(db_frame_ring_t *ring, const uint8_t *data, uint16_t length, uint8_t tag,
+                        const db_frame_stamp_t *stamp);
+bool db_frame_ring_peek(db_frame_ring_t *ring, uint8_t **data, uint16_t *length, uint8_t *tag,
+                        db_frame_stamp_t *stamp);
+void db_frame_ring_pop(db_frame_ring_t *ring);
+uint32_t db_frame_ring_used(db_frame_ring_t *ring);
+uint16_t db_frame_ring_room(db_frame_ring_t *ring);
+
+/**
+ * Wakeup handshake for a consumer that sleeps while its ring is empty. The producer calls db_wakeup_request() after
+ * every push and wakes the consumer if it returns true. The consumer calls db_wakeup_rearm() right before it drains
+ * the ring. Both are read-modify-writes on the same flag: either the producer sees the rearmed flag and wakes the
+ * consumer, or the consumer reads the flag set by the producer and with it sees everything pushed before. A plain
+ * store + load on each side could miss both (store buffering).
+ *
+ * @param pending Flag shared by producer & consumer. 1 = a wakeup is on its way
+ * @return true if the consumer must be woken up
+ */
+static inline bool db_wakeup_request(uint32_t *pending) {
+    return __atomic_exchange_n(pending, 1, __ATOMIC_ACQ_REL) == 0;
+}
+
+static inline void db_wakeup_rearm(uint32_t *pending) {
+    __atomic_exchange_n(pending, 0, __ATOMIC_ACQ_REL);
+}
+
+#endif //DB_ESP32_DB_FRAME_RING_H
@@ -0,0 +1,155 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include "db_latency.h"
+
+typedef struct {
+    uint32_t buckets[DB_LATENCY_BUCKETS];
+    uint32_t count;
+    uint64_t sum_us;
+    uint32_t max_us;
+} db_latency_histogram_t;
+
+static const char *stage_names[DB_LATENCY_STAGES] = {"batch", "queue", "send", "total"};
+static db_latency_histogram_t histograms[DB_LATENCY_STAGES];
+static portMUX_TYPE latency_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Log-linear bucket index: values below 4 us get their own bucket, every higher power of two is split into
+ * 2^DB_LATENCY_SUB_BITS buckets of equal width
+ */
+static int bucket_index(uint32_t latency_us) {
+    if (latency_us < (1u << DB_LATENCY_SUB_BITS)) return (int) latency_us;
+    int exponent = 31 - __builtin_clz(latency_us);
+    int sub = (int) (latency_us >> (exponent - DB_LATENCY_SUB_BITS)) & ((1 << DB_LATENCY_SUB_BITS) - 1);
+    int index = ((exponent - DB_LATENCY_SUB_BITS + 1) << DB_LATENCY_SUB_BITS) + sub;
+    return index < DB_LATENCY_BUCKETS ? index : DB_LATENCY_BUCKETS - 1;
+}
+
+/**
+ * @return Smallest latency in us that goes into the bucket
+ */
+static uint32_t bucket_lower_bound(int index) {
+    if (index < (1 << DB_LATENCY_SUB_BITS)) return (uint32_t) index;
+    int exponent = (index >> DB_LATENCY_SUB_BITS) + DB_LATENCY_SUB_BITS - 1;
+    uint32_t sub = (uint32_t) (index & ((1 << DB_LATENCY_SUB_BITS) - 1));
+    return ((1u << DB_LATENCY_SUB_BITS) + sub) << (exponent - DB_LATENCY_SUB_BITS);
+}
+
+/**
+ * Adds a measurement to the histogram of a stage. Can be called by any task
+ */
+void db_latency_record(db_latency_stage_e stage, uint32_t latency_us) {
+    db_latency_histogram_t *histogram = &histograms[stage];
+    int index = bucket_index(latency_us);
+    portENTER_CRITICAL(&latency_lock);
+    histogram->buckets[index]++;
+    histogram->count++;
+    histogram->sum_us += latency_us;
+    if (latency_us > histogram->max_us) histogram->max_us = latency_us;
+    portEXIT_CRITICAL(&latency_lock);
+}
+
+void db_latency_reset() {
+    portENTER_CRITICAL(&latency_lock);
+    memset(histograms, 0, sizeof(histograms));
+    portEXIT_CRITICAL(&latency_lock);
+}
+
+/**
+ * @param percentile 0-100
+ * @return Upper bound of the bucket containing the percentile. Never more than the max. measured latency
+ */
+static uint32_t get_percentile(const db_latency_histogram_t *histogram, uint32_t percentile) {
+    if (histogram->count == 0) return 0;
+    uint32_t rank = (uint32_t) (((uint64_t) histogram->count * percentile + 99) / 100);
+    uint32_t seen = 0;
+    for (int i = 0; i < DB_LATENCY_BUCKETS - 1; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank && seen > 0) {
+            uint32_t upper_bound = bucket_lower_bound(i + 1) - 1;
+            return upper_bound < histogram->max_us ? upper_bound : histogram->max_us;
+        }
+    }
+    return histogram->max_us;
+}
+
+static void summarize(const db_latency_histogram_t *histogram, db_latency_summary_t *summary) {
+    summary->count = histogram->count;
+    summary->mean_us = histogram->count > 0 ? (uint32_t) (histogram->sum_us / histogram->count) : 0;
+    summary->p50_us = get_percentile(histogram, 50);
+    summary->p90_us = get_percentile(histogram, 90);
+    summary->p99_us = get_percentile(histogram, 99);
+    summary->max_us = histogram->max_us;
+}
+
+/**
+ * Percentiles of one stage. Can be called by any task
+ */
+void db_latency_get_summary(db_latency_stage_e stage, db_latency_summary_t *summary) {
+    db_latency_histogram_t *histogram = malloc(sizeof(db_latency_histogram_t));
+    memset(summary, 0, sizeof(db_latency_summary_t));
+    if (histogram == NULL) return;
+    portENTER_CRITICAL(&latency_lock);
+    memcpy(histogram, &histograms[stage], sizeof(db_latency_histogram_t));
+    portEXIT_CRITICAL(&latency_lock);
+    summarize(histogram, summary);
+    free(histogram);
+}
+
+/**
+ * Builds a JSON object with count, mean, p50, p90, p99 & max of every stage plus the non-empty buckets as
+ * [lower bound in us, count] pairs
+ *
+ * @return JSON object. Must be freed with cJSON_Delete(). NULL if out of memory
+ */
+cJSON *db_latency_to_json() {
+    cJSON *root = cJSON_CreateObject();
+    if (root == NULL) return NULL;
+    db_latency_histogram_t *histogram = malloc(sizeof(db_latency_histogram_t));
+    if (histogram == NULL) return root;
+    for (int stage = 0; stage < DB_LATENCY_STAGES; stage++) {
+        portENTER_CRITICAL(&latency_lock);
+        memcpy(histogram, &histograms[stage], sizeof(db_latency_histogram_t));
+        portEXIT_CRITICAL(&latency_lock);
+        db_latency_summary_t summary;
+        summarize(histogram, &summary);
+        cJSON *item = cJSON_AddObjectToObject(root, stage_names[stage]);
+        cJSON_AddNumberToObject(item, "count", summary.count);
+        cJSON_AddNumberToObject(item, "mean_us", summary.mean_us);
+        cJSON_AddNumberToObject(item, "p50_us", summary.p50_us);
+        cJSON_AddNumberToObject(item, "p90_us", summary.p90_us);
+        cJSON_AddNumberToObject(item, "p99_us", summary.p99_us);
+        cJSON_AddNumberToObject(item, "max_us", summary.max_us);
+        cJSON *buckets = cJSON_AddArrayToObject(item, "buckets");
+        for (int i = 0; i < DB_LATENCY_BUCKETS; i++) {
+            if (histogram->buckets[i] == 0) continue;
+            cJSON *bucket = cJSON_CreateArray();
+            cJSON_AddItemToArray(bucket, cJSON_CreateNumber(bucket_lower_bound(i)));
+            cJSON_AddItemToArray(bucket, cJSON_CreateNumber(histogram->buckets[i]));
+            cJSON_AddItemToArray(buckets, bucket);
+        }
+    }
+    free(histogram);
+    return root;
+}
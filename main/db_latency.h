@@ -0,0 +1,55 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#ifndef DB_ESP32_DB_LATENCY_H
+#define DB_ESP32_DB_LATENCY_H
+
+#include <stdint.h>
+#include <cJSON.h>
+
+#define DB_LATENCY_SUB_BITS 2       // every power of two is split into 4 buckets. Max. error of a percentile 25%
+#define DB_LATENCY_BUCKETS 96       // 0 us up to 2^25 us (~33 s). Longer latencies go into the last bucket
+
+/**
+ * Stages of the downlink. Times are taken with db_time_us()
+ */
+typedef enum {
+    DB_LATENCY_BATCH,   // first byte read from the UART -> packet handed to the network task. Parsing & packing
+    DB_LATENCY_QUEUE,   // packet handed to the network task -> taken from the downlink ring
+    DB_LATENCY_SEND,    // packet taken from the downlink ring -> sent. Per TCP client once its socket took the last byte
+    DB_LATENCY_TOTAL,   // first byte read from the UART -> sent. Same points in time as DB_LATENCY_SEND
+    DB_LATENCY_STAGES
+} db_latency_stage_e;
+
+typedef struct {
+    uint32_t count;
+    uint32_t mean_us;
+    uint32_t p50_us;
+    uint32_t p90_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} db_latency_summary_t;
+
+void db_latency_record(db_latency_stage_e stage, uint32_t latency_us);
+void db_latency_reset();
+void db_latency_get_summary(db_latency_stage_e stage, db_latency_summary_t *summary);
+cJSON *db_latency_to_json();
+
+#endif //DB_ESP32_DB_LATENCY_H
@@ -0,0 +1,216 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <lwip/inet.h>
+#include "db_metrics.h"
+#include "msp_cache.h"
+#include "msp_router.h"
+#include "globals.h"
+#include "db_uplink.h"
+#include "db_platform.h"
+
+typedef struct {
+    bool is_tcp;
+    uint32_t ip_addr;       // network byte order
+    uint16_t port;          // UDP only. Host byte order
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+    uint32_t queued_bytes;  // TCP: bytes waiting in the send queue
+    uint32_t dropped;       // TCP: packets dropped because the send queue was full
+    uint32_t idle_ms;       // UDP: time since the client sent something
+} db_metrics_client_t;
+
+/**
+ * Taken by the network task. Everything in here belongs to the network task and can not be read by others directly
+ */
+typedef struct {
+    db_metrics_client_t clients[DB_METRICS_MAX_CLIENTS];
+    int client_count;
+    uint32_t tcp_send_errors;       // sum of all TCP client slots
+    uint32_t tcp_evictions;
+    uint32_t ring_used;
+    uint32_t ring_high_water_mark;
+    uint32_t ring_dropped_bytes;
+    uint32_t udp_expired;
+    uint32_t udp_rejected;
+    msp_router_stats_t msp_router;
+} db_metrics_snapshot_t;
+
+db_metrics_t db_metrics;
+static db_metrics_snapshot_t snapshot;
+static int64_t last_snapshot = 0;   // only used by the network task
+static portMUX_TYPE snapshot_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Refreshes the client & queue snapshot once per DB_METRICS_UPDATE_INTERVAL_US. Must be called by the network task
+ *
+ * @param tcp_clients TCP clients of the network task
+ * @param udp_clients UDP clients of the network task
+ * @param downlink_ring Ring between UART reader and network task
+ * @param now Current time in us
+ */
+void db_metrics_update(const db_tcp_client_t tcp_clients[], const db_udp_client_table_t *udp_clients,
+                       db_frame_ring_t *downlink_ring, int64_t now) {
+    if (now - last_snapshot < DB_METRICS_UPDATE_INTERVAL_US) return;
+    last_snapshot = now;
+    db_metrics_snapshot_t update;
+    memset(&update, 0, sizeof(update));
+    for (int i = 0; i < CONFIG_LWIP_MAX_ACTIVE_TCP; i++) {
+        update.tcp_send_errors += tcp_clients[i].send_errors;
+        update.tcp_evictions += tcp_clients[i].evictions;
+        if (tcp_clients[i].socket < 0) continue;
+        db_metrics_client_t *client = &update.clients[update.client_count++];
+        client->is_tcp = true;
+        client->ip_addr = tcp_clients[i].ip_addr;
+        client->rx_bytes = tcp_clients[i].received_bytes;
+        client->tx_bytes = tcp_clients[i].sent_bytes;
+        client->queued_bytes = tcp_clients[i].queue_head - tcp_clients[i].queue_tail;
+        client->dropped = tcp_clients[i].dropped_packets;
+    }
+    for (int i = 0; i < DB_UDP_MAX_CLIENTS; i++) {
+        const db_udp_client_t *udp_client = &udp_clients->entries[i];
+        if (!udp_client->used) continue;
+        db_metrics_client_t *client = &update.clients[update.client_count++];
+        client->ip_addr = udp_client->addr.sin_addr.s_addr;
+        client->port = ntohs(udp_client->addr.sin_port);
+        client->rx_bytes = udp_client->rx_bytes;
+        client->tx_bytes = udp_client->tx_bytes;
+        client->idle_ms = (uint32_t) ((now - udp_client->last_seen) / 1000);
+    }
+    update.ring_used = db_frame_ring_used(downlink_ring);
+    update.ring_high_water_mark = downlink_ring->high_water_mark;
+    update.ring_dropped_bytes = downlink_ring->dropped_bytes;
+    update.udp_expired = udp_clients->stats.expired;
+    update.udp_rejected = udp_clients->stats.rejected;
+    msp_router_get_stats(&update.msp_router);
+    portENTER_CRITICAL(&snapshot_lock);
+    memcpy(&snapshot, &update, sizeof(snapshot));
+    portEXIT_CRITICAL(&snapshot_lock);
+}
+
+static void add_clients(cJSON *root, const db_metrics_snapshot_t *current) {
+    cJSON *clients = cJSON_AddArrayToObject(root, "clients");
+    for (int i = 0; i < current->client_count; i++) {
+        const db_metrics_client_t *client = &current->clients[i];
+        cJSON *item = cJSON_CreateObject();
+        char addr_str[16];
+        inet_ntoa_r(client->ip_addr, addr_str, sizeof(addr_str));
+        cJSON_AddStringToObject(item, "proto", client->is_tcp ? "tcp" : "udp");
+        cJSON_AddStringToObject(item, "ip", addr_str);
+        cJSON_AddNumberToObject(item, "rx", client->rx_bytes);
+        cJSON_AddNumberToObject(item, "tx", client->tx_bytes);
+        if (client->is_tcp) {
+            cJSON_AddNumberToObject(item, "queued", client->queued_bytes);
+            cJSON_AddNumberToObject(item, "dropped", client->dropped);
+        } else {
+            cJSON_AddNumberToObject(item, "port", client->port);
+            cJSON_AddNumberToObject(item, "idle_ms", client->idle_ms);
+        }
+        cJSON_AddItemToArray(clients, item);
+    }
+}
+
+/**
+ * Builds a JSON object of all counters and the latest client & queue snapshot. Can be called by any task
+ *
+ * @return JSON object. Must be freed with cJSON_Delete(). NULL if out of memory
+ */
+cJSON *db_metrics_to_json() {
+    db_metrics_snapshot_t current;
+    portENTER_CRITICAL(&snapshot_lock);
+    memcpy(&current, &snapshot, sizeof(current));
+    portEXIT_CRITICAL(&snapshot_lock);
+    cJSON *root = cJSON_CreateObject();
+    if (root == NULL) return NULL;
+    cJSON_AddNumberToObject(root, "uptime_ms", (double) (db_time_us() / 1000));
+
+    cJSON *uart = cJSON_AddObjectToObject(root, "uart");
+    cJSON_AddNumberToObject(uart, "rx", db_metrics.uart_rx_bytes);
+    cJSON_AddNumberToObject(uart, "tx", db_metrics.uart_tx_bytes);
+    cJSON_AddNumberToObject(uart, "fifo_ovf", db_metrics.uart_fifo_overflows);
+    cJSON_AddNumberToObject(uart, "buf_full", db_metrics.uart_buffer_full);
+    cJSON_AddNumberToObject(uart, "frame_err", db_metrics.uart_frame_errors);
+    cJSON_AddNumberToObject(uart, "rx_buf_hwm", db_metrics.uart_rx_buffered_max);
+    cJSON_AddNumberToObject(uart, "rx_buf_size", DB_UART_RX_BUF_SIZE);
+
+    cJSON *parser = cJSON_AddObjectToObject(root, "parser");
+    cJSON_AddNumberToObject(parser, "frames", db_metrics.parser_frames);
+    cJSON_AddNumberToObject(parser, "unvalidated", db_metrics.parser_unvalidated);
+    cJSON_AddNumberToObject(parser, "bad_crc", db_metrics.parser_bad_checksums);
+    cJSON_AddNumberToObject(parser, "resyncs", db_metrics.parser_resyncs);
+    cJSON_AddNumberToObject(parser, "skipped", db_metrics.parser_skipped_bytes);
+
+    cJSON *packing = cJSON_AddObjectToObject(root, "packing");
+    cJSON_AddNumberToObject(packing, "packets", db_metrics.packer_packets);
+    cJSON_AddNumberToObject(packing, "frames", db_metrics.packer_frames);
+    cJSON_AddNumberToObject(packing, "efficiency", db_metrics.packer_efficiency);
+
+    cJSON *downlink = cJSON_AddObjectToObject(root, "downlink");
+    cJSON_AddNumberToObject(downlink, "queued", db_metrics.downlink_queued);
+    cJSON_AddNumberToObject(downlink, "packets", db_metrics.downlink_packets);
+    cJSON_AddNumberToObject(downlink, "bytes", db_metrics.downlink_bytes);
+    cJSON_AddNumberToObject(downlink, "ring_used", current.ring_used);
+    cJSON_AddNumberToObject(downlink, "ring_hwm", current.ring_high_water_mark);
+    cJSON_AddNumberToObject(downlink, "ring_dropped", db_metrics.downlink_dropped);
+    cJSON_AddNumberToObject(downlink, "ring_dropped_bytes", current.ring_dropped_bytes);
+    cJSON_AddNumberToObject(downlink, "tcp_send_err", current.tcp_send_errors);
+    cJSON_AddNumberToObject(downlink, "tcp_evictions", current.tcp_evictions);
+    cJSON_AddNumberToObject(downlink, "udp_send_err", db_metrics.udp_send_errors);
+    cJSON_AddNumberToObject(downlink, "udp_group_send_err", db_metrics.udp_group_send_errors);
+    cJSON_AddNumberToObject(downlink, "udp_expired", current.udp_expired);
+    cJSON_AddNumberToObject(downlink, "udp_rejected", current.udp_rejected);
+
+    if (db_metrics.bench_frames > 0) {
+        cJSON *bench = cJSON_AddObjectToObject(root, "bench");
+        cJSON_AddNumberToObject(bench, "frames", db_metrics.bench_frames);
+        cJSON_AddNumberToObject(bench, "bytes", db_metrics.bench_bytes);
+    }
+
+    cJSON *uplink = cJSON_AddObjectToObject(root, "uplink");
+    cJSON_AddNumberToObject(uplink, "packets", db_metrics.uplink_packets);
+    cJSON_AddNumberToObject(uplink, "bytes", db_metrics.uplink_bytes);
+    db_uplink_stats_t uplink_stats;
+    db_uplink_get_stats(&uplink_stats);
+    const char *class_names[DB_UPLINK_CLASS_COUNT] = {"control", "normal", "bulk"};
+    for (int i = 0; i < DB_UPLINK_CLASS_COUNT; i++) {
+        cJSON *uplink_class = cJSON_AddObjectToObject(uplink, class_names[i]);
+        cJSON_AddNumberToObject(uplink_class, "queued", uplink_stats.queued[i]);
+        cJSON_AddNumberToObject(uplink_class, "dropped", uplink_stats.dropped[i]);
+        cJSON_AddNumberToObject(uplink_class, "used", uplink_stats.used[i]);
+    }
+
+    if (msp_cache_enabled()) {
+        msp_cache_stats_t cache_stats;
+        msp_cache_get_stats(&cache_stats);
+        cJSON *msp_cache = cJSON_AddObjectToObject(root, "msp_cache");
+        cJSON_AddNumberToObject(msp_cache, "hits", cache_stats.hits);
+        cJSON_AddNumberToObject(msp_cache, "misses", cache_stats.misses);
+        cJSON_AddNumberToObject(msp_cache, "polls", cache_stats.polls);
+    }
+    cJSON *msp_router = cJSON_AddObjectToObject(root, "msp_router");
+    cJSON_AddNumberToObject(msp_router, "forwarded", current.msp_router.forwarded);
+    cJSON_AddNumberToObject(msp_router, "coalesced", current.msp_router.coalesced);
+    cJSON_AddNumberToObject(msp_router, "routed", current.msp_router.routed);
+
+    add_clients(root, &current);
+    return root;
+}
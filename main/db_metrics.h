@@ -0,0 +1,75 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#ifndef DB_ESP32_DB_METRICS_H
+#define DB_ESP32_DB_METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <cJSON.h>
+#include "tcp_server.h"
+#include "db_udp_clients.h"
+#include "db_frame_ring.h"
+
+#define DB_METRICS_MAX_CLIENTS (CONFIG_LWIP_MAX_ACTIVE_TCP + DB_UDP_MAX_CLIENTS)
+#define DB_METRICS_UPDATE_INTERVAL_US 1000000   // client & queue snapshot is refreshed once per second
+
+/**
+ * Data path counters. Every counter is only written by one task so they are incremented without a lock. Readers get
+ * consistent 32 bit values but counters of different tasks are not sampled at the same instant.
+ */
+typedef struct {
+    // UART reader task
+    uint32_t uart_rx_bytes;         // read from the UART
+    uint32_t uart_fifo_overflows;   // UART_FIFO_OVF events - bytes were lost
+    uint32_t uart_buffer_full;      // UART_BUFFER_FULL events - bytes were lost
+    uint32_t uart_frame_errors;     // framing/parity errors & breaks
+    uint32_t uart_rx_buffered_max;  // max. bytes waiting in the UART driver RX buffer when the reader woke up
+    uint32_t parser_frames;         // valid MSP/LTM/MAVLink frames
+    uint32_t parser_unvalidated;    // MAVLink: frames of unknown messages passed on without CRC check
+    uint32_t parser_bad_checksums;  // frames dropped because of a checksum/CRC mismatch
+    uint32_t parser_resyncs;        // frames aborted because of an invalid header or size
+    uint32_t parser_skipped_bytes;  // MSP/LTM: bytes outside of any frame
+    uint32_t packer_packets;        // MSP/LTM: packets of packed frames
+    uint32_t packer_frames;         // MSP/LTM: frames in these packets
+    uint32_t packer_efficiency;     // MSP/LTM: frame bytes vs. frame bytes plus IP/UDP headers in percent
+    uint32_t downlink_queued;       // packets handed to the network task
+    uint32_t downlink_dropped;      // packets that did not fit into the downlink ring
+    // network task
+    uint32_t downlink_packets;      // packets taken from the downlink ring
+    uint32_t downlink_bytes;
+    uint32_t uplink_packets;        // TCP reads & UDP datagrams received from clients
+    uint32_t uplink_bytes;
+    uint32_t udp_send_errors;       // failed unicast sends. The client is removed
+    uint32_t udp_group_send_errors; // failed broadcast/multicast sends
+    // uplink writer task
+    uint32_t uart_tx_bytes;         // client data written to the UART
+    // benchmark traffic generator task. See db_bench.h
+    uint32_t bench_frames;
+    uint32_t bench_bytes;
+} db_metrics_t;
+
+extern db_metrics_t db_metrics;
+
+void db_metrics_update(const db_tcp_client_t tcp_clients[], const db_udp_client_table_t *udp_clients,
+                       db_frame_ring_t *downlink_ring, int64_t now);
+cJSON *db_metrics_to_json();
+
+#endif //DB_ESP32_DB_METRICS_H
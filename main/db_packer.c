@@ -0,0 +1,76 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#include <string.h>
+#include "db_packer.h"
+
+void db_packer_init(db_packer_t *packer) {
+    memset(packer, 0, sizeof(db_packer_t));
+}
+
+/**
+ * @param budget Configured packet size in bytes
+ * @return Budget limited to what fits into one datagram without IP fragmentation
+ */
+uint16_t db_packer_budget(uint16_t budget) {
+    if (budget == 0) return 1;  // every frame in its own packet
+    return (budget > DB_PACKER_MAX_SIZE) ? DB_PACKER_MAX_SIZE : budget;
+}
+
+/**
+ * @return true if the frame can be added without exceeding the budget. An empty packer accepts every frame that fits
+ * into the buffer - frames bigger than the budget are sent alone.
+ */
+bool db_packer_fits(const db_packer_t *packer, uint16_t frame_length, uint16_t budget) {
+    if (packer->length == 0) return frame_length <= DB_PACKER_MAX_SIZE;
+    return packer->length + frame_length <= db_packer_budget(budget);
+}
+
+/**
+ * Appends a frame. Caller must check db_packer_fits() first.
+ *
+ * @param now Current time in us. Used to track the hold time of the packet
+ */
+void db_packer_add(db_packer_t *packer, const uint8_t *frame, uint16_t frame_length, int64_t now) {
+    if (packer->length == 0) packer->start_time = now;
+    memcpy(&packer->buffer[packer->length], frame, frame_length);
+    packer->length += frame_length;
+    packer->frames++;
+}
+
+/**
+ * Call after the packet was sent. Updates the statistics and empties the packer
+ */
+void db_packer_reset(db_packer_t *packer) {
+    if (packer->length == 0) return;
+    packer->packets_total++;
+    packer->frames_total += packer->frames;
+    packer->bytes_total += packer->length;
+    packer->length = 0;
+    packer->frames = 0;
+}
+
+/**
+ * @return Average packing efficiency in percent: frame bytes vs. frame bytes plus IP/UDP headers of all sent packets
+ */
+uint8_t db_packer_efficiency(const db_packer_t *packer) {
+    uint64_t total = (uint64_t) packer->bytes_total + (uint64_t) packer->packets_total * DB_PACKER_IP_UDP_OVERHEAD;
+    if (total == 0) return 0;
+    return (uint8_t) (((uint64_t) packer->bytes_total * 100) / total);
+}
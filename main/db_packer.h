@@ -0,0 +1,50 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#ifndef DB_ESP32_DB_PACKER_H
+#define DB_ESP32_DB_PACKER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DB_PACKER_MTU 1500
+#define DB_PACKER_IP_UDP_OVERHEAD 28    // IPv4 + UDP header. Sent with every packet
+#define DB_PACKER_MAX_SIZE (DB_PACKER_MTU - DB_PACKER_IP_UDP_OVERHEAD)  // max. payload without IP fragmentation
+
+/**
+ * Packs whole frames into one packet until the byte budget is reached. Frames are never split.
+ */
+typedef struct {
+    uint8_t buffer[DB_PACKER_MAX_SIZE];
+    uint16_t length;            // bytes in buffer
+    uint16_t frames;            // frames in buffer
+    int64_t start_time;         // time the first frame was added
+    uint32_t packets_total;     // statistics: packets taken from the packer
+    uint32_t frames_total;
+    uint32_t bytes_total;
+} db_packer_t;
+
+void db_packer_init(db_packer_t *packer);
+uint16_t db_packer_budget(uint16_t budget);
+bool db_packer_fits(const db_packer_t *packer, uint16_t frame_length, uint16_t budget);
+void db_packer_add(db_packer_t *packer, const uint8_t *frame, uint16_t frame_length, int64_t now);
+void db_packer_reset(db_packer_t *packer);
+uint8_t db_packer_efficiency(const db_packer_t *packer);
+
+#endif //DB_ESP32_DB_PACKER_H
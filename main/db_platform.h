@@ -0,0 +1,102 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#ifndef DB_ESP32_DB_PLATFORM_H
+#define DB_ESP32_DB_PLATFORM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Platform layer of the bridge core. Everything that talks to the serial port, the clock, the settings storage, the
+ * Wi-Fi driver or creates tasks goes through here. db_platform_esp32.c implements it on the ESP-IDF,
+ * db_platform_posix.c on Linux (serial device or pseudo terminal, settings are not stored).
+ */
+
+#ifdef ESP_PLATFORM
+#include <esp_timer.h>
+
+/**
+ * @return Monotonic time in us
+ */
+static inline int64_t db_time_us() {
+    return esp_timer_get_time();
+}
+#else
+#include <time.h>
+
+static inline int64_t db_time_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+#endif
+
+typedef struct {
+    uint32_t baud_rate;
+    int tx_pin;                 // ESP32 only
+    int rx_pin;                 // ESP32 only
+    uint32_t rx_buffer_size;    // bytes buffered by the driver while the reader is busy
+    uint32_t tx_buffer_size;    // bytes buffered by the driver. 0: writes block until the data is in the HW FIFO
+    uint8_t rx_full_threshold;  // ESP32 only. RX FIFO fill level in bytes that makes the driver empty the FIFO
+    uint8_t rx_timeout;         // ESP32 only. Idle time in symbols after which the driver empties a partly filled FIFO
+} db_uart_config_t;
+
+typedef struct {
+    uint32_t fifo_overflows;    // hardware FIFO overflowed - bytes were lost
+    uint32_t buffer_full;       // driver RX buffer was full - bytes were lost
+    uint32_t frame_errors;      // framing/parity error or break - wrong baud rate or noise on the line
+} db_uart_events_t;
+
+bool db_uart_open(const db_uart_config_t *config);
+size_t db_uart_wait(int64_t timeout_us, db_uart_events_t *events);
+int db_uart_read(uint8_t *buffer, size_t length);
+int db_uart_write(const uint8_t *data, size_t length);
+
+typedef struct {
+    uint8_t mac[6];
+    uint32_t ip_addr;           // network byte order. 0 if no address was assigned yet
+} db_wifi_station_t;
+
+bool db_wifi_is_ap();
+bool db_wifi_get_ip_info(bool ap, uint32_t *ip_addr, uint32_t *netmask);
+int db_wifi_get_stations(db_wifi_station_t stations[], int max_stations);
+
+#define DB_TASK_NO_AFFINITY (-1)
+bool db_task_create(void (*task)(void *), const char *name, uint32_t stack_size, int priority, int core);
+
+#define DB_KV_OK 0
+#define DB_KV_NOT_FOUND 1           // settings were never stored or key does not exist. Any other value is an error
+
+typedef uint32_t db_kv_t;
+int db_kv_open(bool writable, db_kv_t *kv);
+void db_kv_close(db_kv_t kv);
+int db_kv_commit(db_kv_t kv);
+int db_kv_get_u8(db_kv_t kv, const char *key, uint8_t *value);
+int db_kv_get_u16(db_kv_t kv, const char *key, uint16_t *value);
+int db_kv_get_u32(db_kv_t kv, const char *key, uint32_t *value);
+int db_kv_get_str(db_kv_t kv, const char *key, char *value, size_t size);
+int db_kv_set_u8(db_kv_t kv, const char *key, uint8_t value);
+int db_kv_set_u16(db_kv_t kv, const char *key, uint16_t value);
+int db_kv_set_u32(db_kv_t kv, const char *key, uint32_t value);
+int db_kv_set_str(db_kv_t kv, const char *key, const char *value);
+
+#endif //DB_ESP32_DB_PLATFORM_H
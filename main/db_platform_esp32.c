@@ -0,0 +1,252 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#ifdef ESP_PLATFORM
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <esp_log.h>
+#include <esp_vfs_dev.h>
+#include <esp_wifi.h>
+#include <nvs.h>
+#include <driver/uart.h>
+#include <tcpip_adapter.h>
+#include "db_platform.h"
+
+#define TAG "DB_PLATFORM"
+#define DB_UART_NUM UART_NUM_2
+#define UART_EVENT_QUEUE_SIZE 20
+#define UART_TX_EMPTY_THRESH 10      // driver default
+#define KV_NAMESPACE "settings"
+
+static QueueHandle_t uart_event_queue;
+static int uart_fd = -1;                    // /dev/uart/2. Only kept to be closed when the UART is opened again
+
+/**
+ * Installs the UART driver on UART2 and routes /dev/uart/2 through it. The interrupts of the driver are configured with
+ * the RX FIFO full threshold & RX timeout of the config. Opening it again closes & uninstalls the previous instance
+ *
+ * @return false if the UART could not be opened
+ */
+bool db_uart_open(const db_uart_config_t *config) {
+    uart_config_t uart_config = {
+            .baud_rate = (int) config->baud_rate,
+            .data_bits = UART_DATA_8_BITS,
+            .parity    = UART_PARITY_DISABLE,
+            .stop_bits = UART_STOP_BITS_1,
+            .flow_ctrl = UART_HW_FLOWCTRL_DISABLE
+    };
+    if (uart_fd != -1) {
+        close(uart_fd);
+        uart_fd = -1;
+        uart_driver_delete(DB_UART_NUM);
+    }
+    ESP_ERROR_CHECK(uart_param_config(DB_UART_NUM, &uart_config));
+    ESP_ERROR_CHECK(uart_set_pin(DB_UART_NUM, config->tx_pin, config->rx_pin, UART_PIN_NO_CHANGE,
+                                 UART_PIN_NO_CHANGE));
+    ESP_ERROR_CHECK(uart_driver_install(DB_UART_NUM, (int) config->rx_buffer_size, (int) config->tx_buffer_size,
+                                        UART_EVENT_QUEUE_SIZE, &uart_event_queue, 0));
+    uart_intr_config_t uart_intr = {
+            .intr_enable_mask = UART_RXFIFO_FULL_INT_ENA_M | UART_RXFIFO_TOUT_INT_ENA_M | UART_FRM_ERR_INT_ENA_M |
+                                UART_RXFIFO_OVF_INT_ENA_M | UART_BRK_DET_INT_ENA_M | UART_PARITY_ERR_INT_ENA_M,
+            .rxfifo_full_thresh = config->rx_full_threshold,
+            .rx_timeout_thresh = config->rx_timeout,
+            .txfifo_empty_intr_thresh = UART_TX_EMPTY_THRESH
+    };
+    ESP_ERROR_CHECK(uart_intr_config(DB_UART_NUM, &uart_intr));
+    if ((uart_fd = open("/dev/uart/2", O_RDWR)) == -1) {
+        ESP_LOGE(TAG, "Cannot open UART2");
+        uart_driver_delete(DB_UART_NUM);
+        return false;
+    }
+    esp_vfs_dev_uart_use_driver(2);
+    return true;
+}
+
+/**
+ * Waits for the next event of the UART driver and processes all pending events
+ *
+ * @param timeout_us Max. time to wait for an event
+ * @param events Counters of lost & corrupted data. Incremented
+ * @return Number of bytes currently waiting in the UART RX buffer
+ */
+size_t db_uart_wait(int64_t timeout_us, db_uart_events_t *events) {
+    TickType_t wait_ticks = (timeout_us + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000);
+    uart_event_t uart_event;
+    while (xQueueReceive(uart_event_queue, &uart_event, wait_ticks) == pdTRUE) {
+        wait_ticks = 0;
+        switch (uart_event.type) {
+            case UART_FIFO_OVF:
+                events->fifo_overflows++;
+                break;
+            case UART_BUFFER_FULL:
+                events->buffer_full++;
+                break;
+            case UART_FRAME_ERR:
+            case UART_PARITY_ERR:
+            case UART_BREAK:
+                events->frame_errors++;
+                break;
+            case UART_DATA:
+            default:
+                break;
+        }
+    }
+    size_t buffered_len = 0;
+    uart_get_buffered_data_len(DB_UART_NUM, &buffered_len);
+    return buffered_len;
+}
+
+/**
+ * Reads what is buffered by the driver. Does not block
+ *
+ * @return Number of bytes read. -1 on error
+ */
+int db_uart_read(uint8_t *buffer, size_t length) {
+    return uart_read_bytes(DB_UART_NUM, buffer, length, 0);
+}
+
+/**
+ * Writes to the UART. Blocks until the driver accepted all data
+ *
+ * @return Number of bytes written. -1 on error
+ */
+int db_uart_write(const uint8_t *data, size_t length) {
+    return uart_write_bytes(DB_UART_NUM, (const char *) data, length);
+}
+
+bool db_wifi_is_ap() {
+    wifi_mode_t wifi_mode;
+    return esp_wifi_get_mode(&wifi_mode) == ESP_OK && wifi_mode == WIFI_MODE_AP;
+}
+
+/**
+ * @param ap true for the access point interface, false for the station interface
+ * @param ip_addr Set to the IPv4 address of the interface. Network byte order
+ * @param netmask Set to the netmask of the interface. Network byte order
+ * @return false if the interface has no address
+ */
+bool db_wifi_get_ip_info(bool ap, uint32_t *ip_addr, uint32_t *netmask) {
+    tcpip_adapter_ip_info_t ip_info;
+    if (tcpip_adapter_get_ip_info(ap ? TCPIP_ADAPTER_IF_AP : TCPIP_ADAPTER_IF_STA, &ip_info) != ESP_OK ||
+        ip_info.ip.addr == 0)
+        return false;
+    *ip_addr = ip_info.ip.addr;
+    *netmask = ip_info.netmask.addr;
+    return true;
+}
+
+/**
+ * Gets all stations connected to the local AP
+ *
+ * @param stations Set to MAC & IP address of the stations
+ * @param max_stations Size of stations
+ * @return Number of stations. -1 if the list could not be read
+ */
+int db_wifi_get_stations(db_wifi_station_t stations[], int max_stations) {
+    wifi_sta_list_t sta_list;
+    tcpip_adapter_sta_list_t tcpip_sta_list;
+    memset(&sta_list, 0, sizeof(sta_list));
+    memset(&tcpip_sta_list, 0, sizeof(tcpip_sta_list));
+    if (esp_wifi_ap_get_sta_list(&sta_list) != ESP_OK ||
+        tcpip_adapter_get_sta_list(&sta_list, &tcpip_sta_list) != ESP_OK)
+        return -1;
+    int count = 0;
+    for (int i = 0; i < tcpip_sta_list.num && count < max_stations; i++) {
+        memcpy(stations[count].mac, tcpip_sta_list.sta[i].mac, 6);
+        stations[count++].ip_addr = tcpip_sta_list.sta[i].ip.addr;
+    }
+    return count;
+}
+
+/**
+ * @param core Core to pin the task to. DB_TASK_NO_AFFINITY to let the scheduler decide
+ * @return false if the task could not be created
+ */
+bool db_task_create(void (*task)(void *), const char *name, uint32_t stack_size, int priority, int core) {
+    return xTaskCreatePinnedToCore(task, name, stack_size, NULL, (UBaseType_t) priority, NULL,
+                                   core == DB_TASK_NO_AFFINITY ? tskNO_AFFINITY : core) == pdPASS;
+}
+
+static int kv_result(esp_err_t err) {
+    return err == ESP_ERR_NVS_NOT_FOUND ? DB_KV_NOT_FOUND : err;
+}
+
+/**
+ * Opens the settings in NVS
+ *
+ * @param writable true to change the settings
+ * @return DB_KV_OK, DB_KV_NOT_FOUND if settings were never stored, else the esp_err_t
+ */
+int db_kv_open(bool writable, db_kv_t *kv) {
+    nvs_handle handle = 0;
+    esp_err_t err = nvs_open(KV_NAMESPACE, writable ? NVS_READWRITE : NVS_READONLY, &handle);
+    *kv = handle;
+    return kv_result(err);
+}
+
+void db_kv_close(db_kv_t kv) {
+    nvs_close(kv);
+}
+
+int db_kv_commit(db_kv_t kv) {
+    return kv_result(nvs_commit(kv));
+}
+
+int db_kv_get_u8(db_kv_t kv, const char *key, uint8_t *value) {
+    return kv_result(nvs_get_u8(kv, key, value));
+}
+
+int db_kv_get_u16(db_kv_t kv, const char *key, uint16_t *value) {
+    return kv_result(nvs_get_u16(kv, key, value));
+}
+
+int db_kv_get_u32(db_kv_t kv, const char *key, uint32_t *value) {
+    return kv_result(nvs_get_u32(kv, key, value));
+}
+
+/**
+ * @param size Size of value incl. the terminating null. Fails if the stored string is longer
+ */
+int db_kv_get_str(db_kv_t kv, const char *key, char *value, size_t size) {
+    return kv_result(nvs_get_str(kv, key, value, &size));
+}
+
+int db_kv_set_u8(db_kv_t kv, const char *key, uint8_t value) {
+    return kv_result(nvs_set_u8(kv, key, value));
+}
+
+int db_kv_set_u16(db_kv_t kv, const char *key, uint16_t value) {
+    return kv_result(nvs_set_u16(kv, key, value));
+}
+
+int db_kv_set_u32(db_kv_t kv, const char *key, uint32_t value) {
+    return kv_result(nvs_set_u32(kv, key, value));
+}
+
+int db_kv_set_str(db_kv_t kv, const char *key, const char *value) {
+    return kv_result(nvs_set_str(kv, key, value));
+}
+
+#endif
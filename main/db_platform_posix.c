@@ -0,0 +1,262 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#ifndef ESP_PLATFORM
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include "db_platform.h"
+
+#define DB_UART_DEVICE_ENV "DB_UART_DEVICE"     // serial device or pseudo terminal the bridge reads from
+
+static int uart_fd = -1;
+
+static speed_t baud_to_speed(uint32_t baud_rate) {
+    switch (baud_rate) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 500000: return B500000;
+        case 921600: return B921600;
+        case 1000000: return B1000000;
+        default: return B0;
+    }
+}
+
+/**
+ * Opens the device named by the DB_UART_DEVICE environment variable in raw mode. Only the baud rate is used. Opening it
+ * again closes the previous device
+ *
+ * @return false if the device could not be opened
+ */
+bool db_uart_open(const db_uart_config_t *config) {
+    const char *device = getenv(DB_UART_DEVICE_ENV);
+    if (device == NULL) {
+        fprintf(stderr, "DB_PLATFORM: Set %s to the serial device or pseudo terminal to use\n", DB_UART_DEVICE_ENV);
+        return false;
+    }
+    if (uart_fd != -1) {
+        close(uart_fd);
+        uart_fd = -1;
+    }
+    if ((uart_fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK)) == -1) {
+        fprintf(stderr, "DB_PLATFORM: Cannot open %s: %s\n", device, strerror(errno));
+        return false;
+    }
+    struct termios tio;
+    if (tcgetattr(uart_fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        speed_t speed = baud_to_speed(config->baud_rate);
+        if (speed != B0) {  // pseudo terminals do not care
+            cfsetispeed(&tio, speed);
+            cfsetospeed(&tio, speed);
+        }
+        tcsetattr(uart_fd, TCSANOW, &tio);
+    }
+    return true;
+}
+
+/**
+ * Waits until data is available. Lost data is not reported by the OS
+ *
+ * @param timeout_us Max. time to wait for data
+ * @param events Unchanged
+ * @return Number of bytes waiting to be read
+ */
+size_t db_uart_wait(int64_t timeout_us, db_uart_events_t *events) {
+    (void) events;
+    struct pollfd pfd = {.fd = uart_fd, .events = POLLIN};
+    if (poll(&pfd, 1, (int) ((timeout_us + 999) / 1000)) <= 0) return 0;
+    int available = 0;
+    if (ioctl(uart_fd, FIONREAD, &available) == -1 || available < 0) return 0;
+    return (size_t) available;
+}
+
+/**
+ * @return Number of bytes read. Does not block. -1 on error
+ */
+int db_uart_read(uint8_t *buffer, size_t length) {
+    ssize_t read_bytes = read(uart_fd, buffer, length);
+    if (read_bytes < 0) return (errno == EAGAIN) ? 0 : -1;
+    return (int) read_bytes;
+}
+
+/**
+ * Writes all data. Blocks until the OS accepted it
+ *
+ * @return Number of bytes written. -1 on error
+ */
+int db_uart_write(const uint8_t *data, size_t length) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t n = write(uart_fd, data + written, length - written);
+        if (n < 0) {
+            if (errno != EAGAIN) return -1;
+            struct pollfd pfd = {.fd = uart_fd, .events = POLLOUT};
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        written += n;
+    }
+    return (int) written;
+}
+
+/**
+ * The host behaves like a station. Clients register via UDP
+ */
+bool db_wifi_is_ap() {
+    return false;
+}
+
+bool db_wifi_get_ip_info(bool ap, uint32_t *ip_addr, uint32_t *netmask) {
+    (void) ap;
+    (void) ip_addr;
+    (void) netmask;
+    return false;
+}
+
+int db_wifi_get_stations(db_wifi_station_t stations[], int max_stations) {
+    (void) stations;
+    (void) max_stations;
+    return 0;
+}
+
+struct task_start {
+    void (*task)(void *);
+};
+
+static void *run_task(void *arg) {
+    struct task_start start = *(struct task_start *) arg;
+    free(arg);
+    start.task(NULL);
+    return NULL;
+}
+
+/**
+ * Starts the task as a detached thread. Priority and core are ignored
+ */
+bool db_task_create(void (*task)(void *), const char *name, uint32_t stack_size, int priority, int core) {
+    (void) stack_size;
+    (void) priority;
+    (void) core;
+    struct task_start *start = malloc(sizeof(struct task_start));
+    if (start == NULL) return false;
+    start->task = task;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int err = pthread_create(&thread, &attr, run_task, start);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        fprintf(stderr, "DB_PLATFORM: Cannot start task %s: %s\n", name, strerror(err));
+        free(start);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Settings are not stored on the host. Every start uses the defaults
+ */
+int db_kv_open(bool writable, db_kv_t *kv) {
+    *kv = 0;
+    return writable ? DB_KV_OK : DB_KV_NOT_FOUND;
+}
+
+void db_kv_close(db_kv_t kv) {
+    (void) kv;
+}
+
+int db_kv_commit(db_kv_t kv) {
+    (void) kv;
+    return DB_KV_OK;
+}
+
+int db_kv_get_u8(db_kv_t kv, const char *key, uint8_t *value) {
+    (void) kv;
+    (void) key;
+    (void) value;
+    return DB_KV_NOT_FOUND;
+}
+
+int db_kv_get_u16(db_kv_t kv, const char *key, uint16_t *value) {
+    (void) kv;
+    (void) key;
+    (void) value;
+    return DB_KV_NOT_FOUND;
+}
+
+int db_kv_get_u32(db_kv_t kv, const char *key, uint32_t *value) {
+    (void) kv;
+    (void) key;
+    (void) value;
+    return DB_KV_NOT_FOUND;
+}
+
+int db_kv_get_str(db_kv_t kv, const char *key, char *value, size_t size) {
+    (void) kv;
+    (void) key;
+    (void) value;
+    (void) size;
+    return DB_KV_NOT_FOUND;
+}
+
+int db_kv_set_u8(db_kv_t kv, const char *key, uint8_t value) {
+    (void) kv;
+    (void) key;
+    (void) value;
+    return DB_KV_OK;
+}
+
+int db_kv_set_u16(db_kv_t kv, const char *key, uint16_t value) {
+    (void) kv;
+    (void) key;
+    (void) value;
+    return DB_KV_OK;
+}
+
+int db_kv_set_u32(db_kv_t kv, const char *key, uint32_t value) {
+    (void) kv;
+    (void) key;
+    (void) value;
+    return DB_KV_OK;
+}
+
+int db_kv_set_str(db_kv_t kv, const char *key, const char *value) {
+    (void) kv;
+    (void) key;
+    (void) value;
+    return DB_KV_OK;
+}
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#include <string.h>
+#include "db_udp_clients.h"
+
+void db_udp_clients_init(db_udp_client_table_t *table) {
+    memset(table, 0, sizeof(db_udp_client_table_t));
+    memset(table->buckets, -1, sizeof(table->buckets));
+}
+
+static uint32_t hash_addr(const struct sockaddr_in *addr) {
+    uint32_t key = addr->sin_addr.s_addr ^ ((uint32_t) addr->sin_port << 16);
+    return (key * 2654435761u) >> 24 & (DB_UDP_HASH_BUCKETS - 1);  // multiplicative hashing
+}
+
+/**
+ * @return The client with that address & port or NULL if unknown
+ */
+db_udp_client_t *db_udp_clients_find(db_udp_client_table_t *table, const struct sockaddr_in *addr) {
+    uint32_t probes = 0;
+    db_udp_client_t *found = NULL;
+    for (int8_t i = table->buckets[hash_addr(addr)]; i >= 0; i = table->entries[i].next) {
+        probes++;
+        if (table->entries[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+            table->entries[i].addr.sin_port == addr->sin_port) {
+            found = &table->entries[i];
+            break;
+        }
+    }
+    table->stats.lookups++;
+    table->stats.probes += probes;
+    if (probes > table->stats.max_probes) table->stats.max_probes = probes;
+    return found;
+}
+
+/**
+ * Adds a client or refreshes its last seen time if it is already known
+ *
+ * @param addr Address & port of the client
+ * @param is_broadcast true if the client is added because its station is connected to the AP
+ * @param now Current time in us
+ * @param is_new Set to true if the client was not known before
+ * @return The client. NULL if the table is full
+ */
+db_udp_client_t *db_udp_clients_add(db_udp_client_table_t *table, const struct sockaddr_in *addr, bool is_broadcast,
+                                    int64_t now, bool *is_new) {
+    *is_new = false;
+    db_udp_client_t *client = db_udp_clients_find(table, addr);
+    if (client != NULL) {
+        client->last_seen = now;
+        if (is_broadcast) client->is_broadcast = true;  // client is a connected station - keep until it leaves
+        return client;
+    }
+    for (int i = 0; i < DB_UDP_MAX_CLIENTS; i++) {
+        if (table->entries[i].used) continue;
+        uint32_t bucket = hash_addr(addr);
+        client = &table->entries[i];
+        client->used = true;
+        client->is_broadcast = is_broadcast;
+        client->addr = *addr;
+        client->last_seen = now;
+        client->next = table->buckets[bucket];
+        table->buckets[bucket] = (int8_t) i;
+        table->count++;
+        *is_new = true;
+        return client;
+    }
+    table->stats.rejected++;
+    return NULL;
+}
+
+void db_udp_clients_remove(db_udp_client_table_t *table, db_udp_client_t *client) {
+    if (!client->used) return;
+    int8_t index = (int8_t) (client - table->entries);
+    int8_t *link = &table->buckets[hash_addr(&client->addr)];
+    while (*link >= 0 && *link != index) link = &table->entries[*link].next;
+    if (*link == index) *link = client->next;
+    memset(client, 0, sizeof(db_udp_client_t));
+    table->count--;
+}
+
+/**
+ * Removes all clients that were idle for too long. Entries of connected stations stay until the station leaves
+ *
+ * @param now Current time in us
+ * @return Number of removed clients
+ */
+int db_udp_clients_expire(db_udp_client_table_t *table, int64_t now) {
+    int removed = 0;
+    for (int i = 0; i < DB_UDP_MAX_CLIENTS; i++) {
+        db_udp_client_t *client = &table->entries[i];
+        if (client->used && !client->is_broadcast && now - client->last_seen > DB_UDP_CLIENT_TIMEOUT_US) {
+            db_udp_clients_remove(table, client);
+            removed++;
+        }
+    }
+    table->stats.expired += removed;
+    return removed;
+}
@@ -0,0 +1,73 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#ifndef DB_ESP32_DB_UDP_CLIENTS_H
+#define DB_ESP32_DB_UDP_CLIENTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lwip/sockets.h"
+#include "db_filter.h"
+
+#ifndef DB_UDP_MAX_CLIENTS
+#define DB_UDP_MAX_CLIENTS 16               // AP allows 10 stations. Some of them might use more than one port
+#endif
+#define DB_UDP_HASH_BUCKETS 32              // power of two. About twice DB_UDP_MAX_CLIENTS keeps the chains short
+#ifndef DB_UDP_CLIENT_TIMEOUT_US
+#define DB_UDP_CLIENT_TIMEOUT_US 60000000   // clients that did not send anything for this long are removed
+#endif
+
+typedef struct {
+    bool used;
+    bool is_broadcast;                      // added because a station is connected to the AP - not because it sent data
+    int8_t next;                            // next entry in the same hash bucket. -1 = end of chain
+    struct sockaddr_in addr;
+    int64_t last_seen;                      // last time data was received from the client (or the station was seen)
+    db_filter_state_t filter_state;         // telemetry filter rate limits of this client
+    uint32_t rx_bytes;                      // statistics. Received from the client
+    uint32_t tx_bytes;                      // sent to the client as unicast
+} db_udp_client_t;
+
+typedef struct {
+    uint32_t lookups;
+    uint32_t probes;                        // entries compared during all lookups. probes/lookups = avg. lookup cost
+    uint32_t max_probes;                    // longest lookup
+    uint32_t expired;                       // clients removed because they were idle
+    uint32_t rejected;                      // new clients that did not fit into the table
+} db_udp_client_stats_t;
+
+/**
+ * UDP clients of the network task. Hash table with chaining for the lookup on every received datagram, entries array
+ * for sending to all clients
+ */
+typedef struct {
+    db_udp_client_t entries[DB_UDP_MAX_CLIENTS];
+    int8_t buckets[DB_UDP_HASH_BUCKETS];    // index of first entry of every bucket. -1 = empty
+    int count;
+    db_udp_client_stats_t stats;
+} db_udp_client_table_t;
+
+void db_udp_clients_init(db_udp_client_table_t *table);
+db_udp_client_t *db_udp_clients_find(db_udp_client_table_t *table, const struct sockaddr_in *addr);
+db_udp_client_t *db_udp_clients_add(db_udp_client_table_t *table, const struct sockaddr_in *addr, bool is_broadcast,
+                                    int64_t now, bool *is_new);
+void db_udp_clients_remove(db_udp_client_table_t *table, db_udp_client_t *client);
+int db_udp_clients_expire(db_udp_client_table_t *table, int64_t now);
+
+#endif //DB_ESP32_DB_UDP_CLIENTS_H
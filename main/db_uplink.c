@@ -0,0 +1,162 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#include <string.h>
+#include "db_uplink.h"
+#include "db_frame_ring.h"
+
+#define MSP_SET_RAW_RC 200
+#define MSP_SET_WP 209
+#define MSP_BULK_PAYLOAD_SIZE 64    // MSP frames with a larger payload are bulk transfers
+
+/**
+ * One queue per class. Network task -> uplink writer task. Bulk must hold a complete TCP read of transparent data
+ */
+static const uint32_t uplink_ring_sizes[DB_UPLINK_CLASS_COUNT] = {1024, 4096, 8192};
+static db_frame_ring_t uplink_rings[DB_UPLINK_CLASS_COUNT];
+static uint32_t uplink_queued[DB_UPLINK_CLASS_COUNT];
+
+static const uint32_t mavlink_control_msgs[] = {
+        0,      // HEARTBEAT
+        11,     // SET_MODE
+        69,     // MANUAL_CONTROL
+        70,     // RC_CHANNELS_OVERRIDE
+        75,     // COMMAND_INT
+        76,     // COMMAND_LONG
+        81,     // MANUAL_SETPOINT
+        82,     // SET_ATTITUDE_TARGET
+        84,     // SET_POSITION_TARGET_LOCAL_NED
+        86      // SET_POSITION_TARGET_GLOBAL_INT
+};
+
+static const uint32_t mavlink_bulk_msgs[] = {
+        20,     // PARAM_REQUEST_READ
+        21,     // PARAM_REQUEST_LIST
+        23,     // PARAM_SET
+        39,     // MISSION_ITEM
+        40,     // MISSION_REQUEST
+        43,     // MISSION_REQUEST_LIST
+        44,     // MISSION_COUNT
+        45,     // MISSION_CLEAR_ALL
+        47,     // MISSION_ACK
+        51,     // MISSION_REQUEST_INT
+        73,     // MISSION_ITEM_INT
+        110,    // FILE_TRANSFER_PROTOCOL
+        117,    // LOG_REQUEST_LIST
+        119,    // LOG_REQUEST_DATA
+        121,    // LOG_ERASE
+        122     // LOG_REQUEST_END
+};
+
+static bool contains(const uint32_t list[], int count, uint32_t msg_id) {
+    for (int i = 0; i < count; i++) {
+        if (list[i] == msg_id) return true;
+    }
+    return false;
+}
+
+/**
+ * @return true on success, false if memory could not be allocated
+ */
+bool db_uplink_init() {
+    memset(uplink_queued, 0, sizeof(uplink_queued));
+    for (int i = 0; i < DB_UPLINK_CLASS_COUNT; i++) {
+        if (!db_frame_ring_init(&uplink_rings[i], uplink_ring_sizes[i])) return false;
+    }
+    return true;
+}
+
+/**
+ * @return Priority class of a MAVLink frame sent by a client
+ */
+uint8_t db_uplink_mavlink_class(uint32_t msg_id) {
+    if (contains(mavlink_control_msgs, sizeof(mavlink_control_msgs) / sizeof(mavlink_control_msgs[0]), msg_id))
+        return DB_UPLINK_CONTROL;
+    if (contains(mavlink_bulk_msgs, sizeof(mavlink_bulk_msgs) / sizeof(mavlink_bulk_msgs[0]), msg_id))
+        return DB_UPLINK_BULK;
+    return DB_UPLINK_NORMAL;
+}
+
+/**
+ * @param cmd MSP command of a frame sent by a client
+ * @param payload_size Size of the payload of the frame
+ * @return Priority class of the frame
+ */
+uint8_t db_uplink_msp_class(uint16_t cmd, uint16_t payload_size) {
+    if (cmd == MSP_SET_RAW_RC) return DB_UPLINK_CONTROL;
+    if (cmd == MSP_SET_WP || payload_size > MSP_BULK_PAYLOAD_SIZE) return DB_UPLINK_BULK;
+    return DB_UPLINK_NORMAL;
+}
+
+/**
+ * Queues a frame for the UART. Must only be called by the network task
+ *
+ * @param frame Complete frame or a chunk of unframed data. Written to the UART in one piece
+ * @param priority_class DB_UPLINK_CONTROL, DB_UPLINK_NORMAL or DB_UPLINK_BULK
+ * @return false if the queue of the class is full. The frame is dropped and counted
+ */
+bool db_uplink_queue(const uint8_t *frame, uint16_t length, uint8_t priority_class) {
+    db_frame_stamp_t stamp = {0};
+    if (!db_frame_ring_push(&uplink_rings[priority_class], frame, length, priority_class, &stamp)) return false;
+    uplink_queued[priority_class]++;
+    return true;
+}
+
+/**
+ * @return Largest frame the queue of the class accepts right now. Must only be called by the network task
+ */
+uint16_t db_uplink_room(uint8_t priority_class) {
+    return db_frame_ring_room(&uplink_rings[priority_class]);
+}
+
+/**
+ * Gets the next frame to write to the UART without removing it. Frames of a higher priority class always go first.
+ * Must only be called by the uplink writer task
+ *
+ * @param frame Set to the start of the frame inside the queue
+ * @param length Set to the length of the frame
+ * @param priority_class Set to the class of the frame. Pass it to db_uplink_pop()
+ * @return false if all queues are empty
+ */
+bool db_uplink_peek(uint8_t **frame, uint16_t *length, uint8_t *priority_class) {
+    db_frame_stamp_t stamp;
+    for (int i = 0; i < DB_UPLINK_CLASS_COUNT; i++) {
+        if (db_frame_ring_peek(&uplink_rings[i], frame, length, priority_class, &stamp)) return true;
+    }
+    return false;
+}
+
+/**
+ * Removes the frame returned by the last db_uplink_peek(). Must only be called by the uplink writer task
+ */
+void db_uplink_pop(uint8_t priority_class) {
+    db_frame_ring_pop(&uplink_rings[priority_class]);
+}
+
+/**
+ * Statistics are read without a lock. Counters are consistent 32 bit values
+ */
+void db_uplink_get_stats(db_uplink_stats_t *stats) {
+    for (int i = 0; i < DB_UPLINK_CLASS_COUNT; i++) {
+        stats->queued[i] = uplink_queued[i];
+        stats->dropped[i] = uplink_rings[i].dropped_frames;
+        stats->used[i] = uplink_rings[i].buffer != NULL ? db_frame_ring_used(&uplink_rings[i]) : 0;
+    }
+}
@@ -0,0 +1,50 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+
+#ifndef DB_ESP32_DB_UPLINK_H
+#define DB_ESP32_DB_UPLINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Priority classes of data written to the UART. Lower value is written first
+ */
+#define DB_UPLINK_CONTROL 0     // manual control, RC override, commands, heartbeats
+#define DB_UPLINK_NORMAL 1      // everything else that is a complete frame
+#define DB_UPLINK_BULK 2        // mission, parameter, log & file transfers. Unframed (transparent) data
+#define DB_UPLINK_CLASS_COUNT 3
+
+typedef struct {
+    uint32_t queued[DB_UPLINK_CLASS_COUNT];     // frames queued per class
+    uint32_t dropped[DB_UPLINK_CLASS_COUNT];    // frames that did not fit into the queue of their class
+    uint32_t used[DB_UPLINK_CLASS_COUNT];       // bytes currently queued per class
+} db_uplink_stats_t;
+
+bool db_uplink_init();
+uint8_t db_uplink_mavlink_class(uint32_t msg_id);
+uint8_t db_uplink_msp_class(uint16_t cmd, uint16_t payload_size);
+bool db_uplink_queue(const uint8_t *frame, uint16_t length, uint8_t priority_class);
+uint16_t db_uplink_room(uint8_t priority_class);
+bool db_uplink_peek(uint8_t **frame, uint16_t *length, uint8_t *priority_class);
+void db_uplink_pop(uint8_t priority_class);
+void db_uplink_get_stats(db_uplink_stats_t *stats);
+
+#endif //DB_ESP32_DB_UPLINK_H
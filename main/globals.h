@@ -22,19 +22,30 @@
 
 #include <freertos/event_groups.h>
 
-#define MAX_LTM_FRAMES_IN_BUFFER 5
 #define BUILDVERSION 6    //v0.6
 
+#define UDP_DOWNLINK_UNICAST 0      // one datagram per known UDP client
+#define UDP_DOWNLINK_BROADCAST 1    // one datagram to the subnet broadcast address
+#define UDP_DOWNLINK_MULTICAST 2    // one datagram to UDP_MULTICAST_GROUP
+
 // can be set by user
 extern uint8_t DEFAULT_SSID[32];
 extern uint8_t DEFAULT_PWD[64];
 extern uint8_t DEFAULT_CHANNEL;
-extern uint8_t SERIAL_PROTOCOL;  // 1,2=MSP, 3,4,5=MAVLink/transparent
+extern uint8_t SERIAL_PROTOCOL;  // 1,2=MSP, 3=MAVLink, 4,5=transparent
 extern uint8_t DB_UART_PIN_TX;
 extern uint8_t DB_UART_PIN_RX;
 extern uint32_t DB_UART_BAUD_RATE;
+extern uint32_t DB_UART_RX_BUF_SIZE;    // bytes the UART driver buffers while the reader task is busy
+extern uint32_t DB_UART_TX_BUF_SIZE;    // bytes the UART driver buffers for writing (0 = writes block)
+extern uint8_t DB_UART_RX_THRESH;       // RX FIFO fill level in bytes that makes the driver empty the FIFO (1-127)
+extern uint8_t DB_UART_RX_TIMEOUT;      // idle symbols after which the driver empties a partly filled FIFO (1-126)
 extern uint16_t TRANSPARENT_BUF_SIZE;
-extern uint8_t LTM_FRAME_NUM_BUFFER;    // Number of LTM frames per UDP packet (min = 1; max = 5)
+extern char MSP_POLL_LIST[64];          // MSP commands polled by the ESP32 as "<cmd>:<rate Hz>,..." (empty = off)
+extern uint16_t MSP_LTM_PACKET_SIZE;    // Max. bytes of MSP/LTM frames per packet (0 = one frame per packet)
+extern uint32_t SERIAL_HOLD_TIME_US;    // Max. time data is held back to fill a packet (0 = wait until packet is full)
+extern uint8_t UDP_DOWNLINK_MODE;       // UDP_DOWNLINK_UNICAST, UDP_DOWNLINK_BROADCAST or UDP_DOWNLINK_MULTICAST
+extern char UDP_MULTICAST_GROUP[16];    // IPv4 multicast group used with UDP_DOWNLINK_MULTICAST
 extern EventGroupHandle_t wifi_event_group;
 
 #endif //DB_ESP32_GLOBALS_H
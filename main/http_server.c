@@ -18,19 +18,28 @@
  */
 
 #include <sys/socket.h>
+#include <lwip/inet.h>
 #include <freertos/event_groups.h>
 #include <esp_log.h>
 #include <string.h>
-#include <nvs.h>
+#include <ctype.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "globals.h"
+#include "db_packer.h"
+#include "db_metrics.h"
+#include "db_latency.h"
+#include "db_platform.h"
+#include "db_esp32_settings.h"
+#include "http_server.h"
 #include <math.h>
 #include <driver/gpio.h>
 
 #define LISTENQ 2
 #define REQUEST_BUF_SIZE 1024
-#define WEBSITE_RESPONSE_BUFFER_SIZE 3072
+#define WEBSITE_RESPONSE_BUFFER_SIZE 5120
+#define UART_MIN_BUF_SIZE 256      // UART driver needs more than the 128 byte HW FIFO
+#define UART_MAX_BUF_SIZE 32768
 #define TAG "TCP_SERVER"
 
 const char *save_response = "HTTP/1.1 200 OK\r\n"
@@ -61,6 +70,12 @@ const char *save_response = "HTTP/1.1 200 OK\r\n"
                             "</html>\n"
                             "";
 
+const char *json_header = "HTTP/1.1 200 OK\r\n"
+                          "Server: DroneBridgeESP32\r\n"
+                          "Content-Type: application/json\r\n"
+                          "Cache-Control: no-cache\r\n"
+                          "\r\n";
+
 const char *bad_gateway = "HTTP/1.1 502 Bad Gateway \r\n"
                           "Server: DroneBridgeESP32 \r\n"
                           "Content-Type: text/html \r\n"
@@ -70,34 +85,45 @@ const char *bad_gateway = "HTTP/1.1 502 Bad Gateway \r\n"
  * @brief Check if we got a simple request or new settings
  * @param request_buffer
  * @param length
- * @return 0 if GET-Request, 1 if new settings, -1 if none
+ * @return 0 if GET-Request, 1 if new settings, 3 if metrics, 4 if latency, 5 if latency & reset, 2 any other GET,
+ * -1 if none
  */
 int http_request_type(uint8_t *request_buffer, uint length) {
     uint8_t http_get_header[] = {'G', 'E', 'T', ' ', '/', ' ', 'H', 'T', 'T', 'P'};
     uint8_t http_get_header_settings[] = {'G', 'E', 'T', ' ', '/', 's', 'e', 't', 't', 'i', 'n', 'g', 's'};
+    uint8_t http_get_header_metrics[] = {'G', 'E', 'T', ' ', '/', 'm', 'e', 't', 'r', 'i', 'c', 's'};
+    const char *http_get_header_latency = "GET /latency";
+    const char *http_get_header_latency_reset = "GET /latency?reset";
     uint8_t http_get_header_other_data[] = {'G', 'E', 'T', ' ', '/'};
     if (memcmp(request_buffer, http_get_header, sizeof(http_get_header)) == 0) return 0;
     if (memcmp(request_buffer, http_get_header_settings, sizeof(http_get_header_settings)) == 0) return 1;
+    if (memcmp(request_buffer, http_get_header_metrics, sizeof(http_get_header_metrics)) == 0) return 3;
+    if (memcmp(request_buffer, http_get_header_latency_reset, strlen(http_get_header_latency_reset)) == 0) return 5;
+    if (memcmp(request_buffer, http_get_header_latency, strlen(http_get_header_latency)) == 0) return 4;
     if (memcmp(request_buffer, http_get_header_other_data, sizeof(http_get_header_other_data)) == 0) return 2;
     return -1;
 }
 
 
-void write_settings_to_nvs() {
-    ESP_LOGI(TAG, "Saving to NVS");
-    nvs_handle my_handle;
-    ESP_ERROR_CHECK(nvs_open("settings", NVS_READWRITE, &my_handle));
-    ESP_ERROR_CHECK(nvs_set_str(my_handle, "ssid", (char *) DEFAULT_SSID));
-    ESP_ERROR_CHECK(nvs_set_str(my_handle, "wifi_pass", (char *) DEFAULT_PWD));
-    ESP_ERROR_CHECK(nvs_set_u8(my_handle, "wifi_chan", DEFAULT_CHANNEL));
-    ESP_ERROR_CHECK(nvs_set_u32(my_handle, "baud", DB_UART_BAUD_RATE));
-    ESP_ERROR_CHECK(nvs_set_u8(my_handle, "gpio_tx", DB_UART_PIN_TX));
-    ESP_ERROR_CHECK(nvs_set_u8(my_handle, "gpio_rx", DB_UART_PIN_RX));
-    ESP_ERROR_CHECK(nvs_set_u8(my_handle, "proto", SERIAL_PROTOCOL));
-    ESP_ERROR_CHECK(nvs_set_u16(my_handle, "trans_pack_size", TRANSPARENT_BUF_SIZE));
-    ESP_ERROR_CHECK(nvs_set_u8(my_handle, "ltm_per_packet", LTM_FRAME_NUM_BUFFER));
-    ESP_ERROR_CHECK(nvs_commit(my_handle));
-    nvs_close(my_handle);
+/**
+ * Decodes %XX escapes of a GET parameter value
+ *
+ * @param dst Destination buffer
+ * @param src URL encoded string
+ * @param dst_size Size of dst incl. terminating 0
+ */
+void url_decode(char *dst, const char *src, size_t dst_size) {
+    size_t i = 0;
+    while (*src != '\0' && i < dst_size - 1) {
+        if (src[0] == '%' && isxdigit((unsigned char) src[1]) && isxdigit((unsigned char) src[2])) {
+            char hex[3] = {src[1], src[2], '\0'};
+            dst[i++] = (char) strtol(hex, NULL, 16);
+            src += 3;
+        } else {
+            dst[i++] = *src++;
+        }
+    }
+    dst[i] = '\0';
 }
 
 
@@ -138,10 +164,29 @@ void parse_save_get_parameters(char *request_buffer, uint length) {
             ptr = strtok(NULL, delimiter);
             if (atoi(ptr) <= GPIO_NUM_MAX) DB_UART_PIN_RX = atoi(ptr);
             ESP_LOGI(TAG, "New gpio_rx: %i", DB_UART_PIN_RX);
+        } else if (strcmp(ptr, "uart_rx_buf") == 0) {
+            ptr = strtok(NULL, delimiter);
+            if (atoi(ptr) >= UART_MIN_BUF_SIZE && atoi(ptr) <= UART_MAX_BUF_SIZE) DB_UART_RX_BUF_SIZE = atoi(ptr);
+            ESP_LOGI(TAG, "New uart_rx_buf: %i", DB_UART_RX_BUF_SIZE);
+        } else if (strcmp(ptr, "uart_tx_buf") == 0) {
+            ptr = strtok(NULL, delimiter);
+            if (atoi(ptr) == 0 || (atoi(ptr) >= UART_MIN_BUF_SIZE && atoi(ptr) <= UART_MAX_BUF_SIZE))
+                DB_UART_TX_BUF_SIZE = atoi(ptr);
+            ESP_LOGI(TAG, "New uart_tx_buf: %i", DB_UART_TX_BUF_SIZE);
+        } else if (strcmp(ptr, "uart_rx_thresh") == 0) {
+            ptr = strtok(NULL, delimiter);
+            if (atoi(ptr) >= 1 && atoi(ptr) <= 127) DB_UART_RX_THRESH = atoi(ptr);
+            ESP_LOGI(TAG, "New uart_rx_thresh: %i", DB_UART_RX_THRESH);
+        } else if (strcmp(ptr, "uart_rx_tout") == 0) {
+            ptr = strtok(NULL, delimiter);
+            if (atoi(ptr) >= 1 && atoi(ptr) <= 126) DB_UART_RX_TIMEOUT = atoi(ptr);
+            ESP_LOGI(TAG, "New uart_rx_tout: %i", DB_UART_RX_TIMEOUT);
         } else if (strcmp(ptr, "proto") == 0) {
             ptr = strtok(NULL, delimiter);
             if (strcmp(ptr, "msp_ltm") == 0) {
                 SERIAL_PROTOCOL = 2;
+            } else if (strcmp(ptr, "mavlink") == 0) {
+                SERIAL_PROTOCOL = 3;
             } else {
                 SERIAL_PROTOCOL = 4;
             }
@@ -150,10 +195,41 @@ void parse_save_get_parameters(char *request_buffer, uint length) {
             ptr = strtok(NULL, delimiter);
             TRANSPARENT_BUF_SIZE = atoi(ptr);
             ESP_LOGI(TAG, "New trans_pack_size: %i", TRANSPARENT_BUF_SIZE);
-        } else if (strcmp(ptr, "ltm_per_packet") == 0) {
+        } else if (strcmp(ptr, "msp_ltm_size") == 0) {
+            ptr = strtok(NULL, delimiter);
+            if (atoi(ptr) >= 0 && atoi(ptr) <= DB_PACKER_MAX_SIZE) MSP_LTM_PACKET_SIZE = atoi(ptr);
+            ESP_LOGI(TAG, "New msp_ltm_size: %i", MSP_LTM_PACKET_SIZE);
+        } else if (strcmp(ptr, "hold_time_us") == 0) {
+            ptr = strtok(NULL, delimiter);
+            if (atoi(ptr) >= 0) SERIAL_HOLD_TIME_US = atoi(ptr);
+            ESP_LOGI(TAG, "New hold_time_us: %i", SERIAL_HOLD_TIME_US);
+        } else if (strcmp(ptr, "msp_poll") == 0) {
             ptr = strtok(NULL, delimiter);
-            LTM_FRAME_NUM_BUFFER = atoi(ptr);
-            ESP_LOGI(TAG, "New ltm_per_packet: %i", LTM_FRAME_NUM_BUFFER);
+            // empty value: strtok already returned the next parameter name. It gets handled in the next iteration
+            if (ptr != NULL && isdigit((unsigned char) ptr[0])) {
+                url_decode(MSP_POLL_LIST, ptr, sizeof(MSP_POLL_LIST));
+            } else {
+                MSP_POLL_LIST[0] = '\0';
+            }
+            ESP_LOGI(TAG, "New msp_poll: %s", MSP_POLL_LIST);
+        } else if (strcmp(ptr, "udp_mode") == 0) {
+            ptr = strtok(NULL, delimiter);
+            if (strcmp(ptr, "broadcast") == 0) {
+                UDP_DOWNLINK_MODE = UDP_DOWNLINK_BROADCAST;
+            } else if (strcmp(ptr, "multicast") == 0) {
+                UDP_DOWNLINK_MODE = UDP_DOWNLINK_MULTICAST;
+            } else {
+                UDP_DOWNLINK_MODE = UDP_DOWNLINK_UNICAST;
+            }
+            ESP_LOGI(TAG, "New udp_mode: %i", UDP_DOWNLINK_MODE);
+        } else if (strcmp(ptr, "mcast_group") == 0) {
+            ptr = strtok(NULL, delimiter);
+            struct in_addr group;
+            if (ptr != NULL && strlen(ptr) < sizeof(UDP_MULTICAST_GROUP) && inet_aton(ptr, &group) &&
+                IN_MULTICAST(ntohl(group.s_addr))) {
+                strcpy(UDP_MULTICAST_GROUP, ptr);
+            }
+            ESP_LOGI(TAG, "New mcast_group: %s", UDP_MULTICAST_GROUP);
         } else {
             ptr = strtok(NULL, delimiter);
         }
@@ -166,15 +242,13 @@ char *create_response(char *website_response) {
     char baud_selection[14][9] = {""};
     char uart_serial_selection1[9] = "";
     char uart_serial_selection2[9] = "";
+    char uart_serial_selection3[9] = "";
     char trans_pack_size_selection1[9] = "";
     char trans_pack_size_selection2[9] = "";
     char trans_pack_size_selection3[9] = "";
     char trans_pack_size_selection4[9] = "";
     char trans_pack_size_selection5[9] = "";
-    char ltm_size_selection1[9] = "";
-    char ltm_size_selection2[9] = "";
-    char ltm_size_selection3[9] = "";
-    char ltm_size_selection4[9] = "", ltm_size_selection5[9] = "";
+    char udp_mode_selection[3][9] = {""};
 
     switch (SERIAL_PROTOCOL) {
         default:
@@ -183,6 +257,8 @@ char *create_response(char *website_response) {
             strcpy(uart_serial_selection1, "selected");
             break;
         case 3:
+            strcpy(uart_serial_selection3, "selected");
+            break;
         case 4:
         case 5:
             strcpy(uart_serial_selection2, "selected");
@@ -206,24 +282,6 @@ char *create_response(char *website_response) {
             strcpy(trans_pack_size_selection5, "selected");
             break;
     }
-    switch (LTM_FRAME_NUM_BUFFER) {
-        default:
-        case 1:
-            strcpy(ltm_size_selection1, "selected");
-            break;
-        case 2:
-            strcpy(ltm_size_selection2, "selected");
-            break;
-        case 3:
-            strcpy(ltm_size_selection3, "selected");
-            break;
-        case 4:
-            strcpy(ltm_size_selection4, "selected");
-            break;
-        case 5:
-            strcpy(ltm_size_selection5, "selected");
-            break;
-    }
     switch (DB_UART_BAUD_RATE) {
         default:
         case 5000000:
@@ -269,6 +327,7 @@ char *create_response(char *website_response) {
             strcpy(baud_selection[13], "selected");
             break;
     }
+    strcpy(udp_mode_selection[UDP_DOWNLINK_MODE <= UDP_DOWNLINK_MULTICAST ? UDP_DOWNLINK_MODE : 0], "selected");
     char build_version[16];
     sprintf(build_version, "v%.2f", floorf(BUILDVERSION) / 100);
     sprintf(website_response, "HTTP/1.1 200 OK\r\n"
@@ -317,10 +376,17 @@ char *create_response(char *website_response) {
                               "<td><input type=\"text\" name=\"gpio_tx\" value=\"%i\"></td></tr>"
                               "<tr><td>GPIO RX pin number</td><td>"
                               "<input type=\"text\" name=\"gpio_rx\" value=\"%i\">"
+                              "</td></tr><tr><td>UART RX/TX buffer [bytes]</td><td>"
+                              "<input type=\"number\" name=\"uart_rx_buf\" min=\"256\" max=\"32768\" value=\"%i\">"
+                              "<input type=\"number\" name=\"uart_tx_buf\" min=\"0\" max=\"32768\" value=\"%i\">"
+                              "</td></tr><tr><td>UART RX FIFO threshold [bytes]/timeout [symbols]</td><td>"
+                              "<input type=\"number\" name=\"uart_rx_thresh\" min=\"1\" max=\"127\" value=\"%i\">"
+                              "<input type=\"number\" name=\"uart_rx_tout\" min=\"1\" max=\"126\" value=\"%i\">"
                               "</td></tr><tr><td>UART serial protocol</td><td>"
                               "<select name=\"proto\" form=\"settings_form\">"
                               "<option %s value=\"msp_ltm\">MSP/LTM</option>"
-                              "<option %s value=\"trans\">Transparent/MAVLink</option>"
+                              "<option %s value=\"mavlink\">MAVLink</option>"
+                              "<option %s value=\"trans\">Transparent</option>"
                               "</select>"
                               "</td></tr><tr><td>Transparent packet size</td><td>"
                               "<select name=\"trans_pack_size\" form=\"settings_form\">"
@@ -328,14 +394,20 @@ char *create_response(char *website_response) {
                               "<option %s value=\"64\">64</option><option %s value=\"128\">128</option>"
                               "<option %s value=\"256\">256</option>"
                               "</select>"
-                              "</td></tr><tr><td>LTM frames per packet</td><td>"
-                              "<select name=\"ltm_per_packet\" form=\"settings_form\">"
-                              "<option %s value=\"1\">1</option>"
-                              "<option %s value=\"2\">2</option>"
-                              "<option %s value=\"3\">3</option>"
-                              "<option %s value=\"4\">4</option>"
-                              "<option %s value=\"5\">5</option>"
+                              "</td></tr><tr><td>MSP/LTM packet size [bytes]</td><td>"
+                              "<input type=\"number\" name=\"msp_ltm_size\" min=\"0\" max=\"1472\" value=\"%i\">"
+                              "</td></tr><tr><td>MSP commands polled by ESP32 [cmd:Hz,...]</td><td>"
+                              "<input type=\"text\" name=\"msp_poll\" maxlength=\"63\" value=\"%s\">"
+                              "</td></tr><tr><td>Max. packet hold time [us]</td><td>"
+                              "<input type=\"number\" name=\"hold_time_us\" min=\"0\" value=\"%i\">"
+                              "</td></tr><tr><td>UDP downlink</td><td>"
+                              "<select name=\"udp_mode\" form=\"settings_form\">"
+                              "<option %s value=\"unicast\">Unicast</option>"
+                              "<option %s value=\"broadcast\">Broadcast</option>"
+                              "<option %s value=\"multicast\">Multicast</option>"
                               "</select>"
+                              "</td></tr><tr><td>UDP multicast group</td><td>"
+                              "<input type=\"text\" name=\"mcast_group\" maxlength=\"15\" value=\"%s\">"
 
                               "</td></tr><tr><td></td><td>"
                               "</td></tr></tbody></table><p></p>"
@@ -345,19 +417,53 @@ char *create_response(char *website_response) {
                               "<p class=\"foot\">%s</p>\n"
                               "<p class=\"foot\">&copy; Wolfgang Christl 2018 - Apache 2.0 License</p>"
                               "</body></html>\n"
-                              "", DEFAULT_SSID, DEFAULT_PWD, DEFAULT_CHANNEL, baud_selection[0], baud_selection[1], baud_selection[2], baud_selection[3], baud_selection[4], baud_selection[5], baud_selection[6], baud_selection[7], baud_selection[8], baud_selection[9], baud_selection[10],  baud_selection[11], baud_selection[12], baud_selection[13], DB_UART_PIN_TX, DB_UART_PIN_RX, uart_serial_selection1,
-            uart_serial_selection2, trans_pack_size_selection1, trans_pack_size_selection2, trans_pack_size_selection3,
-            trans_pack_size_selection4, trans_pack_size_selection5, ltm_size_selection1, ltm_size_selection2,
-            ltm_size_selection3, ltm_size_selection4, ltm_size_selection5, build_version);
+                              "", DEFAULT_SSID, DEFAULT_PWD, DEFAULT_CHANNEL, baud_selection[0], baud_selection[1], baud_selection[2], baud_selection[3], baud_selection[4], baud_selection[5], baud_selection[6], baud_selection[7], baud_selection[8], baud_selection[9], baud_selection[10],  baud_selection[11], baud_selection[12], baud_selection[13], DB_UART_PIN_TX, DB_UART_PIN_RX,
+            DB_UART_RX_BUF_SIZE, DB_UART_TX_BUF_SIZE, DB_UART_RX_THRESH, DB_UART_RX_TIMEOUT, uart_serial_selection1,
+            uart_serial_selection3, uart_serial_selection2, trans_pack_size_selection1, trans_pack_size_selection2, trans_pack_size_selection3,
+            trans_pack_size_selection4, trans_pack_size_selection5, MSP_LTM_PACKET_SIZE, MSP_POLL_LIST,
+            SERIAL_HOLD_TIME_US, udp_mode_selection[0], udp_mode_selection[1], udp_mode_selection[2],
+            UDP_MULTICAST_GROUP, build_version);
     return website_response;
 }
 
+/**
+ * @brief Sends a JSON object compactly. Frees the object
+ * @return false if sending failed
+ */
+bool send_json(int client_socket, cJSON *object) {
+    char *json = object != NULL ? cJSON_PrintUnformatted(object) : NULL;
+    cJSON_Delete(object);
+    if (json == NULL) return write(client_socket, bad_gateway, strlen(bad_gateway)) >= 0;
+    bool success = write(client_socket, json_header, strlen(json_header)) >= 0 &&
+                   write(client_socket, json, strlen(json)) >= 0;
+    free(json);
+    return success;
+}
+
+/**
+ * @brief Sends the data path counters of the control module as compact JSON
+ * @return false if sending failed
+ */
+bool send_metrics(int client_socket) {
+    return send_json(client_socket, db_metrics_to_json());
+}
+
+/**
+ * @brief Sends the latency histograms of the downlink as compact JSON. Histograms are cleared afterwards if requested
+ * @return false if sending failed
+ */
+bool send_latency(int client_socket, bool reset) {
+    bool success = send_json(client_socket, db_latency_to_json());
+    if (reset) db_latency_reset();
+    return success;
+}
+
 void http_settings_server(void *parameter) {
     ESP_LOGI(TAG, "http_settings_server task started");
     struct sockaddr_in tcpServerAddr;
     tcpServerAddr.sin_addr.s_addr = htonl(INADDR_ANY);
     tcpServerAddr.sin_family = AF_INET;
-    tcpServerAddr.sin_port = htons(80);
+    tcpServerAddr.sin_port = htons(HTTP_SERVER_PORT);
     int tcp_socket, r;
     char recv_buf[64];
     static struct sockaddr_in remote_addr;
@@ -424,6 +530,20 @@ void http_settings_server(void *parameter) {
                     vTaskDelay(4000 / portTICK_PERIOD_MS);
                     continue;
                 }
+            } else if (http_req == 3) {
+                if (!send_metrics(client_socket)) {
+                    ESP_LOGE(TAG, "... Send failed");
+                    close(tcp_socket);
+                    vTaskDelay(4000 / portTICK_PERIOD_MS);
+                    continue;
+                }
+            } else if (http_req == 4 || http_req == 5) {
+                if (!send_latency(client_socket, http_req == 5)) {
+                    ESP_LOGE(TAG, "... Send failed");
+                    close(tcp_socket);
+                    vTaskDelay(4000 / portTICK_PERIOD_MS);
+                    continue;
+                }
             } else if (http_req == 2) {
                 if (write(client_socket, bad_gateway, strlen(bad_gateway)) < 0) {
                     ESP_LOGE(TAG, "... Send failed");
@@ -447,5 +567,5 @@ void http_settings_server(void *parameter) {
  * @brief Starts a TCP server that serves the page to change settings & handles the changes
  */
 void start_tcp_server() {
-    xTaskCreate(&http_settings_server, "http_settings_server", 10240, NULL, 5, NULL);
+    db_task_create(&http_settings_server, "http_settings_server", 11264, 5, DB_TASK_NO_AFFINITY);
 }
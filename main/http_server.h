@@ -20,7 +20,10 @@
 #ifndef DB_ESP32_HTTP_SERVER_H
 #define DB_ESP32_HTTP_SERVER_H
 
+#ifndef HTTP_SERVER_PORT
+#define HTTP_SERVER_PORT 80     // settings page & /metrics
+#endif
+
 void start_tcp_server();
-void write_settings_to_nvs();
 
 #endif //DB_ESP32_HTTP_SERVER_H
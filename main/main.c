@@ -22,15 +22,16 @@
 #include <esp_wifi_types.h>
 #include <mdns.h>
 #include <string.h>
-#include <driver/gpio.h>
 #include "freertos/event_groups.h"
 #include "esp_wifi.h"
 #include "esp_log.h"
 #include "esp_event.h"
 #include "db_esp32_control.h"
 #include "http_server.h"
+#include "db_esp32_settings.h"
 #include "db_esp32_comm.h"
 #include "db_protocol.h"
+#include "globals.h"
 
 #define STA_MAXIMUM_RETRY 3
 
@@ -38,16 +39,6 @@ EventGroupHandle_t wifi_event_group;
 static const char *TAG = "DB_ESP32";
 static int s_retry_num = 0;
 
-uint8_t DEFAULT_SSID[32] = "DroneBridge ESP32";
-uint8_t DEFAULT_PWD[64] = "dronebridge";
-uint8_t DEFAULT_CHANNEL = 6;
-uint8_t SERIAL_PROTOCOL = 2;  // 1,2=MSP, 3,4,5=MAVLink/transparent
-uint8_t DB_UART_PIN_TX = GPIO_NUM_17;
-uint8_t DB_UART_PIN_RX = GPIO_NUM_16;
-uint32_t DB_UART_BAUD_RATE = 115200;
-uint16_t TRANSPARENT_BUF_SIZE = 64;
-uint8_t LTM_FRAME_NUM_BUFFER = 1;
-
 void init_wifi_ap();
 void init_wifi_sta();
 
@@ -58,21 +49,22 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t e
     if(event_base==WIFI_EVENT)
     {
 	switch (event_id) {
-        case SYSTEM_EVENT_AP_START:
+        case WIFI_EVENT_AP_START:
             ESP_LOGI(TAG, "Wifi AP started!");
             xEventGroupSetBits(wifi_event_group, BIT2);
             break;
-        case SYSTEM_EVENT_AP_STOP:
+        case WIFI_EVENT_AP_STOP:
             ESP_LOGI(TAG, "Wifi AP stopped!");
             break;
-        case SYSTEM_EVENT_AP_STACONNECTED:
+        case WIFI_EVENT_AP_STACONNECTED:
             event = (wifi_event_ap_staconnected_t *) event_data;
             ESP_LOGI(TAG, "Client connected - station:"MACSTR", AID=%d", MAC2STR(event->mac), event->aid);
             break;
-        case SYSTEM_EVENT_AP_STADISCONNECTED:
+        case WIFI_EVENT_AP_STADISCONNECTED:
             evente = (wifi_event_ap_stadisconnected_t*) event_data;
             ESP_LOGI(TAG, "Client disconnected - station:"MACSTR", AID=%d",
                      MAC2STR(evente->mac), evente->aid);
+            db_station_disconnected(evente->mac);
             break;
         case WIFI_EVENT_STA_START:
             esp_wifi_connect();
@@ -101,6 +93,12 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t e
 	//ESP_ERROR_CHECK(tcpip_adapter_sta_start(TCPIP_ADAPTER_IF_STA, &event->ip_info));
 	xEventGroupSetBits(wifi_event_group, BIT0|BIT2);
     }
+    else if(event_base==IP_EVENT && event_id==IP_EVENT_AP_STAIPASSIGNED)
+    {
+	ip_event_ap_staipassigned_t* event = (ip_event_ap_staipassigned_t*) event_data;
+	ESP_LOGI(TAG, "Station got ip:" IPSTR, IP2STR(&event->ip));
+	db_station_ip_assigned(event->ip.addr);
+    }
 }
 
 void start_mdns_service()
@@ -115,7 +113,7 @@ void start_mdns_service()
     ESP_ERROR_CHECK(mdns_hostname_set("dronebridge"));
     ESP_ERROR_CHECK(mdns_instance_name_set("DroneBridge for ESP32"));
 
-    ESP_ERROR_CHECK(mdns_service_add(NULL, "_http", "_tcp", 80, NULL, 0));
+    ESP_ERROR_CHECK(mdns_service_add(NULL, "_http", "_tcp", HTTP_SERVER_PORT, NULL, 0));
     ESP_ERROR_CHECK(mdns_service_add(NULL, "_db_proxy", "_tcp", APP_PORT_PROXY, NULL, 0));
     ESP_ERROR_CHECK(mdns_service_add(NULL, "_db_comm", "_tcp", APP_PORT_COMM, NULL, 0));
     ESP_ERROR_CHECK(mdns_service_instance_name_set("_http", "_tcp", "DroneBridge for ESP32"));
@@ -187,6 +185,7 @@ void init_wifi(){
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_AP_STAIPASSIGNED, &wifi_event_handler, NULL));
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
@@ -209,39 +208,6 @@ void init_wifi(){
 }
 
 
-void read_settings_nvs(){
-    nvs_handle my_handle;
-    if (nvs_open("settings", NVS_READONLY, &my_handle) == ESP_ERR_NVS_NOT_FOUND){
-        // First start
-        nvs_close(my_handle);
-        write_settings_to_nvs();
-    } else {
-        ESP_LOGI(TAG, "Reading settings from NVS");
-        size_t required_size = 0;
-        ESP_ERROR_CHECK(nvs_get_str(my_handle, "ssid", NULL, &required_size));
-        char* ssid = malloc(required_size);
-        ESP_ERROR_CHECK(nvs_get_str(my_handle, "ssid", ssid, &required_size));
-        memcpy(DEFAULT_SSID, ssid, required_size);
-
-        ESP_ERROR_CHECK(nvs_get_str(my_handle, "wifi_pass", NULL, &required_size));
-        char* wifi_pass = malloc(required_size);
-        ESP_ERROR_CHECK(nvs_get_str(my_handle, "wifi_pass", wifi_pass, &required_size));
-        memcpy(DEFAULT_PWD, wifi_pass, required_size);
-
-        ESP_ERROR_CHECK(nvs_get_u8(my_handle, "wifi_chan", &DEFAULT_CHANNEL));
-        ESP_ERROR_CHECK(nvs_get_u32(my_handle, "baud", &DB_UART_BAUD_RATE));
-        ESP_ERROR_CHECK(nvs_get_u8(my_handle, "gpio_tx", &DB_UART_PIN_TX));
-        ESP_ERROR_CHECK(nvs_get_u8(my_handle, "gpio_rx", &DB_UART_PIN_RX));
-        ESP_ERROR_CHECK(nvs_get_u8(my_handle, "proto", &SERIAL_PROTOCOL));
-        ESP_ERROR_CHECK(nvs_get_u16(my_handle, "trans_pack_size", &TRANSPARENT_BUF_SIZE));
-        ESP_ERROR_CHECK(nvs_get_u8(my_handle, "ltm_per_packet", &LTM_FRAME_NUM_BUFFER));
-        nvs_close(my_handle);
-        free(wifi_pass);
-        free(ssid);
-    }
-}
-
-
 void app_main()
 {
     esp_err_t ret = nvs_flash_init();
@@ -0,0 +1,89 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#include <string.h>
+#include "mavlink_router.h"
+
+// Only used by the network task
+static mavlink_route_t mavlink_routes[MAVLINK_ROUTER_MAX_ROUTES];
+
+void mavlink_router_init() {
+    memset(mavlink_routes, 0, sizeof(mavlink_routes));
+}
+
+static bool same_link(const mavlink_route_t *route, int tcp_index, int tcp_socket, const struct sockaddr_in *udp_addr) {
+    if (route->tcp_index != tcp_index) return false;
+    if (tcp_index >= 0) return route->tcp_socket == tcp_socket;
+    return route->udp_addr.sin_addr.s_addr == udp_addr->sin_addr.s_addr &&
+           route->udp_addr.sin_port == udp_addr->sin_port;
+}
+
+/**
+ * Remembers the client link a MAVLink system sent a message from
+ *
+ * @param system_id Sender of the message
+ * @param tcp_index Index of the TCP client. -1 for UDP
+ * @param tcp_socket Socket of the TCP client. Ignored for UDP
+ * @param udp_addr Address of the UDP client. Ignored for TCP
+ * @param now Current time in us
+ */
+void mavlink_router_learn(uint8_t system_id, int tcp_index, int tcp_socket, const struct sockaddr_in *udp_addr,
+                          int64_t now) {
+    mavlink_route_t *route = NULL;
+    mavlink_route_t *oldest = &mavlink_routes[0];
+    for (int i = 0; i < MAVLINK_ROUTER_MAX_ROUTES; i++) {
+        mavlink_route_t *candidate = &mavlink_routes[i];
+        if (candidate->used && candidate->system_id == system_id &&
+            same_link(candidate, tcp_index, tcp_socket, udp_addr)) {
+            candidate->last_seen = now;
+            return;
+        }
+        if (route == NULL && (!candidate->used || now - candidate->last_seen > MAVLINK_ROUTER_TIMEOUT_US))
+            route = candidate;
+        if (candidate->last_seen < oldest->last_seen) oldest = candidate;
+    }
+    if (route == NULL) route = oldest;  // table full - replace the route that was not used for the longest time
+    memset(route, 0, sizeof(mavlink_route_t));
+    route->used = true;
+    route->system_id = system_id;
+    route->tcp_index = tcp_index;
+    route->tcp_socket = tcp_socket;
+    if (tcp_index < 0) route->udp_addr = *udp_addr;
+    route->last_seen = now;
+}
+
+/**
+ * Finds all client links a MAVLink system was seen on
+ *
+ * @param system_id Target system of a message
+ * @param now Current time in us
+ * @param routes Filled with the links of the system
+ * @param max_routes Size of routes
+ * @return Number of links. 0 if the system is unknown
+ */
+int mavlink_router_find(uint8_t system_id, int64_t now, const mavlink_route_t *routes[], int max_routes) {
+    int found = 0;
+    for (int i = 0; i < MAVLINK_ROUTER_MAX_ROUTES && found < max_routes; i++) {
+        if (mavlink_routes[i].used && mavlink_routes[i].system_id == system_id &&
+            now - mavlink_routes[i].last_seen <= MAVLINK_ROUTER_TIMEOUT_US) {
+            routes[found++] = &mavlink_routes[i];
+        }
+    }
+    return found;
+}
@@ -0,0 +1,47 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#ifndef DB_ESP32_MAVLINK_ROUTER_H
+#define DB_ESP32_MAVLINK_ROUTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lwip/sockets.h"
+
+#define MAVLINK_ROUTER_MAX_ROUTES 16
+#define MAVLINK_ROUTER_TIMEOUT_US 10000000  // route is forgotten if the system was not heard of for this long
+
+/**
+ * Client link a MAVLink system was seen on. Either a TCP client or a UDP endpoint
+ */
+typedef struct {
+    bool used;
+    uint8_t system_id;
+    int tcp_index;                  // -1 for UDP
+    int tcp_socket;                 // detects that the TCP slot was reused by another client
+    struct sockaddr_in udp_addr;
+    int64_t last_seen;
+} mavlink_route_t;
+
+void mavlink_router_init();
+void mavlink_router_learn(uint8_t system_id, int tcp_index, int tcp_socket, const struct sockaddr_in *udp_addr,
+                          int64_t now);
+int mavlink_router_find(uint8_t system_id, int64_t now, const mavlink_route_t *routes[], int max_routes);
+
+#endif //DB_ESP32_MAVLINK_ROUTER_H
@@ -0,0 +1,296 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "mavlink_serial.h"
+#include "db_crc.h"
+
+typedef struct {
+    uint32_t msg_id;
+    uint8_t crc_extra;
+} mavlink_crc_extra_t;
+
+/**
+ * CRC_EXTRA seeds of the MAVLink common message set plus frequently used ArduPilot messages. Sorted by msg_id.
+ * Frames with a message ID not listed here are passed on without CRC check. See frame_crc_ok()
+ */
+static const mavlink_crc_extra_t mavlink_crc_extras[] = {
+        {0, 50}, {1, 124}, {2, 137}, {4, 237}, {5, 217}, {6, 104}, {7, 119}, {11, 89}, {20, 214}, {21, 159},
+        {22, 220}, {23, 168}, {24, 24}, {25, 23}, {26, 170}, {27, 144}, {28, 67}, {29, 115}, {30, 39}, {31, 246},
+        {32, 185}, {33, 104}, {34, 237}, {35, 244}, {36, 222}, {37, 212}, {38, 9}, {39, 254}, {40, 230}, {41, 28},
+        {42, 28}, {43, 132}, {44, 221}, {45, 232}, {46, 11}, {47, 153}, {48, 41}, {49, 39}, {50, 78}, {51, 196},
+        {54, 15}, {55, 3}, {61, 167}, {62, 183}, {63, 119}, {64, 191}, {65, 118}, {66, 148}, {67, 21}, {69, 243},
+        {70, 124}, {73, 38}, {74, 20}, {75, 158}, {76, 152}, {77, 143}, {81, 106}, {82, 49}, {83, 22}, {84, 143},
+        {85, 140}, {86, 5}, {87, 150}, {89, 231}, {90, 183}, {91, 63}, {92, 54}, {93, 47}, {100, 175}, {101, 102},
+        {102, 158}, {103, 208}, {104, 56}, {105, 93}, {106, 138}, {107, 108}, {108, 32}, {109, 185}, {110, 84},
+        {111, 34}, {112, 174}, {113, 124}, {114, 237}, {115, 4}, {116, 76}, {117, 128}, {118, 56}, {119, 116},
+        {120, 134}, {121, 237}, {122, 203}, {123, 250}, {124, 87}, {125, 203}, {126, 220}, {127, 25}, {128, 226},
+        {129, 46}, {130, 29}, {131, 223}, {132, 85}, {133, 6}, {134, 229}, {135, 203}, {136, 1}, {137, 195},
+        {138, 109}, {139, 168}, {140, 181}, {141, 47}, {142, 72}, {143, 131}, {144, 127}, {146, 103}, {147, 154},
+        {148, 178}, {149, 200}, {150, 134}, {152, 208}, {163, 127}, {165, 21}, {168, 1}, {178, 47}, {193, 71},
+        {230, 163}, {231, 105}, {232, 151}, {233, 35}, {234, 150}, {241, 90}, {242, 104}, {243, 85}, {244, 95},
+        {245, 130}, {246, 184}, {247, 81}, {248, 8}, {249, 204}, {250, 49}, {251, 170}, {252, 44}, {253, 83},
+        {254, 46}
+};
+
+/**
+ * Binary search for the CRC_EXTRA of a message
+ *
+ * @param msg_id MAVLink message ID
+ * @param crc_extra Set to the CRC_EXTRA of the message if found
+ * @return true if the message is known
+ */
+static bool get_crc_extra(uint32_t msg_id, uint8_t *crc_extra) {
+    int low = 0;
+    int high = (sizeof(mavlink_crc_extras) / sizeof(mavlink_crc_extras[0])) - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        if (mavlink_crc_extras[mid].msg_id == msg_id) {
+            *crc_extra = mavlink_crc_extras[mid].crc_extra;
+            return true;
+        } else if (mavlink_crc_extras[mid].msg_id < msg_id) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return false;
+}
+
+typedef struct {
+    uint32_t msg_id;
+    uint8_t target_system_ofs;      // payload offset of target_system
+    uint8_t target_component_ofs;   // payload offset of target_component. 0xFF if the message has none
+} mavlink_target_ofs_t;
+
+/**
+ * Payload offsets of the target fields of all routed messages of the common message set. Sorted by msg_id.
+ * Messages not listed here are broadcasts
+ */
+static const mavlink_target_ofs_t mavlink_target_offsets[] = {
+        {4, 12, 13}, {5, 0, 0xFF}, {11, 4, 0xFF}, {20, 2, 3}, {21, 0, 1}, {23, 4, 5}, {37, 4, 5}, {38, 4, 5},
+        {39, 32, 33}, {40, 2, 3}, {41, 2, 3}, {43, 0, 1}, {44, 2, 3}, {45, 0, 1}, {47, 0, 1}, {48, 12, 0xFF},
+        {51, 2, 3}, {54, 24, 25}, {66, 2, 3}, {69, 10, 0xFF}, {70, 16, 17}, {73, 32, 33}, {75, 30, 31},
+        {76, 30, 31}, {77, 8, 9}, {82, 36, 37}, {84, 50, 51}, {86, 50, 51}, {110, 1, 2}, {117, 4, 5},
+        {119, 10, 11}, {121, 0, 1}, {122, 0, 1}, {123, 0, 1}, {248, 3, 4}
+};
+
+/**
+ * Reads the addressed system & component of a complete and valid frame. MAVLink v2 strips trailing zero bytes of the
+ * payload - target fields that were cut off are 0.
+ *
+ * @param frame Complete frame
+ * @param target_system Set to the target system. 0 for broadcasts
+ * @param target_component Set to the target component. 0 for broadcasts & messages without a target component
+ * @return true if the message is addressed to a specific system
+ */
+bool get_mavlink_target(const uint8_t *frame, uint8_t *target_system, uint8_t *target_component) {
+    bool is_v2 = frame[0] == MAVLINK_STX_V2;
+    uint32_t msg_id = is_v2 ? (frame[7] | (frame[8] << 8) | ((uint32_t) frame[9] << 16)) : frame[5];
+    const uint8_t *payload = &frame[is_v2 ? MAVLINK_HEADER_LEN_V2 : MAVLINK_HEADER_LEN_V1];
+    uint8_t payload_len = frame[1];
+    *target_system = 0;
+    *target_component = 0;
+    int low = 0;
+    int high = (sizeof(mavlink_target_offsets) / sizeof(mavlink_target_offsets[0])) - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        const mavlink_target_ofs_t *ofs = &mavlink_target_offsets[mid];
+        if (ofs->msg_id == msg_id) {
+            if (ofs->target_system_ofs < payload_len) *target_system = payload[ofs->target_system_ofs];
+            if (ofs->target_component_ofs < payload_len) *target_component = payload[ofs->target_component_ofs];
+            break;
+        } else if (ofs->msg_id < msg_id) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return *target_system != 0;
+}
+
+/**
+ * @param frame Complete frame
+ * @return System ID of the sender
+ */
+uint8_t get_mavlink_source_system(const uint8_t *frame) {
+    return frame[0] == MAVLINK_STX_V2 ? frame[5] : frame[3];
+}
+
+typedef enum {
+    MAV_CRC_OK,
+    MAV_CRC_BAD,
+    MAV_CRC_UNKNOWN_MESSAGE
+} mavlink_crc_result_e;
+
+/**
+ * Checks the CRC of the complete frame in the frame buffer. The CRC of messages that are not in mavlink_crc_extras
+ * (other dialects, new messages) can not be checked - their CRC_EXTRA is not known.
+ *
+ * @return MAV_CRC_UNKNOWN_MESSAGE if the CRC_EXTRA of the message is not known
+ */
+static mavlink_crc_result_e frame_crc_ok(mavlink_port_t *mavlink_port) {
+    uint8_t crc_extra;
+    if (!get_crc_extra(mavlink_port->msg_id, &crc_extra)) return MAV_CRC_UNKNOWN_MESSAGE;
+    uint8_t *frame = mavlink_port->frame_buffer;
+    uint16_t header_len = (frame[0] == MAVLINK_STX_V2) ? MAVLINK_HEADER_LEN_V2 : MAVLINK_HEADER_LEN_V1;
+    uint16_t crc_pos = header_len + frame[1];
+    uint16_t frame_crc = frame[crc_pos] | (frame[crc_pos + 1] << 8);
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 1; i < crc_pos; i++) {
+        crc = crc_x25_accumulate(crc, frame[i]);
+    }
+    return crc_x25_accumulate(crc, crc_extra) == frame_crc ? MAV_CRC_OK : MAV_CRC_BAD;
+}
+
+void init_mavlink_port(mavlink_port_t *mavlink_port) {
+    mavlink_port->parse_state = MAV_IDLE;
+    mavlink_port->frame_length = 0;
+    mavlink_port->expected_length = 0;
+    mavlink_port->msg_id = 0;
+    mavlink_port->replay_length = 0;
+    mavlink_port->replay_pos = 0;
+    mavlink_port->validated = false;
+    mavlink_port->frames_received = 0;
+    mavlink_port->unvalidated = 0;
+    mavlink_port->bad_crcs = 0;
+    mavlink_port->resyncs = 0;
+    mavlink_port->on_skipped_byte = NULL;
+}
+
+/**
+ * Moves all bytes of the rejected frame except its start byte in front of the not yet replayed bytes. Another frame
+ * might start within the rejected one. The start byte is skipped.
+ */
+static void schedule_replay(mavlink_port_t *mavlink_port) {
+    if (mavlink_port->on_skipped_byte != NULL) mavlink_port->on_skipped_byte(mavlink_port->frame_buffer[0]);
+    uint16_t rejected = mavlink_port->frame_length - 1;
+    uint16_t remaining = mavlink_port->replay_length - mavlink_port->replay_pos;
+    memmove(&mavlink_port->replay_buffer[rejected], &mavlink_port->replay_buffer[mavlink_port->replay_pos], remaining);
+    memcpy(mavlink_port->replay_buffer, &mavlink_port->frame_buffer[1], rejected);
+    mavlink_port->replay_length = rejected + remaining;
+    mavlink_port->replay_pos = 0;
+    mavlink_port->frame_length = 0;
+    mavlink_port->parse_state = MAV_IDLE;
+}
+
+/**
+ * MAVLink v1 & v2 state machine. Processes one byte.
+ *
+ * @return false if the frame in progress was rejected and its bytes need to be parsed again
+ */
+static bool parse_mavlink_byte(mavlink_port_t *mavlink_port, uint8_t new_byte) {
+    switch (mavlink_port->parse_state) {
+        default:
+        case MAV_FRAME_RECEIVED:
+        case MAV_IDLE:
+            if (new_byte == MAVLINK_STX_V1 || new_byte == MAVLINK_STX_V2) {
+                mavlink_port->frame_buffer[0] = new_byte;
+                mavlink_port->frame_length = 1;
+                mavlink_port->parse_state = MAV_GOT_STX;
+            } else {
+                mavlink_port->parse_state = MAV_IDLE;
+                if (mavlink_port->on_skipped_byte != NULL) mavlink_port->on_skipped_byte(new_byte);
+            }
+            break;
+
+        case MAV_GOT_STX:
+            mavlink_port->frame_buffer[mavlink_port->frame_length++] = new_byte;
+            if (mavlink_port->frame_buffer[0] == MAVLINK_STX_V1) {
+                mavlink_port->expected_length = MAVLINK_HEADER_LEN_V1 + new_byte + MAVLINK_CHECKSUM_LEN;
+                mavlink_port->parse_state = MAV_FRAME_DATA;
+            } else {
+                mavlink_port->parse_state = MAV_GOT_LENGTH;  // need incompat flags to know the length
+            }
+            break;
+
+        case MAV_GOT_LENGTH:
+            mavlink_port->frame_buffer[mavlink_port->frame_length++] = new_byte;
+            if (new_byte & ~MAVLINK_IFLAG_SIGNED) {  // unknown incompatibility flag - must not process
+                mavlink_port->resyncs++;
+                return false;
+            }
+            mavlink_port->expected_length = MAVLINK_HEADER_LEN_V2 + mavlink_port->frame_buffer[1] +
+                                            MAVLINK_CHECKSUM_LEN;
+            if (new_byte & MAVLINK_IFLAG_SIGNED) mavlink_port->expected_length += MAVLINK_SIGNATURE_LEN;
+            mavlink_port->parse_state = MAV_FRAME_DATA;
+            break;
+
+        case MAV_FRAME_DATA:
+            mavlink_port->frame_buffer[mavlink_port->frame_length++] = new_byte;
+            if (mavlink_port->frame_length == mavlink_port->expected_length) {
+                uint8_t *frame = mavlink_port->frame_buffer;
+                if (frame[0] == MAVLINK_STX_V2) {
+                    mavlink_port->msg_id = frame[7] | (frame[8] << 8) | ((uint32_t) frame[9] << 16);
+                } else {
+                    mavlink_port->msg_id = frame[5];
+                }
+                switch (frame_crc_ok(mavlink_port)) {
+                    case MAV_CRC_BAD:
+                        mavlink_port->bad_crcs++;
+                        return false;
+                    case MAV_CRC_UNKNOWN_MESSAGE:
+                        mavlink_port->validated = false;
+                        mavlink_port->unvalidated++;
+                        break;
+                    default:
+                        mavlink_port->validated = true;
+                        mavlink_port->frames_received++;
+                        break;
+                }
+                mavlink_port->parse_state = MAV_FRAME_RECEIVED;
+            }
+            break;
+    }
+    return true;
+}
+
+/**
+ * Parses MAVLink v1 & v2 frames from a buffer. Validates the CRC (incl. CRC_EXTRA) of all known messages. Frames of
+ * unknown messages are returned as they are with validated = false - the frame ends where its length says. Returns
+ * after every complete frame so it must be called until it returns false:
+ *
+ *     size_t pos = 0;
+ *     while (parse_mavlink_buffer(&port, buf, len, &pos)) { use port.frame_buffer & port.frame_length }
+ *
+ * Frames may span multiple buffers. Bytes of rejected frames are parsed again to find frames starting within them.
+ *
+ * @param mavlink_port Parser state
+ * @param buf Bytes read from serial
+ * @param buf_len Number of bytes in buf
+ * @param buf_pos Position in buf to continue from. Updated by the parser
+ * @return true if a complete frame is in frame_buffer, false if all bytes are consumed
+ */
+bool parse_mavlink_buffer(mavlink_port_t *mavlink_port, const uint8_t *buf, size_t buf_len, size_t *buf_pos) {
+    while (mavlink_port->replay_pos < mavlink_port->replay_length || *buf_pos < buf_len) {
+        uint8_t new_byte;
+        if (mavlink_port->replay_pos < mavlink_port->replay_length) {
+            new_byte = mavlink_port->replay_buffer[mavlink_port->replay_pos++];
+        } else {
+            new_byte = buf[(*buf_pos)++];
+        }
+        if (!parse_mavlink_byte(mavlink_port, new_byte)) {
+            schedule_replay(mavlink_port);
+        } else if (mavlink_port->parse_state == MAV_FRAME_RECEIVED) {
+            return true;
+        }
+    }
+    return false;
+}
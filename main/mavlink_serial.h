@@ -0,0 +1,68 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#ifndef DB_ESP32_MAVLINK_SERIAL_H
+#define DB_ESP32_MAVLINK_SERIAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MAVLINK_STX_V1 0xFE
+#define MAVLINK_STX_V2 0xFD
+#define MAVLINK_HEADER_LEN_V1 6     // incl. STX
+#define MAVLINK_HEADER_LEN_V2 10    // incl. STX
+#define MAVLINK_CHECKSUM_LEN 2
+#define MAVLINK_SIGNATURE_LEN 13
+#define MAVLINK_IFLAG_SIGNED 0x01
+#define MAVLINK_MAX_PAYLOAD_LEN 255
+#define MAVLINK_MAX_FRAME_SIZE (MAVLINK_HEADER_LEN_V2 + MAVLINK_MAX_PAYLOAD_LEN + MAVLINK_CHECKSUM_LEN + \
+                                MAVLINK_SIGNATURE_LEN)
+
+typedef enum {
+    MAV_IDLE,
+    MAV_GOT_STX,
+    MAV_GOT_LENGTH,
+    MAV_FRAME_DATA,
+    MAV_FRAME_RECEIVED
+} mavlink_parse_state_e;
+
+typedef struct {
+    mavlink_parse_state_e parse_state;
+    uint8_t frame_buffer[MAVLINK_MAX_FRAME_SIZE];   // complete frame incl. STX, CRC & signature
+    uint16_t frame_length;                          // bytes of the current frame in frame_buffer
+    uint16_t expected_length;                       // total length of current frame once header is known
+    uint32_t msg_id;
+    uint8_t replay_buffer[MAVLINK_MAX_FRAME_SIZE];  // bytes of a rejected frame that need to be parsed again
+    uint16_t replay_length;
+    uint16_t replay_pos;
+    bool validated;             // false if the CRC of the frame in frame_buffer could not be checked (unknown msg_id)
+    uint32_t frames_received;   // statistics: valid frames
+    uint32_t unvalidated;       // frames of unknown messages passed on without CRC check
+    uint32_t bad_crcs;          // complete frames dropped because of a CRC mismatch
+    uint32_t resyncs;           // frames rejected because of an unknown incompatibility flag
+    void (*on_skipped_byte)(uint8_t skipped_byte);  // optional. Called for every byte that is not part of a frame
+} mavlink_port_t;
+
+void init_mavlink_port(mavlink_port_t *mavlink_port);
+bool parse_mavlink_buffer(mavlink_port_t *mavlink_port, const uint8_t *buf, size_t buf_len, size_t *buf_pos);
+bool get_mavlink_target(const uint8_t *frame, uint8_t *target_system, uint8_t *target_component);
+uint8_t get_mavlink_source_system(const uint8_t *frame);
+
+#endif //DB_ESP32_MAVLINK_SERIAL_H
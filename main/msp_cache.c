@@ -0,0 +1,226 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+#include "msp_cache.h"
+#include "db_crc.h"
+
+#define TAG "DB_MSP_CACHE"
+
+// Filled by the UART reader task, read by the network task
+static msp_cache_entry_t msp_cache[MSP_CACHE_MAX_ENTRIES];
+static int msp_cache_size = 0;
+static msp_cache_stats_t msp_cache_stats;
+static portMUX_TYPE msp_cache_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Sets up the commands to poll
+ *
+ * @param poll_list Commands & rates as "<cmd>:<rate in Hz>" separated by ",". E.g. "108:10,109:5,110:2"
+ * @return Number of commands that will be polled
+ */
+int msp_cache_init(const char *poll_list) {
+    memset(msp_cache, 0, sizeof(msp_cache));
+    memset(&msp_cache_stats, 0, sizeof(msp_cache_stats));
+    msp_cache_size = 0;
+    const char *pos = poll_list;
+    while (*pos != '\0' && msp_cache_size < MSP_CACHE_MAX_ENTRIES) {
+        char *end;
+        long cmd = strtol(pos, &end, 10);
+        if (end == pos || *end != ':') break;
+        pos = end + 1;
+        long rate = strtol(pos, &end, 10);
+        if (end == pos) break;
+        pos = (*end == ',') ? end + 1 : end;
+        if (cmd < 1 || cmd > 0xFFFF || rate < 1 || rate > MSP_CACHE_MAX_RATE_HZ) {
+            ESP_LOGW(TAG, "Ignoring invalid MSP poll entry %li:%li", cmd, rate);
+            continue;
+        }
+        msp_cache_entry_t *entry = &msp_cache[msp_cache_size++];
+        entry->cmd = (uint16_t) cmd;
+        entry->version = (cmd < MSP_V2_FRAME_ID) ? MSP_V1 : MSP_V2_NATIVE;
+        entry->period_us = 1000000 / rate;
+    }
+    ESP_LOGI(TAG, "Polling %i MSP command(s)", msp_cache_size);
+    return msp_cache_size;
+}
+
+bool msp_cache_enabled() {
+    return msp_cache_size > 0;
+}
+
+static msp_cache_entry_t *find_entry(uint16_t cmd) {
+    for (int i = 0; i < msp_cache_size; i++) {
+        if (msp_cache[i].cmd == cmd) return &msp_cache[i];
+    }
+    return NULL;
+}
+
+/**
+ * Builds the next due poll request. Call until it returns 0.
+ *
+ * @param now Current time in us
+ * @param request Filled with the request frame
+ * @return Length of the request. 0 if no request is due
+ */
+uint16_t msp_cache_due_request(int64_t now, uint8_t request[MSP_REQUEST_MAX_SIZE]) {
+    for (int i = 0; i < msp_cache_size; i++) {
+        msp_cache_entry_t *entry = &msp_cache[i];
+        if (entry->next_poll > now) continue;
+        entry->next_poll = now + entry->period_us;
+        portENTER_CRITICAL(&msp_cache_lock);
+        msp_cache_stats.polls++;
+        portEXIT_CRITICAL(&msp_cache_lock);
+        request[0] = '$';
+        request[2] = '<';
+        if (entry->version == MSP_V1) {
+            request[1] = 'M';
+            request[3] = 0;                     // size
+            request[4] = (uint8_t) entry->cmd;
+            request[5] = request[3] ^ request[4];
+            return 6;
+        }
+        request[1] = 'X';
+        request[3] = 0;                         // flags
+        request[4] = (uint8_t) (entry->cmd & 0xFF);
+        request[5] = (uint8_t) (entry->cmd >> 8);
+        request[6] = 0;                         // size
+        request[7] = 0;
+        request[8] = crc8_dvb_s2_buffer(0, &request[3], 5);
+        return 9;
+    }
+    return 0;
+}
+
+/**
+ * @return Time in us when the next poll is due. INT64_MAX if nothing is polled
+ */
+int64_t msp_cache_next_poll() {
+    int64_t next_poll = INT64_MAX;
+    for (int i = 0; i < msp_cache_size; i++) {
+        if (msp_cache[i].next_poll < next_poll) next_poll = msp_cache[i].next_poll;
+    }
+    return next_poll;
+}
+
+/**
+ * Stores the response in the cache if its command is polled. Responses of any MSP version update the entry
+ *
+ * @param msp_port Parser that just received a complete MSP frame
+ * @param now Current time in us
+ * @return true if the response must be sent to the clients. false if it was only requested by the poller
+ */
+bool msp_cache_update(const msp_ltm_port_t *msp_port, int64_t now) {
+    if (msp_port->msp_direction != '>') return true;
+    msp_cache_entry_t *entry = find_entry(msp_port->cmdMSP);
+    if (entry == NULL) return true;
+    portENTER_CRITICAL(&msp_cache_lock);
+    memcpy(entry->payload, msp_port->inBuf, msp_port->dataSize);
+    entry->payload_size = msp_port->dataSize;
+    entry->flags = msp_port->cmdFlags;
+    entry->last_update = now;
+    bool forward = entry->client_pending;
+    entry->client_pending = false;
+    msp_cache_stats.updates++;
+    portEXIT_CRITICAL(&msp_cache_lock);
+    return forward;
+}
+
+/**
+ * Builds the response frame of a cache entry in the MSP version of the request
+ *
+ * @return Length of the frame. 0 if it does not fit into the buffer or the command can not be sent in that version
+ */
+static uint16_t encode_response(const msp_cache_entry_t *entry, mspVersion_e version, uint8_t frame[],
+                                uint16_t frame_size) {
+    uint16_t size = entry->payload_size;
+    frame[0] = '$';
+    frame[2] = '>';
+    switch (version) {
+        case MSP_V1:
+            if (entry->cmd >= MSP_V2_FRAME_ID || size > 0xFF || frame_size < 6 + size) return 0;
+            frame[1] = 'M';
+            frame[3] = (uint8_t) size;
+            frame[4] = (uint8_t) entry->cmd;
+            memcpy(&frame[5], entry->payload, size);
+            frame[5 + size] = 0;
+            for (uint16_t i = 3; i < 5 + size; i++) frame[5 + size] ^= frame[i];
+            return 6 + size;
+        case MSP_V2_OVER_V1:
+            // v1 frame with command 255 that carries a v2 frame (header, payload & CRC) as payload
+            if (size + 6 > 0xFF || frame_size < 12 + size) return 0;
+            frame[1] = 'M';
+            frame[3] = (uint8_t) (size + 6);
+            frame[4] = MSP_V2_FRAME_ID;
+            break;
+        default:
+            if (frame_size < 9 + size) return 0;
+            frame[1] = 'X';
+            break;
+    }
+    uint8_t *v2 = (version == MSP_V2_OVER_V1) ? &frame[5] : &frame[3];
+    v2[0] = entry->flags;
+    v2[1] = (uint8_t) (entry->cmd & 0xFF);
+    v2[2] = (uint8_t) (entry->cmd >> 8);
+    v2[3] = (uint8_t) (size & 0xFF);
+    v2[4] = (uint8_t) (size >> 8);
+    memcpy(&v2[5], entry->payload, size);
+    v2[5 + size] = crc8_dvb_s2_buffer(0, v2, 5 + size);
+    if (version != MSP_V2_OVER_V1) return 9 + size;
+    frame[11 + size] = 0;
+    for (uint16_t i = 3; i < 11 + size; i++) frame[11 + size] ^= frame[i];
+    return 12 + size;
+}
+
+/**
+ * Looks for a fresh response to a client request. Entries are fresh for two poll intervals - one lost response is
+ * tolerated. Only requests without payload are answered. The response has the MSP version of the request.
+ *
+ * @param msp_port Parser that just received a complete MSP request
+ * @param now Current time in us
+ * @param response Filled with the response frame
+ * @param response_size Size of the response buffer
+ * @return Length of the response. 0 if the request must be passed on to the flight controller
+ */
+uint16_t msp_cache_lookup(const msp_ltm_port_t *msp_port, int64_t now, uint8_t response[], uint16_t response_size) {
+    if (msp_port->msp_direction != '<' || msp_port->dataSize > 0) return 0;
+    msp_cache_entry_t *entry = find_entry(msp_port->cmdMSP);
+    if (entry == NULL) return 0;
+    uint16_t length = 0;
+    portENTER_CRITICAL(&msp_cache_lock);
+    if (entry->last_update > 0 && now - entry->last_update < 2 * (int64_t) entry->period_us)
+        length = encode_response(entry, msp_port->mspVersion, response, response_size);
+    if (length > 0) {
+        msp_cache_stats.hits++;
+    } else {
+        entry->client_pending = true;
+        msp_cache_stats.misses++;
+    }
+    portEXIT_CRITICAL(&msp_cache_lock);
+    return length;
+}
+
+void msp_cache_get_stats(msp_cache_stats_t *stats) {
+    portENTER_CRITICAL(&msp_cache_lock);
+    *stats = msp_cache_stats;
+    portEXIT_CRITICAL(&msp_cache_lock);
+}
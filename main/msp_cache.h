@@ -0,0 +1,62 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#ifndef DB_ESP32_MSP_CACHE_H
+#define DB_ESP32_MSP_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "msp_ltm_serial.h"
+
+#define MSP_CACHE_MAX_ENTRIES 16
+#define MSP_CACHE_MAX_RATE_HZ 50
+#define MSP_REQUEST_MAX_SIZE 9      // request without payload: "$X<" + 5 byte header + CRC
+
+/**
+ * Latest response of the flight controller to a polled MSP command. Stored without framing so requests of any MSP
+ * version can be answered
+ */
+typedef struct {
+    uint16_t cmd;
+    mspVersion_e version;                   // MSP version used for polling
+    uint32_t period_us;                     // poll interval
+    int64_t next_poll;                      // only used by the uplink writer task. Not protected by the lock
+    int64_t last_update;                    // 0 if there was no response yet
+    bool client_pending;                    // a client request was passed on to the FC - forward the next response
+    uint8_t flags;                          // MSP v2 flags of the response
+    uint8_t payload[MSP_MAX_PAYLOAD_SIZE];
+    uint16_t payload_size;
+} msp_cache_entry_t;
+
+typedef struct {
+    uint32_t hits;          // client requests answered from the cache
+    uint32_t misses;        // client requests for polled commands passed on to the FC
+    uint32_t polls;         // requests sent by the poller
+    uint32_t updates;       // responses stored in the cache
+} msp_cache_stats_t;
+
+int msp_cache_init(const char *poll_list);
+bool msp_cache_enabled();
+uint16_t msp_cache_due_request(int64_t now, uint8_t request[MSP_REQUEST_MAX_SIZE]);
+int64_t msp_cache_next_poll();
+bool msp_cache_update(const msp_ltm_port_t *msp_port, int64_t now);
+uint16_t msp_cache_lookup(const msp_ltm_port_t *msp_port, int64_t now, uint8_t response[], uint16_t response_size);
+void msp_cache_get_stats(msp_cache_stats_t *stats);
+
+#endif //DB_ESP32_MSP_CACHE_H
@@ -19,6 +19,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 #include "msp_ltm_serial.h"
 #include "db_crc.h"
 
@@ -49,7 +50,11 @@ bool parse_msp_ltm_byte(msp_ltm_port_t *msp_ltm_port, uint8_t new_byte) {
                 msp_ltm_port->mspVersion = MSP_V1;
                 msp_ltm_port->parse_state = HEADER_START;
                 msp_ltm_port->ltm_frame_buffer[0] = '$';
-            } else { return false; }
+                msp_ltm_port->msp_frame_length = 0;
+            } else {
+                msp_ltm_port->skipped_bytes++;
+                return false;
+            }
             msp_ltm_port->ltm_payload_cnt = 0;
             msp_ltm_port->checksum1 = 0;
             break;
@@ -67,6 +72,7 @@ bool parse_msp_ltm_byte(msp_ltm_port_t *msp_ltm_port, uint8_t new_byte) {
                     msp_ltm_port->ltm_frame_buffer[1] = 'T';
                     break;
                 default:
+                    msp_ltm_port->resyncs++;
                     msp_ltm_port->parse_state = IDLE;
                     break;
             }
@@ -99,6 +105,7 @@ bool parse_msp_ltm_byte(msp_ltm_port_t *msp_ltm_port, uint8_t new_byte) {
                     msp_ltm_port->parse_state = LTM_TYPE_IDENT;
                     break;
                 default:
+                    msp_ltm_port->resyncs++;
                     msp_ltm_port->parse_state = IDLE;
                     break;
             }
@@ -124,6 +131,7 @@ bool parse_msp_ltm_byte(msp_ltm_port_t *msp_ltm_port, uint8_t new_byte) {
                     if (msp_ltm_port->ltm_payload_cnt == LTM_TYPE_S_PAYLOAD_SIZE) msp_ltm_port->parse_state = LTM_CRC;
                     break;
                 default:
+                    msp_ltm_port->resyncs++;
                     msp_ltm_port->parse_state = IDLE;
                     break;
             }
@@ -133,29 +141,35 @@ bool parse_msp_ltm_byte(msp_ltm_port_t *msp_ltm_port, uint8_t new_byte) {
             msp_ltm_port->ltm_frame_buffer[3 + msp_ltm_port->ltm_payload_cnt] = new_byte;
             if (msp_ltm_port->checksum1 == new_byte) {
                 msp_ltm_port->parse_state = LTM_PACKET_RECEIVED;
+                msp_ltm_port->frames_received++;
             } else {
+                msp_ltm_port->bad_checksums++;
                 msp_ltm_port->parse_state = IDLE;
             }
             break;
 
         case MSP_HEADER_M:
-            if (new_byte == '>') {
+            if (new_byte == '>' || new_byte == '<') {  // response or request
+                msp_ltm_port->msp_direction = new_byte;
                 msp_ltm_port->offset = 0;
                 msp_ltm_port->checksum1 = 0;
                 msp_ltm_port->checksum2 = 0;
                 msp_ltm_port->parse_state = MSP_HEADER_V1;
             } else {
+                msp_ltm_port->resyncs++;
                 msp_ltm_port->parse_state = IDLE;
             }
             break;
 
         case MSP_HEADER_X:
-            if (new_byte == '>') {
+            if (new_byte == '>' || new_byte == '<') {
+                msp_ltm_port->msp_direction = new_byte;
                 msp_ltm_port->offset = 0;
                 msp_ltm_port->checksum2 = 0;
                 msp_ltm_port->mspVersion = MSP_V2_NATIVE;
                 msp_ltm_port->parse_state = MSP_HEADER_V2_NATIVE;
             } else {
+                msp_ltm_port->resyncs++;
                 msp_ltm_port->parse_state = IDLE;
             }
             break;
@@ -166,13 +180,15 @@ bool parse_msp_ltm_byte(msp_ltm_port_t *msp_ltm_port, uint8_t new_byte) {
             if (msp_ltm_port->offset == sizeof(mspHeaderV1_t)) {
                 mspHeaderV1_t *hdr = (mspHeaderV1_t *) &msp_ltm_port->inBuf[0];
                 // Check incoming buffer size limit
-                if (hdr->size > MSP_PORT_INBUF_SIZE) {
+                if (hdr->size > MSP_MAX_PAYLOAD_SIZE) {
+                    msp_ltm_port->resyncs++;
                     msp_ltm_port->parse_state = IDLE;
                 } else if (hdr->cmd == MSP_V2_FRAME_ID) {
                     if (hdr->size >= sizeof(mspHeaderV2_t) + 1) {
                         msp_ltm_port->mspVersion = MSP_V2_OVER_V1;
                         msp_ltm_port->parse_state = MSP_HEADER_V2_OVER_V1;
                     } else {
+                        msp_ltm_port->resyncs++;
                         msp_ltm_port->parse_state = IDLE;
                     }
                 } else {
@@ -196,7 +212,9 @@ bool parse_msp_ltm_byte(msp_ltm_port_t *msp_ltm_port, uint8_t new_byte) {
         case MSP_CHECKSUM_V1:
             if (msp_ltm_port->checksum1 == new_byte) {
                 msp_ltm_port->parse_state = MSP_PACKET_RECEIVED;
+                msp_ltm_port->frames_received++;
             } else {
+                msp_ltm_port->bad_checksums++;
                 msp_ltm_port->parse_state = IDLE;
             }
             break;
@@ -208,7 +226,8 @@ bool parse_msp_ltm_byte(msp_ltm_port_t *msp_ltm_port, uint8_t new_byte) {
             if (msp_ltm_port->offset == (sizeof(mspHeaderV2_t) + sizeof(mspHeaderV1_t))) {
                 mspHeaderV2_t *hdrv2 = (mspHeaderV2_t *) &msp_ltm_port->inBuf[sizeof(mspHeaderV1_t)];
                 msp_ltm_port->dataSize = hdrv2->size;
-                if (hdrv2->size > MSP_PORT_INBUF_SIZE) {
+                if (hdrv2->size > MSP_MAX_PAYLOAD_SIZE) {
+                    msp_ltm_port->resyncs++;
                     msp_ltm_port->parse_state = IDLE;
                 } else {
                     msp_ltm_port->cmdMSP = hdrv2->cmd;
@@ -235,6 +254,7 @@ bool parse_msp_ltm_byte(msp_ltm_port_t *msp_ltm_port, uint8_t new_byte) {
             if (msp_ltm_port->checksum2 == new_byte) {
                 msp_ltm_port->parse_state = MSP_CHECKSUM_V1;
             } else {
+                msp_ltm_port->bad_checksums++;
                 msp_ltm_port->parse_state = IDLE;
             }
             break;
@@ -244,7 +264,8 @@ bool parse_msp_ltm_byte(msp_ltm_port_t *msp_ltm_port, uint8_t new_byte) {
             msp_ltm_port->checksum2 = crc8_dvb_s2_table(msp_ltm_port->checksum2, new_byte);
             if (msp_ltm_port->offset == sizeof(mspHeaderV2_t)) {
                 mspHeaderV2_t *hdrv2 = (mspHeaderV2_t *) &msp_ltm_port->inBuf[0];
-                if (hdrv2->size > MSP_PORT_INBUF_SIZE) {
+                if (hdrv2->size > MSP_MAX_PAYLOAD_SIZE) {
+                    msp_ltm_port->resyncs++;
                     msp_ltm_port->parse_state = IDLE;
                 } else {
                     msp_ltm_port->dataSize = hdrv2->size;
@@ -269,10 +290,110 @@ bool parse_msp_ltm_byte(msp_ltm_port_t *msp_ltm_port, uint8_t new_byte) {
         case MSP_CHECKSUM_V2_NATIVE:
             if (msp_ltm_port->checksum2 == new_byte) {
                 msp_ltm_port->parse_state = MSP_PACKET_RECEIVED;
+                msp_ltm_port->frames_received++;
             } else {
+                msp_ltm_port->bad_checksums++;
                 msp_ltm_port->parse_state = IDLE;
             }
             break;
     }
+    if (msp_ltm_port->msp_frame_length < MSP_MAX_FRAME_SIZE) {
+        msp_ltm_port->msp_frame_buffer[msp_ltm_port->msp_frame_length++] = new_byte;
+    }
     return true;
-}
\ No newline at end of file
+}
+
+/**
+ * Get the last complete frame. Only valid while parse_state is MSP_PACKET_RECEIVED or LTM_PACKET_RECEIVED
+ *
+ * @param frame Set to the start of the frame (incl. header & checksum) inside the parser
+ * @return Length of the frame
+ */
+uint16_t get_msp_ltm_frame(const msp_ltm_port_t *msp_ltm_port, const uint8_t **frame) {
+    if (msp_ltm_port->parse_state == LTM_PACKET_RECEIVED) {
+        *frame = msp_ltm_port->ltm_frame_buffer;
+        return msp_ltm_port->ltm_payload_cnt + 4;
+    }
+    *frame = msp_ltm_port->msp_frame_buffer;
+    return msp_ltm_port->msp_frame_length;
+}
+
+/**
+ * Copies as much payload as available in one go and updates the checksums over the whole span. Same as feeding the
+ * bytes one by one to parse_msp_ltm_byte()
+ *
+ * @return Number of bytes consumed
+ */
+static size_t parse_msp_payload_span(msp_ltm_port_t *msp_ltm_port, const uint8_t *buf, size_t buf_len) {
+    size_t span = msp_ltm_port->dataSize - msp_ltm_port->offset;
+    if (span > buf_len) span = buf_len;
+    memcpy(&msp_ltm_port->inBuf[msp_ltm_port->offset], buf, span);
+    memcpy(&msp_ltm_port->msp_frame_buffer[msp_ltm_port->msp_frame_length], buf, span);
+    msp_ltm_port->msp_frame_length += span;
+    msp_ltm_port->offset += span;
+    if (msp_ltm_port->parse_state != MSP_PAYLOAD_V2_NATIVE) {
+        uint8_t checksum1 = msp_ltm_port->checksum1;
+        for (size_t i = 0; i < span; i++) checksum1 ^= buf[i];
+        msp_ltm_port->checksum1 = checksum1;
+    }
+    if (msp_ltm_port->parse_state != MSP_PAYLOAD_V1) {
+        msp_ltm_port->checksum2 = crc8_dvb_s2_buffer(msp_ltm_port->checksum2, buf, span);
+    }
+    if (msp_ltm_port->offset == msp_ltm_port->dataSize) {
+        switch (msp_ltm_port->parse_state) {
+            case MSP_PAYLOAD_V1:
+                msp_ltm_port->parse_state = MSP_CHECKSUM_V1;
+                break;
+            case MSP_PAYLOAD_V2_OVER_V1:
+                msp_ltm_port->parse_state = MSP_CHECKSUM_V2_OVER_V1;
+                break;
+            default:
+                msp_ltm_port->parse_state = MSP_CHECKSUM_V2_NATIVE;
+                break;
+        }
+    }
+    return span;
+}
+
+/**
+ * Parses a whole buffer of MSP & LTM data. Produces exactly the same frames as calling parse_msp_ltm_byte() for every
+ * byte but skips the bytes between frames with memchr() and handles MSP payloads span by span.
+ *
+ * @param msp_ltm_port Parser state. Frames may span multiple buffers
+ * @param buf Bytes read from serial
+ * @param buf_len Number of bytes in buf
+ * @param on_frame Called for every complete frame. parse_state is MSP_PACKET_RECEIVED or LTM_PACKET_RECEIVED
+ */
+void parse_msp_ltm_buffer(msp_ltm_port_t *msp_ltm_port, const uint8_t *buf, size_t buf_len,
+                          msp_ltm_frame_cb_t on_frame) {
+    size_t pos = 0;
+    while (pos < buf_len) {
+        switch (msp_ltm_port->parse_state) {
+            case IDLE:
+            case MSP_PACKET_RECEIVED:
+            case LTM_PACKET_RECEIVED: {
+                const uint8_t *start = memchr(&buf[pos], '$', buf_len - pos);
+                if (start == NULL) {
+                    msp_ltm_port->skipped_bytes += buf_len - pos;
+                    return;
+                }
+                msp_ltm_port->skipped_bytes += (start - &buf[pos]);
+                pos = start - buf;
+                parse_msp_ltm_byte(msp_ltm_port, buf[pos++]);
+                break;
+            }
+            case MSP_PAYLOAD_V1:
+            case MSP_PAYLOAD_V2_OVER_V1:
+            case MSP_PAYLOAD_V2_NATIVE:
+                pos += parse_msp_payload_span(msp_ltm_port, &buf[pos], buf_len - pos);
+                break;
+            default:
+                parse_msp_ltm_byte(msp_ltm_port, buf[pos++]);
+                if (msp_ltm_port->parse_state == MSP_PACKET_RECEIVED ||
+                    msp_ltm_port->parse_state == LTM_PACKET_RECEIVED) {
+                    on_frame(msp_ltm_port);
+                }
+                break;
+        }
+    }
+}
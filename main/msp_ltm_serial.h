@@ -20,6 +20,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #define MSP_MAX_HEADER_SIZE 9
 #define MSP_V2_FRAME_ID 255
@@ -28,6 +29,8 @@
 #define MSP_PORT_DATAFLASH_BUFFER_SIZE 4096
 #define MSP_PORT_OUTBUF_SIZE 512
 #define MSP_VERSION_MAGIC_INITIALIZER { 'M', 'M', 'X' }
+#define MSP_MAX_PAYLOAD_SIZE MSP_PORT_OUTBUF_SIZE  // largest payload a flight controller sends. Covers every v1 frame
+#define MSP_MAX_FRAME_SIZE (MSP_MAX_HEADER_SIZE + 1 + MSP_MAX_PAYLOAD_SIZE + 2)  // incl. "$M>"/"$X>" & checksums
 
 #define LTM_TYPE_A_PAYLOAD_SIZE 6
 #define LTM_TYPE_G_PAYLOAD_SIZE 14
@@ -99,17 +102,24 @@ struct serialPort_s;
 typedef struct mspPort_s {
     struct serialPort_s *port; // null when port unused.
     msp_ltm_parse_state_e parse_state;
-    uint8_t inBuf[MSP_PORT_INBUF_SIZE];
+    uint8_t inBuf[MSP_MAX_PAYLOAD_SIZE];
     uint_fast16_t offset;
     uint_fast16_t dataSize;
     ltm_type_e ltm_type;
     uint8_t ltm_payload_cnt;
     uint8_t ltm_frame_buffer[LTM_MAX_FRAME_SIZE];
     mspVersion_e mspVersion;
+    uint8_t msp_direction;      // '>' response from FC, '<' request to FC
     uint8_t cmdFlags;
     uint16_t cmdMSP;
     uint8_t checksum1;
     uint8_t checksum2;
+    uint8_t msp_frame_buffer[MSP_MAX_FRAME_SIZE];   // all bytes of the current MSP frame as received
+    uint16_t msp_frame_length;
+    uint32_t frames_received;   // statistics: valid MSP & LTM frames
+    uint32_t bad_checksums;     // complete frames dropped because of a checksum mismatch
+    uint32_t resyncs;           // frames aborted because of an invalid header or size
+    uint32_t skipped_bytes;     // bytes outside of any frame (noise, unsupported protocols)
 } msp_ltm_port_t;
 
 // return positive for ACK, negative on error, zero for no reply
@@ -135,6 +145,11 @@ typedef struct mspPacket_s {
 
 //static msp_ltm_port_t mspPorts[MAX_MSP_PORT_COUNT];
 
+typedef void (*msp_ltm_frame_cb_t)(msp_ltm_port_t *msp_ltm_port);
+
 bool parse_msp_ltm_byte(msp_ltm_port_t *msp_ltm_port, uint8_t new_byte);
+uint16_t get_msp_ltm_frame(const msp_ltm_port_t *msp_ltm_port, const uint8_t **frame);
+void parse_msp_ltm_buffer(msp_ltm_port_t *msp_ltm_port, const uint8_t *buf, size_t buf_len,
+                          msp_ltm_frame_cb_t on_frame);
 
 #endif //CONTROL_STATUS_MSP_SERIAL_H
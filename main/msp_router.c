@@ -0,0 +1,146 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#include <string.h>
+#include "msp_router.h"
+
+// Only used by the network task
+static msp_pending_request_t pending_requests[MSP_ROUTER_MAX_PENDING];
+static msp_router_stats_t msp_router_stats;
+
+void msp_router_init() {
+    memset(pending_requests, 0, sizeof(pending_requests));
+    memset(&msp_router_stats, 0, sizeof(msp_router_stats));
+}
+
+static msp_pending_request_t *find_pending(uint16_t cmd, mspVersion_e version) {
+    for (int i = 0; i < MSP_ROUTER_MAX_PENDING; i++) {
+        if (pending_requests[i].used && pending_requests[i].cmd == cmd && pending_requests[i].version == version)
+            return &pending_requests[i];
+    }
+    return NULL;
+}
+
+static void add_requester(msp_pending_request_t *pending, int tcp_index, int tcp_socket,
+                          const struct sockaddr_in *udp_addr) {
+    if (tcp_index >= 0) {
+        for (int i = 0; i < pending->tcp_count; i++) {
+            msp_tcp_requester_t *requester = &pending->tcp_requesters[i];
+            if (requester->tcp_index == tcp_index && requester->tcp_socket == tcp_socket) return;
+        }
+        if (pending->tcp_count < MSP_ROUTER_MAX_TCP_REQUESTERS) {
+            pending->tcp_requesters[pending->tcp_count].tcp_index = tcp_index;
+            pending->tcp_requesters[pending->tcp_count++].tcp_socket = tcp_socket;
+        } else {
+            pending->overflow = true;
+        }
+        return;
+    }
+    for (int i = 0; i < pending->udp_count; i++) {
+        if (pending->udp_requesters[i].sin_addr.s_addr == udp_addr->sin_addr.s_addr &&
+            pending->udp_requesters[i].sin_port == udp_addr->sin_port) return;
+    }
+    if (pending->udp_count < MSP_ROUTER_MAX_UDP_REQUESTERS) {
+        pending->udp_requesters[pending->udp_count++] = *udp_addr;
+    } else {
+        pending->overflow = true;
+    }
+}
+
+/**
+ * Registers a client request. Identical requests without payload are merged while the first one is waiting for its
+ * response.
+ *
+ * @param request Parser that just received a complete MSP request
+ * @param now Current time in us
+ * @param tcp_index Index of the requesting TCP client. -1 for UDP clients
+ * @param tcp_socket Socket of the requesting TCP client. Ignored for UDP clients
+ * @param udp_addr Address of the requesting UDP client. Ignored for TCP clients
+ * @return true if the request must be written to the UART. false if it was merged into a pending request
+ */
+bool msp_router_request(const msp_ltm_port_t *request, int64_t now, int tcp_index, int tcp_socket,
+                        const struct sockaddr_in *udp_addr) {
+    msp_pending_request_t *pending = find_pending(request->cmdMSP, request->mspVersion);
+    if (pending != NULL && now - pending->sent_time > MSP_ROUTER_TIMEOUT_US) {
+        pending->used = false;  // response got lost
+        pending = NULL;
+    }
+    if (pending != NULL) {
+        add_requester(pending, tcp_index, tcp_socket, udp_addr);
+        if (request->dataSize == 0) {
+            msp_router_stats.coalesced++;
+            return false;
+        }
+        msp_router_stats.forwarded++;
+        return true;  // requests with payload (e.g. MSP_SET_*) always reach the FC
+    }
+    for (int i = 0; i < MSP_ROUTER_MAX_PENDING && pending == NULL; i++) {
+        if (!pending_requests[i].used || now - pending_requests[i].sent_time > MSP_ROUTER_TIMEOUT_US)
+            pending = &pending_requests[i];
+    }
+    msp_router_stats.forwarded++;
+    if (pending == NULL) return true;  // table full - response will be sent to all clients
+    memset(pending, 0, sizeof(msp_pending_request_t));
+    pending->used = true;
+    pending->cmd = request->cmdMSP;
+    pending->version = request->mspVersion;
+    pending->sent_time = now;
+    add_requester(pending, tcp_index, tcp_socket, udp_addr);
+    return true;
+}
+
+/**
+ * Looks up who requested a response from the flight controller. The request is no longer pending afterwards
+ *
+ * @param frame Complete MSP response frame
+ * @param frame_length Length of the frame
+ * @param requesters Filled with the clients to send the response to
+ * @return true if the requesters are known. false if the response must be sent to all clients
+ */
+bool msp_router_response(const uint8_t *frame, uint16_t frame_length, msp_pending_request_t *requesters) {
+    uint16_t cmd;
+    mspVersion_e version;
+    if (frame_length >= 11 && frame[1] == 'M' && frame[4] == MSP_V2_FRAME_ID) {
+        version = MSP_V2_OVER_V1;
+        cmd = frame[6] | (frame[7] << 8);
+    } else if (frame_length >= 6 && frame[1] == 'M') {
+        version = MSP_V1;
+        cmd = frame[4];
+    } else if (frame_length >= 9 && frame[1] == 'X') {
+        version = MSP_V2_NATIVE;
+        cmd = frame[4] | (frame[5] << 8);
+    } else {
+        msp_router_stats.unsolicited++;
+        return false;
+    }
+    msp_pending_request_t *pending = find_pending(cmd, version);
+    if (pending == NULL || pending->overflow) {
+        if (pending != NULL) pending->used = false;
+        msp_router_stats.unsolicited++;
+        return false;
+    }
+    *requesters = *pending;
+    pending->used = false;
+    msp_router_stats.routed++;
+    return true;
+}
+
+void msp_router_get_stats(msp_router_stats_t *stats) {
+    *stats = msp_router_stats;
+}
@@ -0,0 +1,66 @@
+/*
+ *   This file is part of DroneBridge: https://github.com/seeul8er/DroneBridge
+ *
+ *   Copyright 2019 Wolfgang Christl
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ */
+
+#ifndef DB_ESP32_MSP_ROUTER_H
+#define DB_ESP32_MSP_ROUTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lwip/sockets.h"
+#include "msp_ltm_serial.h"
+
+#define MSP_ROUTER_MAX_PENDING 16           // max. number of distinct requests in flight
+#define MSP_ROUTER_MAX_TCP_REQUESTERS 4
+#define MSP_ROUTER_MAX_UDP_REQUESTERS 4
+#define MSP_ROUTER_TIMEOUT_US 250000        // FC did not answer. Next identical request is passed on again
+
+typedef struct {
+    int tcp_index;
+    int tcp_socket;                         // detects that the TCP slot was reused by another client
+} msp_tcp_requester_t;
+
+/**
+ * MSP request passed on to the flight controller and everybody waiting for its response
+ */
+typedef struct {
+    bool used;
+    uint16_t cmd;
+    mspVersion_e version;
+    int64_t sent_time;
+    uint8_t tcp_count;
+    msp_tcp_requester_t tcp_requesters[MSP_ROUTER_MAX_TCP_REQUESTERS];
+    uint8_t udp_count;
+    bool overflow;                          // too many requesters - response is sent to all clients
+    struct sockaddr_in udp_requesters[MSP_ROUTER_MAX_UDP_REQUESTERS];
+} msp_pending_request_t;
+
+typedef struct {
+    uint32_t forwarded;     // requests written to the UART
+    uint32_t coalesced;     // requests merged into a pending one
+    uint32_t routed;        // responses sent to their requesters only
+    uint32_t unsolicited;   // responses without a known requester. Sent to all clients
+} msp_router_stats_t;
+
+void msp_router_init();
+bool msp_router_request(const msp_ltm_port_t *request, int64_t now, int tcp_index, int tcp_socket,
+                        const struct sockaddr_in *udp_addr);
+bool msp_router_response(const uint8_t *frame, uint16_t frame_length, msp_pending_request_t *requesters);
+void msp_router_get_stats(msp_router_stats_t *stats);
+
+#endif //DB_ESP32_MSP_ROUTER_H
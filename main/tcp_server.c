@@ -17,12 +17,29 @@
  *
  */
 
+#include <string.h>
+#include <stdlib.h>
+#include <sys/param.h>
+#include <freertos/FreeRTOS.h>
 #include "esp_event.h"
 #include "esp_log.h"
 #include "lwip/err.h"
 #include "lwip/sockets.h"
+#include "tcp_server.h"
+#include "db_platform.h"
+#include "db_latency.h"
 
 #define TCP_TAG "TCP_SERVER_SETUP"
+#define TCP_KEEPALIVE_IDLE 5        // seconds without data before the first keepalive probe is sent
+#define TCP_KEEPALIVE_INTERVAL 1    // seconds between keepalive probes
+#define TCP_KEEPALIVE_COUNT 3       // unanswered probes until the connection is considered dead
+
+static db_tcp_stamp_t send_stamp;   // only used by the network task
+
+// Set by the comm task, applied by the network task
+static db_tcp_profile_t tcp_profiles[TCP_MAX_PROFILES];
+static uint32_t profile_generation = 0;
+static portMUX_TYPE profile_lock = portMUX_INITIALIZER_UNLOCKED;
 
 int open_tcp_server(int port) {
     char addr_str[128];
@@ -42,6 +59,8 @@ int open_tcp_server(int port) {
         ESP_LOGE(TCP_TAG, "Unable to create socket: %s", esp_err_to_name(errno));
         return ESP_FAIL;
     }
+    int reuse = 1;  // restarted bridge can listen while connections of the previous one are in TIME_WAIT
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
     int err = bind(listen_sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
     if (err != 0) {
         ESP_LOGE(TCP_TAG, "Socket unable to bind: %s", esp_err_to_name(errno));
@@ -56,15 +75,287 @@ int open_tcp_server(int port) {
     return listen_sock;
 }
 
-void send_to_all_tcp_clients(const int tcp_clients[], uint8_t data[], uint data_length) {
+void init_tcp_clients(db_tcp_client_t tcp_clients[]) {
+    for (int i = 0; i < CONFIG_LWIP_MAX_ACTIVE_TCP; i++) {
+        memset(&tcp_clients[i], 0, sizeof(db_tcp_client_t));
+        tcp_clients[i].socket = -1;
+    }
+}
+
+/**
+ * Enable/disable TCP_NODELAY. Low latency sends every packet right away. Otherwise small packets are coalesced by
+ * Nagle's algorithm - fewer but bigger TCP segments, better for clients that only log/display the data.
+ */
+void set_tcp_client_low_latency(db_tcp_client_t *tcp_client, bool low_latency) {
+    int no_delay = low_latency ? 1 : 0;
+    setsockopt(tcp_client->socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+    tcp_client->low_latency = low_latency;
+}
+
+/**
+ * Sets the latency profile & overflow policy of a client. Replaces its previous profile. Called by the comm task
+ *
+ * @param ip_addr IPv4 address of the client in network byte order
+ * @param low_latency See set_tcp_client_low_latency()
+ * @param overflow_policy TCP_OVERFLOW_DROP_OLDEST or TCP_OVERFLOW_DISCONNECT
+ * @return false if there is no space for another client profile
+ */
+bool db_tcp_profile_set(uint32_t ip_addr, bool low_latency, uint8_t overflow_policy) {
+    bool is_default = low_latency == DB_TCP_LOW_LATENCY && overflow_policy == DB_TCP_OVERFLOW_POLICY;
+    bool success = true;
+    portENTER_CRITICAL(&profile_lock);
+    db_tcp_profile_t *profile = NULL;
+    db_tcp_profile_t *unused = NULL;
+    for (int i = 0; i < TCP_MAX_PROFILES; i++) {
+        if (tcp_profiles[i].used && tcp_profiles[i].ip_addr == ip_addr) profile = &tcp_profiles[i];
+        else if (!tcp_profiles[i].used && unused == NULL) unused = &tcp_profiles[i];
+    }
+    if (profile == NULL && !is_default) profile = unused;
+    if (profile != NULL) {
+        profile->used = !is_default;  // default profile needs no entry
+        profile->ip_addr = ip_addr;
+        profile->low_latency = low_latency;
+        profile->overflow_policy = overflow_policy;
+        __atomic_store_n(&profile_generation, profile_generation + 1, __ATOMIC_RELEASE);
+    } else if (!is_default) {
+        success = false;
+    }
+    portEXIT_CRITICAL(&profile_lock);
+    return success;
+}
+
+/**
+ * Applies the profile of its IP address to a client. Defaults if there is none
+ */
+static void apply_tcp_profile(db_tcp_client_t *tcp_client) {
+    bool low_latency = DB_TCP_LOW_LATENCY;
+    uint8_t overflow_policy = DB_TCP_OVERFLOW_POLICY;
+    portENTER_CRITICAL(&profile_lock);
+    for (int i = 0; i < TCP_MAX_PROFILES; i++) {
+        if (tcp_profiles[i].used && tcp_profiles[i].ip_addr == tcp_client->ip_addr) {
+            low_latency = tcp_profiles[i].low_latency;
+            overflow_policy = tcp_profiles[i].overflow_policy;
+            break;
+        }
+    }
+    tcp_client->profile_generation = profile_generation;
+    portEXIT_CRITICAL(&profile_lock);
+    tcp_client->overflow_policy = overflow_policy;
+    if (low_latency != tcp_client->low_latency) set_tcp_client_low_latency(tcp_client, low_latency);
+}
+
+/**
+ * Applies profiles that changed since the last call to the connected clients. Called by the network task
+ */
+void update_tcp_profiles(db_tcp_client_t tcp_clients[]) {
+    uint32_t generation = __atomic_load_n(&profile_generation, __ATOMIC_ACQUIRE);
     for (int i = 0; i < CONFIG_LWIP_MAX_ACTIVE_TCP; i++) {
-        if (tcp_clients[i] > 0) {
-            ESP_LOGD(TCP_TAG, "Sending %i bytes", data_length);
-            int err = write(tcp_clients[i], data, data_length);
-            if (err < 0) {
+        if (tcp_clients[i].socket >= 0 && tcp_clients[i].profile_generation != generation)
+            apply_tcp_profile(&tcp_clients[i]);
+    }
+}
+
+/**
+ * Set up a newly accepted client: non-blocking, keepalive, latency profile & send queue
+ *
+ * @param tcp_client Unused slot
+ * @param socket Accepted socket
+ * @param ip_addr IPv4 address of the client in network byte order
+ * @return true on success. false if send queue could not be allocated. Socket is not closed in that case
+ */
+bool add_tcp_client(db_tcp_client_t *tcp_client, int socket, uint32_t ip_addr) {
+    uint8_t *queue = malloc(TCP_CLIENT_QUEUE_SIZE);
+    if (queue == NULL) {
+        ESP_LOGE(TCP_TAG, "Could not allocate send queue for new client");
+        return false;
+    }
+    uint32_t evictions = tcp_client->evictions;
+    uint32_t send_errors = tcp_client->send_errors;
+    memset(tcp_client, 0, sizeof(db_tcp_client_t));
+    tcp_client->socket = socket;
+    tcp_client->ip_addr = ip_addr;
+    tcp_client->queue = queue;
+    tcp_client->evictions = evictions;
+    tcp_client->send_errors = send_errors;
+    fcntl(socket, F_SETFL, O_NONBLOCK);
+    // detect dead clients (e.g. left Wi-Fi range) fast so their slot gets freed
+    int keepalive = 1, keepidle = TCP_KEEPALIVE_IDLE, keepintvl = TCP_KEEPALIVE_INTERVAL, keepcnt = TCP_KEEPALIVE_COUNT;
+    setsockopt(socket, SOL_SOCKET, SO_KEEPALIVE, &keepalive, sizeof(keepalive));
+    setsockopt(socket, IPPROTO_TCP, TCP_KEEPIDLE, &keepidle, sizeof(keepidle));
+    setsockopt(socket, IPPROTO_TCP, TCP_KEEPINTVL, &keepintvl, sizeof(keepintvl));
+    setsockopt(socket, IPPROTO_TCP, TCP_KEEPCNT, &keepcnt, sizeof(keepcnt));
+    set_tcp_client_low_latency(tcp_client, DB_TCP_LOW_LATENCY);
+    apply_tcp_profile(tcp_client);
+    return true;
+}
+
+void close_tcp_client(db_tcp_client_t *tcp_client) {
+    if (tcp_client->socket < 0) return;
+    ESP_LOGI(TCP_TAG, "Closing client (fd: %i). Queued: %u bytes, sent: %u bytes, dropped: %u packets (%u bytes)",
+             tcp_client->socket, tcp_client->queued_bytes, tcp_client->sent_bytes, tcp_client->dropped_packets,
+             tcp_client->dropped_bytes);
+    shutdown(tcp_client->socket, 0);
+    close(tcp_client->socket);
+    tcp_client->socket = -1;
+    free(tcp_client->queue);
+    tcp_client->queue = NULL;
+    tcp_client->packet_count = 0;
+    tcp_client->queue_head = tcp_client->queue_tail = 0;
+}
+
+/**
+ * Sets the timestamps of the downlink packet the network task is about to send. Everything sent to TCP clients until
+ * the next call carries them. The send & total latency is recorded once the socket took the last byte of a packet.
+ *
+ * @param stamp Timestamps of the packet. NULL for data that is not downlink telemetry - no latency is recorded
+ */
+void set_tcp_send_stamp(const db_tcp_stamp_t *stamp) {
+    if (stamp != NULL) send_stamp = *stamp;
+    else memset(&send_stamp, 0, sizeof(send_stamp));
+}
+
+static void record_send_latency(const db_tcp_stamp_t *stamp) {
+    if (stamp->first_byte == 0 && stamp->dequeued == 0) return;
+    uint32_t now = (uint32_t) db_time_us();
+    db_latency_record(DB_LATENCY_SEND, now - stamp->dequeued);
+    db_latency_record(DB_LATENCY_TOTAL, now - stamp->first_byte);
+}
+
+/**
+ * @return true if the client has data waiting to be sent. Network task should wait for the socket to become writable
+ */
+bool tcp_client_has_pending(const db_tcp_client_t *tcp_client) {
+    return tcp_client->socket >= 0 && tcp_client->packet_count > 0;
+}
+
+/**
+ * Removes the oldest packet from the send queue
+ */
+static void drop_first_packet(db_tcp_client_t *tcp_client) {
+    uint16_t length = tcp_client->packet_lengths[tcp_client->packet_first];
+    tcp_client->queue_tail += length - tcp_client->first_packet_sent;
+    tcp_client->first_packet_sent = 0;
+    tcp_client->packet_first = (tcp_client->packet_first + 1) % TCP_CLIENT_QUEUE_PACKETS;
+    tcp_client->packet_count--;
+}
+
+/**
+ * Sends as much of the send queue as the socket accepts without blocking. Closes the client on error
+ */
+void flush_tcp_client(db_tcp_client_t *tcp_client) {
+    while (tcp_client_has_pending(tcp_client)) {
+        uint32_t pos = tcp_client->queue_tail & (TCP_CLIENT_QUEUE_SIZE - 1);
+        uint32_t length = tcp_client->packet_lengths[tcp_client->packet_first] - tcp_client->first_packet_sent;
+        if (length > TCP_CLIENT_QUEUE_SIZE - pos) length = TCP_CLIENT_QUEUE_SIZE - pos;  // up to end of the queue
+        int sent = send(tcp_client->socket, &tcp_client->queue[pos], length, MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
                 ESP_LOGE(TCP_TAG, "Error occurred during sending: %d", errno);
+                tcp_client->send_errors++;
+                close_tcp_client(tcp_client);
             }
+            return;
+        }
+        tcp_client->sent_bytes += sent;
+        tcp_client->first_packet_sent += sent;
+        tcp_client->queue_tail += sent;
+        if (tcp_client->first_packet_sent == tcp_client->packet_lengths[tcp_client->packet_first]) {
+            record_send_latency(&tcp_client->packet_stamps[tcp_client->packet_first]);
+            drop_first_packet(tcp_client);
+        }
+        if (sent < length) return;  // socket buffer full
+    }
+}
+
+/**
+ * Adds a packet to the send queue of the client. Applies the overflow policy of the client if the queue is full. Packets are
+ * always sent/dropped as a whole so the receiver never sees a truncated frame.
+ *
+ * @return false if the packet was dropped or the client got disconnected
+ */
+static bool enqueue_tcp_client(db_tcp_client_t *tcp_client, const uint8_t data[], uint data_length) {
+    while (data_length > TCP_CLIENT_QUEUE_SIZE - (tcp_client->queue_head - tcp_client->queue_tail) ||
+           tcp_client->packet_count == TCP_CLIENT_QUEUE_PACKETS) {
+        if (tcp_client->overflow_policy == TCP_OVERFLOW_DISCONNECT) {
+            ESP_LOGW(TCP_TAG, "Client (fd: %i) can not keep up - disconnecting", tcp_client->socket);
+            tcp_client->evictions++;
+            close_tcp_client(tcp_client);
+            return false;
         }
+        // a partially sent packet must be completed, otherwise the stream gets corrupted
+        if (tcp_client->packet_count == 0 || tcp_client->first_packet_sent > 0 || data_length > TCP_CLIENT_QUEUE_SIZE) {
+            tcp_client->dropped_packets++;
+            tcp_client->dropped_bytes += data_length;
+            return false;
+        }
+        tcp_client->dropped_packets++;
+        tcp_client->dropped_bytes += tcp_client->packet_lengths[tcp_client->packet_first];
+        drop_first_packet(tcp_client);
     }
+    uint32_t pos = tcp_client->queue_head & (TCP_CLIENT_QUEUE_SIZE - 1);
+    uint32_t first_part = MIN(data_length, TCP_CLIENT_QUEUE_SIZE - pos);
+    memcpy(&tcp_client->queue[pos], data, first_part);
+    memcpy(tcp_client->queue, &data[first_part], data_length - first_part);
+    tcp_client->queue_head += data_length;
+    uint8_t packet = (tcp_client->packet_first + tcp_client->packet_count) % TCP_CLIENT_QUEUE_PACKETS;
+    tcp_client->packet_lengths[packet] = data_length;
+    tcp_client->packet_stamps[packet] = send_stamp;
+    tcp_client->packet_count++;
+    tcp_client->queued_bytes += data_length;
+    return true;
+}
+
+/**
+ * Sends the packet straight from the callers buffer. Only what the socket does not accept is copied to the send queue.
+ * Must only be called if the send queue is empty.
+ */
+static void send_direct_tcp_client(db_tcp_client_t *tcp_client, const uint8_t data[], uint data_length) {
+    int sent = send(tcp_client->socket, data, data_length, MSG_DONTWAIT);
+    if (sent < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            ESP_LOGE(TCP_TAG, "Error occurred during sending: %d", errno);
+            tcp_client->send_errors++;
+            close_tcp_client(tcp_client);
+            return;
+        }
+        sent = 0;
+    }
+    tcp_client->sent_bytes += sent;
+    if (sent == data_length) {
+        record_send_latency(&send_stamp);
+        return;
+    }
+    if (enqueue_tcp_client(tcp_client, data, data_length)) {
+        // keep the packet in one piece in the queue but skip what already went out
+        tcp_client->queue_tail += sent;
+        tcp_client->first_packet_sent = sent;
+    } else if (sent > 0 && tcp_client->socket >= 0) {
+        // the client got the start of the packet - dropping the rest would corrupt the stream
+        ESP_LOGW(TCP_TAG, "Client (fd: %i) can not take the rest of a packet - disconnecting", tcp_client->socket);
+        tcp_client->evictions++;
+        close_tcp_client(tcp_client);
+    }
+}
 
-}
\ No newline at end of file
+/**
+ * Sends the data to one client without blocking. Data that can not be sent right away is queued.
+ */
+void send_to_tcp_client(db_tcp_client_t *tcp_client, uint8_t data[], uint data_length) {
+    if (tcp_client->socket < 0) return;
+    ESP_LOGD(TCP_TAG, "Sending %i bytes", data_length);
+    if (tcp_client->packet_count == 0) {
+        send_direct_tcp_client(tcp_client, data, data_length);
+    } else if (enqueue_tcp_client(tcp_client, data, data_length)) {
+        flush_tcp_client(tcp_client);
+    }
+}
+
+/**
+ * Sends the data to every connected client without blocking. A slow client only fills up its own queue and never
+ * delays the others. Clients that are keeping up get the data without an extra copy into their send queue.
+ */
+void send_to_all_tcp_clients(db_tcp_client_t tcp_clients[], uint8_t data[], uint data_length) {
+    for (int i = 0; i < CONFIG_LWIP_MAX_ACTIVE_TCP; i++) {
+        send_to_tcp_client(&tcp_clients[i], data, data_length);
+    }
+}
@@ -20,9 +20,79 @@
 #ifndef DB_ESP32_TCP_SERVER_H
 #define DB_ESP32_TCP_SERVER_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include "db_filter.h"
+
 #define TCP_BUFF_SIZ 4096
+#define TCP_CLIENT_QUEUE_SIZE 4096      // bytes. Send queue of every TCP client. Power of two
+#define TCP_CLIENT_QUEUE_PACKETS 32     // max. number of packets in the send queue of a TCP client
+
+#define TCP_MAX_PROFILES 8              // max. number of client IPs with their own profile
+
+// What to do with a client whose send queue is full
+#define TCP_OVERFLOW_DROP_OLDEST 0      // drop the oldest packets that were not yet started to be sent
+#define TCP_OVERFLOW_DISCONNECT 1       // close the connection. Client can reconnect and gets fresh data
+#ifndef DB_TCP_OVERFLOW_POLICY
+#define DB_TCP_OVERFLOW_POLICY TCP_OVERFLOW_DROP_OLDEST  // default of clients without a profile
+#endif
+#ifndef DB_TCP_LOW_LATENCY
+#define DB_TCP_LOW_LATENCY true         // default latency profile of new clients. See set_tcp_client_low_latency()
+#endif
+
+/**
+ * Latency profile & overflow policy a client asked for. Applies to all TCP telemetry connections from its IP address
+ */
+typedef struct {
+    bool used;
+    uint32_t ip_addr;                   // network byte order
+    bool low_latency;
+    uint8_t overflow_policy;            // TCP_OVERFLOW_DROP_OLDEST or TCP_OVERFLOW_DISCONNECT
+} db_tcp_profile_t;
+
+/**
+ * Downlink timestamps of a packet sent to TCP clients. All 0 for other data (e.g. cached MSP responses)
+ */
+typedef struct {
+    uint32_t first_byte;                            // us. First byte was read from the UART
+    uint32_t dequeued;                              // us. Packet was taken from the downlink ring
+} db_tcp_stamp_t;
+
+typedef struct {
+    int socket;                                     // -1 if slot is unused
+    uint32_t ip_addr;                               // IPv4 address of the client in network byte order
+    uint8_t *queue;                                 // send queue. Allocated while client is connected
+    uint32_t queue_head;                            // free running write counter (bytes)
+    uint32_t queue_tail;                            // free running read counter (bytes)
+    uint16_t packet_lengths[TCP_CLIENT_QUEUE_PACKETS];
+    db_tcp_stamp_t packet_stamps[TCP_CLIENT_QUEUE_PACKETS];
+    uint8_t packet_first;                           // index of the oldest packet in packet_lengths
+    uint8_t packet_count;
+    uint16_t first_packet_sent;                     // bytes of the oldest packet already sent
+    bool low_latency;
+    uint8_t overflow_policy;                        // TCP_OVERFLOW_DROP_OLDEST or TCP_OVERFLOW_DISCONNECT
+    uint32_t profile_generation;                    // profiles applied to this connection. See update_tcp_profiles()
+    db_filter_state_t filter_state;                 // telemetry filter rate limits of this connection
+    uint32_t queued_bytes;                          // statistics of the current connection. Copied to queue
+    uint32_t sent_bytes;
+    uint32_t received_bytes;
+    uint32_t dropped_packets;
+    uint32_t dropped_bytes;
+    uint32_t evictions;                             // number of times a client in this slot was disconnected
+    uint32_t send_errors;                           // number of times a client in this slot failed with a send error
+} db_tcp_client_t;
 
 int open_tcp_server(int port);
-void send_to_all_tcp_clients(const int tcp_clients[], uint8_t data[], uint data_length);
+void init_tcp_clients(db_tcp_client_t tcp_clients[]);
+bool add_tcp_client(db_tcp_client_t *tcp_client, int socket, uint32_t ip_addr);
+void close_tcp_client(db_tcp_client_t *tcp_client);
+void set_tcp_client_low_latency(db_tcp_client_t *tcp_client, bool low_latency);
+bool db_tcp_profile_set(uint32_t ip_addr, bool low_latency, uint8_t overflow_policy);
+void update_tcp_profiles(db_tcp_client_t tcp_clients[]);
+void set_tcp_send_stamp(const db_tcp_stamp_t *stamp);
+bool tcp_client_has_pending(const db_tcp_client_t *tcp_client);
+void flush_tcp_client(db_tcp_client_t *tcp_client);
+void send_to_tcp_client(db_tcp_client_t *tcp_client, uint8_t data[], uint data_length);
+void send_to_all_tcp_clients(db_tcp_client_t tcp_clients[], uint8_t data[], uint data_length);
 
 #endif //DB_ESP32_TCP_SERVER_H